@@ -298,6 +298,24 @@ struct hailo_vdma_interrupts_wait_params {
         irq_data[MAX_VDMA_CHANNELS_PER_ENGINE * MAX_VDMA_ENGINES];  // out
 };
 
+/* structure mapped to user space by ioctl HAILO_VDMA_COMPLETION_RING_CREATE */
+#define HAILO_VDMA_COMPLETION_RING_ENTRIES (1024)
+#define HAILO_VDMA_COMPLETION_RING_ENTRIES_MASK (HAILO_VDMA_COMPLETION_RING_ENTRIES - 1)
+
+struct hailo_vdma_completion_ring {
+    uint32_t head;                  // Written by the driver, index of the next entry to be written.
+    uint32_t tail;                  // Written by the user, index of the next entry to be read.
+    struct hailo_vdma_interrupts_channel_data
+        entries[HAILO_VDMA_COMPLETION_RING_ENTRIES];
+};
+
+/* structure used in ioctl HAILO_VDMA_COMPLETION_RING_CREATE */
+struct hailo_vdma_completion_ring_create_params {
+    uint32_t channels_bitmap_per_engine[MAX_VDMA_ENGINES];  // in, channels that report completions on the ring.
+    uintptr_t ring_handle;                                  // out, used as the mmap offset of the ring.
+    size_t ring_size;                                       // out, size to mmap.
+};
+
 /* structure used in ioctl HAILO_VDMA_INTERRUPTS_READ_TIMESTAMPS */
 struct hailo_vdma_interrupts_read_timestamp_params {
     uint8_t engine_index;                                                               // in
@@ -484,6 +502,14 @@ struct hailo_free_continuous_buffer_params {
     uintptr_t buffer_handle;    // in
 };
 
+/* structure used in ioctl HAILO_VDMA_BUFFER_EXPORT_DMABUF */
+// Exports a low memory or continuous buffer allocated by the driver as a dmabuf, so other devices can import it.
+// The buffer memory stays valid (even if freed) until the dmabuf is closed by all of its users.
+struct hailo_vdma_buffer_export_dmabuf_params {
+    uintptr_t buffer_handle;    // in
+    int dmabuf_fd;              // out
+};
+
 /* structures used in ioctl HAILO_VDMA_LAUNCH_TRANSFER */
 struct hailo_vdma_transfer_buffer {
     size_t mapped_buffer_handle;       // in
@@ -517,6 +543,43 @@ struct hailo_vdma_launch_transfer_params {
     int launch_transfer_status;                                         // out, status of the launch transfer call. (only used in case of error)
 };
 
+/* structure used in ioctl HAILO_VDMA_LAUNCH_SCATTER_TRANSFER */
+#define HAILO_VDMA_MAX_BUFFERS_PER_SCATTER_TRANSFER (64)
+
+// Same as hailo_vdma_launch_transfer_params, with a variable length list of buffers (e.g. planes of a multi-planar
+// frame), programmed as a single transfer with a single doorbell and completion.
+struct hailo_vdma_launch_scatter_transfer_params {
+    uint8_t engine_index;                                               // in
+    uint8_t channel_index;                                              // in
+
+    uintptr_t desc_handle;                                              // in
+    uint32_t starting_desc;                                             // in
+
+    bool should_bind;                                                   // in, if false, assumes buffer already bound.
+    uint32_t buffers_count;                                             // in, up to HAILO_VDMA_MAX_BUFFERS_PER_SCATTER_TRANSFER
+    uint64_t buffers;                                                   // in, user address of buffers_count
+                                                                        // struct hailo_vdma_transfer_buffer
+
+    enum hailo_vdma_interrupts_domain first_interrupts_domain;          // in
+    enum hailo_vdma_interrupts_domain last_interrupts_domain;           // in
+
+    bool is_debug;                                                      // in, if set program hw to send
+                                                                        // more info (e.g desc complete status)
+
+    uint32_t descs_programed;                                           // out, amount of descriptors programed.
+    int launch_transfer_status;                                         // out, status of the launch transfer call. (only used in case of error)
+};
+
+/* structure used in ioctl HAILO_VDMA_LAUNCH_TRANSFERS_BATCH */
+#define HAILO_VDMA_MAX_TRANSFERS_PER_BATCH (32)
+
+struct hailo_vdma_launch_transfers_batch_params {
+    uint32_t transfers_count;                                           // in
+    struct hailo_vdma_launch_transfer_params
+        transfers[HAILO_VDMA_MAX_TRANSFERS_PER_BATCH];                  // in/out, each transfer gets its own
+                                                                        // descs_programed and launch_transfer_status.
+};
+
 /* structure used in ioctl HAILO_SOC_CONNECT */
 struct hailo_soc_connect_params {
     uint16_t port_number;           // in
@@ -571,6 +634,8 @@ struct tCompatibleHailoIoctlData
         struct hailo_read_log_params ReadLog;
         struct hailo_mark_as_in_use_params MarkAsInUse;
         struct hailo_vdma_launch_transfer_params LaunchTransfer;
+        struct hailo_vdma_launch_transfers_batch_params LaunchTransfersBatch;
+        struct hailo_vdma_completion_ring_create_params CompletionRingCreate;
         struct hailo_soc_connect_params ConnectParams;
         struct hailo_soc_close_params SocCloseParams;
         struct hailo_pci_ep_accept_params AcceptParams;
@@ -612,6 +677,10 @@ enum hailo_vdma_ioctl_code {
     HAILO_VDMA_CONTINUOUS_BUFFER_ALLOC_CODE,
     HAILO_VDMA_CONTINUOUS_BUFFER_FREE_CODE,
     HAILO_VDMA_LAUNCH_TRANSFER_CODE,
+    HAILO_VDMA_LAUNCH_TRANSFERS_BATCH_CODE,
+    HAILO_VDMA_COMPLETION_RING_CREATE_CODE,
+    HAILO_VDMA_LAUNCH_SCATTER_TRANSFER_CODE,
+    HAILO_VDMA_BUFFER_EXPORT_DMABUF_CODE,
 
     // Must be last
     HAILO_VDMA_IOCTL_MAX_NR,
@@ -639,6 +708,10 @@ enum hailo_vdma_ioctl_code {
 #define HAILO_VDMA_CONTINUOUS_BUFFER_FREE     _IOR_(HAILO_VDMA_IOCTL_MAGIC,  HAILO_VDMA_CONTINUOUS_BUFFER_FREE_CODE,       struct hailo_free_continuous_buffer_params)
 
 #define HAILO_VDMA_LAUNCH_TRANSFER           _IOWR_(HAILO_VDMA_IOCTL_MAGIC,  HAILO_VDMA_LAUNCH_TRANSFER_CODE,              struct hailo_vdma_launch_transfer_params)
+#define HAILO_VDMA_LAUNCH_TRANSFERS_BATCH    _IOWR_(HAILO_VDMA_IOCTL_MAGIC,  HAILO_VDMA_LAUNCH_TRANSFERS_BATCH_CODE,       struct hailo_vdma_launch_transfers_batch_params)
+#define HAILO_VDMA_COMPLETION_RING_CREATE    _IOWR_(HAILO_VDMA_IOCTL_MAGIC,  HAILO_VDMA_COMPLETION_RING_CREATE_CODE,       struct hailo_vdma_completion_ring_create_params)
+#define HAILO_VDMA_LAUNCH_SCATTER_TRANSFER   _IOWR_(HAILO_VDMA_IOCTL_MAGIC,  HAILO_VDMA_LAUNCH_SCATTER_TRANSFER_CODE,      struct hailo_vdma_launch_scatter_transfer_params)
+#define HAILO_VDMA_BUFFER_EXPORT_DMABUF      _IOWR_(HAILO_VDMA_IOCTL_MAGIC,  HAILO_VDMA_BUFFER_EXPORT_DMABUF_CODE,         struct hailo_vdma_buffer_export_dmabuf_params)
 
 enum hailo_nnc_ioctl_code {
     HAILO_FW_CONTROL_CODE,
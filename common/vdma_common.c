@@ -5,16 +5,24 @@
 
 #include "vdma_common.h"
 
+#include <asm/barrier.h>
+#include <linux/bitops.h>
 #include <linux/bug.h>
 #include <linux/circ_buf.h>
+#include <linux/compiler.h>
 #include <linux/errno.h>
 #include <linux/kconfig.h>
 #include <linux/kernel.h>
 #include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/printk.h>
+#include <linux/string.h>
 #include <linux/timekeeping.h>
 #include <linux/types.h>
 
+#define CREATE_TRACE_POINTS
+#include "vdma_trace.h"
+
 #define VDMA_CHANNEL_CONTROL_START (0x1)
 #define VDMA_CHANNEL_CONTROL_ABORT (0b00)
 #define VDMA_CHANNEL_CONTROL_ABORT_PAUSE (0b10)
@@ -62,10 +70,10 @@
 
 #define ONGOING_TRANSFERS_CIRC_SPACE(transfers_list)                           \
   CIRC_SPACE((transfers_list).head, (transfers_list).tail,                     \
-             HAILO_VDMA_MAX_ONGOING_TRANSFERS)
+             (transfers_list).size)
 #define ONGOING_TRANSFERS_CIRC_CNT(transfers_list)                             \
-  CIRC_CNT((transfers_list).head, (transfers_list).tail,                       \
-           HAILO_VDMA_MAX_ONGOING_TRANSFERS)
+  CIRC_CNT((transfers_list).head, (transfers_list).tail, (transfers_list).size)
+#define ONGOING_TRANSFERS_MASK(transfers_list) ((transfers_list).size - 1)
 
 #ifndef for_each_sgtable_dma_sg
 #define for_each_sgtable_dma_sg(sgt, sg, i)                                    \
@@ -76,7 +84,8 @@ static int
 ongoing_transfer_push(struct hailo_vdma_channel *channel,
                       struct hailo_ongoing_transfer *ongoing_transfer) {
   struct hailo_ongoing_transfers_list *transfers = &channel->ongoing_transfers;
-  if (!ONGOING_TRANSFERS_CIRC_SPACE(*transfers)) {
+  if ((NULL == transfers->transfers) ||
+      !ONGOING_TRANSFERS_CIRC_SPACE(*transfers)) {
     return -EFAULT;
   }
 
@@ -86,8 +95,7 @@ ongoing_transfer_push(struct hailo_vdma_channel *channel,
   }
 
   transfers->transfers[transfers->head] = *ongoing_transfer;
-  transfers->head =
-      (transfers->head + 1) & HAILO_VDMA_MAX_ONGOING_TRANSFERS_MASK;
+  transfers->head = (transfers->head + 1) & ONGOING_TRANSFERS_MASK(*transfers);
   return 0;
 }
 
@@ -102,8 +110,7 @@ ongoing_transfer_pop(struct hailo_vdma_channel *channel,
   if (ongoing_transfer) {
     *ongoing_transfer = transfers->transfers[transfers->tail];
   }
-  transfers->tail =
-      (transfers->tail + 1) & HAILO_VDMA_MAX_ONGOING_TRANSFERS_MASK;
+  transfers->tail = (transfers->tail + 1) & ONGOING_TRANSFERS_MASK(*transfers);
   return 0;
 }
 
@@ -268,19 +275,16 @@ static int bind_and_program_descriptors_list(
                        ? starting_desc + desc_list->desc_count - 1
                        : desc_list->desc_count - 1;
 
-  pr_err("Bind descriptors prog-size %lld max_desc_index %lld",
-         (long long)program_size, (long long)max_desc_index);
   for_each_sgtable_dma_sg(buffer->sg_table, sg_entry, i) {
+    if (0 == program_size) {
+      // The rest of the sg entries are out of the programmed range.
+      break;
+    }
+
     // Skip sg entries until we reach the right buffer offset. offset can be in
     // the middle of an sg entry.
-
-    // pr_err("dma sg buffer_current_offset %lx sg_dma_len %llx < buffer "
-    //        "offset %llx program_size %llx",
-    //        buffer_current_offset, (long long)sg_dma_len(sg_entry),
-    //        (long long)buffer->offset, (long long)program_size);
     if (buffer_current_offset + sg_dma_len(sg_entry) < buffer->offset) {
       buffer_current_offset += sg_dma_len(sg_entry);
-      pr_err("skip");
       continue;
     }
     chunk_start_addr = (buffer_current_offset < buffer->offset)
@@ -292,12 +296,12 @@ static int bind_and_program_descriptors_list(
                              (buffer->offset - buffer_current_offset))
                      : (u32)(sg_dma_len(sg_entry));
     chunk_size = min((u32)program_size, chunk_size);
-    pr_err("chunk_start_addr %lld chunk_size %lld", (long long)chunk_start_addr,
-           (long long)chunk_size);
 
     descs_programmed_in_chunk = hailo_vdma_program_descriptors_in_chunk(
         vdma_hw, chunk_start_addr, chunk_size, desc_list, starting_desc,
         max_desc_index, channel_index, vdma_hw->ddr_data_id);
+    trace_hailo_vdma_program_chunk(channel_index, chunk_start_addr, chunk_size,
+                                   starting_desc, descs_programmed_in_chunk);
 
     if (descs_programmed_in_chunk < 0) {
       pr_err("descs_programmed_in_chunk < 0");
@@ -320,6 +324,8 @@ static int bind_and_program_descriptors_list(
       .PageSize_DescControl |=
       get_interrupts_bitmask(vdma_hw, last_desc_interrupts, is_debug);
 
+  trace_hailo_vdma_bind(channel_index, starting_desc - desc_programmed, buffer,
+                        desc_programmed);
   return desc_programmed;
 }
 
@@ -362,6 +368,8 @@ static bool channel_control_reg_is_active(u8 control) {
          VDMA_CHANNEL_CONTROL_START;
 }
 
+// Reads the channel register word once, checks the channel is active and in
+// sync with the num available shadow, and keeps the word for the doorbell.
 static int validate_channel_state(struct hailo_vdma_channel *channel) {
   u32 host_regs_value = ioread32(channel->host_regs);
   const u8 control = READ_BITS_AT_OFFSET(BYTE_SIZE * BITS_IN_BYTE,
@@ -375,35 +383,44 @@ static int validate_channel_state(struct hailo_vdma_channel *channel) {
     return -ECONNRESET;
   }
 
-  if (hw_num_avail != channel->state.num_avail) {
+  if (hw_num_avail != channel->state.hw_num_avail) {
     pr_err(
         "Channel %d hw state out of sync. num available is %d, expected %d\n",
-        channel->index, hw_num_avail, channel->state.num_avail);
+        channel->index, hw_num_avail, channel->state.hw_num_avail);
+    // Resync the shadow, so the error is reported once and not on every
+    // following launch.
+    channel->state.hw_num_avail = hw_num_avail;
     return -EFAULT;
   }
 
+  channel->state.regs_value = host_regs_value;
+  channel->state.regs_value_valid = true;
   return 0;
 }
 
-void hailo_vdma_set_num_avail(u8 __iomem *regs, u16 num_avail) {
-  u32 regs_val = ioread32(regs);
+static void write_num_avail(u8 __iomem *regs, u32 regs_value, u16 num_avail) {
   iowrite32(WRITE_BITS_AT_OFFSET(WORD_SIZE * BITS_IN_BYTE,
                                  CHANNEL_NUM_AVAIL_OFFSET * BITS_IN_BYTE,
-                                 regs_val, num_avail),
+                                 regs_value, num_avail),
             regs);
 }
 
+void hailo_vdma_set_num_avail(u8 __iomem *regs, u16 num_avail) {
+  write_num_avail(regs, ioread32(regs), num_avail);
+}
+
 u16 hailo_vdma_get_num_proc(u8 __iomem *regs) {
   return READ_BITS_AT_OFFSET(WORD_SIZE * BITS_IN_BYTE, 0,
                              ioread32(regs + CHANNEL_NUM_PROC_OFFSET));
 }
 
-int hailo_vdma_launch_transfer(
+static int prepare_transfer(
     struct hailo_vdma_hw *vdma_hw, struct hailo_vdma_channel *channel,
     struct hailo_vdma_descriptors_list *desc_list, u32 starting_desc,
     u8 buffers_count, struct hailo_vdma_mapped_transfer_buffer *buffers,
     bool should_bind, enum hailo_vdma_interrupts_domain first_interrupts_domain,
-    enum hailo_vdma_interrupts_domain last_desc_interrupts, bool is_debug) {
+    enum hailo_vdma_interrupts_domain last_desc_interrupts, bool is_debug,
+    bool validate_hw_state, bool is_partial) {
   int ret = -EFAULT;
   u32 total_descs = 0;
   u32 first_desc = starting_desc;
@@ -412,9 +429,12 @@ int hailo_vdma_launch_transfer(
   struct hailo_ongoing_transfer ongoing_transfer = {0};
   u8 i = 0;
 
-  channel->state.desc_count_mask = (desc_list->desc_count - 1);
+  if (NULL == channel->ongoing_transfers.transfers) {
+    // The channel is not enabled.
+    return -ECONNRESET;
+  }
 
-  pr_err("transfer started %d\n", channel->index);
+  channel->state.desc_count_mask = (desc_list->desc_count - 1);
 
   if (NULL == channel->last_desc_list) {
     // First transfer on this active channel, store desc list.
@@ -425,12 +445,9 @@ int hailo_vdma_launch_transfer(
     return -EINVAL;
   }
 
-  ret = validate_channel_state(channel);
-  if (ret < 0) {
-
-    pr_err("Validate channel failed %d\n", channel->index);
-    return ret;
-  }
+  // Any transfer prepared after the last validation makes the register word it
+  // read too old to be written back.
+  channel->state.regs_value_valid = false;
 
   if (channel->state.num_avail != (u16)starting_desc) {
     pr_err("Channel %d state out of sync. num available is %d, expected %d\n",
@@ -450,13 +467,19 @@ int hailo_vdma_launch_transfer(
   ongoing_transfer.dirty_descs[0] = (u16)starting_desc;
 
   for (i = 0; i < buffers_count; i++) {
-    pr_err("buffer %d\n", i);
     ret = hailo_vdma_program_descriptors_list(
         vdma_hw, desc_list, starting_desc, &buffers[i], should_bind,
         channel->index,
         (i == (buffers_count - 1) ? last_desc_interrupts
                                   : HAILO_VDMA_INTERRUPTS_DOMAIN_NONE),
         is_debug);
+    if (ret < 0) {
+      // Nothing was pushed and num_avail is untouched, so the descriptors
+      // programmed so far are simply overwritten by the next transfer.
+      pr_err("Failed to program descriptors list for channel %d, err %d\n",
+             channel->index, ret);
+      return ret;
+    }
 
     total_descs += ret;
     last_desc = (starting_desc + ret - 1) % desc_list->desc_count;
@@ -472,26 +495,177 @@ int hailo_vdma_launch_transfer(
 
   ongoing_transfer.last_desc = (u16)last_desc;
   ongoing_transfer.is_debug = is_debug;
+  ongoing_transfer.is_partial = is_partial;
+  ongoing_transfer.launch_timestamp_ns = ktime_get_ns();
+
+  // Validated only now, right before the transfer is pushed, so the doorbell
+  // writes back a register word read just before it. When batching, only the
+  // first transfer of the channel is validated.
+  if (validate_hw_state) {
+    ret = validate_channel_state(channel);
+    if (ret < 0) {
+      pr_err("Validate channel failed %d\n", channel->index);
+      return ret;
+    }
+  }
+
   ret = ongoing_transfer_push(channel, &ongoing_transfer);
   if (ret < 0) {
     pr_err("Failed push ongoing transfer to channel %d\n", channel->index);
     return ret;
   }
+  trace_hailo_vdma_launch(channel, &ongoing_transfer, first_desc, total_descs);
 
   new_num_avail = (u16)((last_desc + 1) % desc_list->desc_count);
   channel->state.num_avail = new_num_avail;
-  hailo_vdma_set_num_avail(channel->host_regs, new_num_avail);
 
   return (int)total_descs;
 }
 
-static void hailo_vdma_push_timestamp(struct hailo_vdma_channel *channel) {
+// Prepares a transfer with more buffers than a single ongoing transfer can hold
+// as several ongoing transfers. Only the first one may raise the first
+// descriptor interrupts and only the last one the last descriptor interrupts,
+// so the hw sees a single transfer. On failure, the parts already prepared are
+// rolled back.
+static int prepare_scatter_transfer(
+    struct hailo_vdma_hw *vdma_hw, struct hailo_vdma_channel *channel,
+    struct hailo_vdma_descriptors_list *desc_list, u32 starting_desc,
+    u8 buffers_count, struct hailo_vdma_mapped_transfer_buffer *buffers,
+    bool should_bind, enum hailo_vdma_interrupts_domain first_interrupts_domain,
+    enum hailo_vdma_interrupts_domain last_desc_interrupts, bool is_debug,
+    bool validate_hw_state) {
+  struct hailo_ongoing_transfers_list *transfers = &channel->ongoing_transfers;
+  const u16 initial_num_avail = channel->state.num_avail;
+  const unsigned long initial_head = transfers->head;
+  const u8 parts_count =
+      DIV_ROUND_UP(buffers_count, HAILO_MAX_BUFFERS_PER_SINGLE_TRANSFER);
+  u8 first_buffer = 0, part_buffers_count = 0;
+  bool is_last_part = false;
+  u32 total_descs = 0;
+  int ret = 0;
+
+  if (buffers_count > HAILO_VDMA_MAX_BUFFERS_PER_SCATTER_TRANSFER) {
+    pr_err("Too many buffers %u for scatter transfer\n", buffers_count);
+    return -EINVAL;
+  }
+
+  if (NULL == transfers->transfers) {
+    // The channel is not enabled.
+    return -ECONNRESET;
+  }
+
+  if (ONGOING_TRANSFERS_CIRC_SPACE(*transfers) < parts_count) {
+    return -ENOBUFS;
+  }
+
+  for (first_buffer = 0; first_buffer < buffers_count;
+       first_buffer += part_buffers_count) {
+    part_buffers_count = min_t(u8, buffers_count - first_buffer,
+                               HAILO_MAX_BUFFERS_PER_SINGLE_TRANSFER);
+    is_last_part = ((first_buffer + part_buffers_count) == buffers_count);
+
+    ret = prepare_transfer(
+        vdma_hw, channel, desc_list,
+        (0 == first_buffer) ? starting_desc : channel->state.num_avail,
+        part_buffers_count, &buffers[first_buffer], should_bind,
+        (0 == first_buffer) ? first_interrupts_domain
+                            : HAILO_VDMA_INTERRUPTS_DOMAIN_NONE,
+        is_last_part ? last_desc_interrupts : HAILO_VDMA_INTERRUPTS_DOMAIN_NONE,
+        is_debug, (0 == first_buffer) && validate_hw_state, !is_last_part);
+    if (ret < 0) {
+      goto rollback;
+    }
+    total_descs += ret;
+  }
+
+  return (int)total_descs;
+
+rollback:
+  while (transfers->head != initial_head) {
+    transfers->head =
+        (transfers->head - 1) & ONGOING_TRANSFERS_MASK(*transfers);
+    clear_dirty_descs(channel, &transfers->transfers[transfers->head]);
+  }
+  channel->state.num_avail = initial_num_avail;
+  return ret;
+}
+
+int hailo_vdma_prepare_transfer(
+    struct hailo_vdma_hw *vdma_hw, struct hailo_vdma_channel *channel,
+    struct hailo_vdma_descriptors_list *desc_list, u32 starting_desc,
+    u8 buffers_count, struct hailo_vdma_mapped_transfer_buffer *buffers,
+    bool should_bind, enum hailo_vdma_interrupts_domain first_interrupts_domain,
+    enum hailo_vdma_interrupts_domain last_desc_interrupts, bool is_debug,
+    bool validate_hw_state) {
+  u8 i = 0;
+  int ret = 0;
+
+  if (buffers_count <= HAILO_MAX_BUFFERS_PER_SINGLE_TRANSFER) {
+    ret = prepare_transfer(vdma_hw, channel, desc_list, starting_desc,
+                           buffers_count, buffers, should_bind,
+                           first_interrupts_domain, last_desc_interrupts,
+                           is_debug, validate_hw_state, false);
+  } else {
+    ret = prepare_scatter_transfer(vdma_hw, channel, desc_list, starting_desc,
+                                   buffers_count, buffers, should_bind,
+                                   first_interrupts_domain,
+                                   last_desc_interrupts, is_debug,
+                                   validate_hw_state);
+  }
+  if (ret < 0) {
+    channel->stats.launch_failures++;
+    return ret;
+  }
+
+  channel->stats.transfers_launched++;
+  channel->stats.descs_programmed += ret;
+  for (i = 0; i < buffers_count; i++) {
+    channel->stats.bytes_launched += buffers[i].size;
+  }
+
+  return ret;
+}
+
+void hailo_vdma_channel_ring_doorbell(struct hailo_vdma_channel *channel) {
+  trace_hailo_vdma_doorbell(channel);
+
+  if (likely(channel->state.regs_value_valid)) {
+    write_num_avail(channel->host_regs, channel->state.regs_value,
+                    channel->state.num_avail);
+  } else {
+    hailo_vdma_set_num_avail(channel->host_regs, channel->state.num_avail);
+  }
+
+  channel->state.regs_value_valid = false;
+  channel->state.hw_num_avail = channel->state.num_avail;
+}
+
+int hailo_vdma_launch_transfer(
+    struct hailo_vdma_hw *vdma_hw, struct hailo_vdma_channel *channel,
+    struct hailo_vdma_descriptors_list *desc_list, u32 starting_desc,
+    u8 buffers_count, struct hailo_vdma_mapped_transfer_buffer *buffers,
+    bool should_bind, enum hailo_vdma_interrupts_domain first_interrupts_domain,
+    enum hailo_vdma_interrupts_domain last_desc_interrupts, bool is_debug) {
+  int ret = hailo_vdma_prepare_transfer(
+      vdma_hw, channel, desc_list, starting_desc, buffers_count, buffers,
+      should_bind, first_interrupts_domain, last_desc_interrupts, is_debug,
+      true);
+  if (ret < 0) {
+    return ret;
+  }
+
+  hailo_vdma_channel_ring_doorbell(channel);
+  return ret;
+}
+
+static void hailo_vdma_push_timestamp(struct hailo_vdma_channel *channel,
+                                      u64 timestamp_ns) {
   struct hailo_channel_interrupt_timestamp_list *timestamp_list =
       &channel->timestamp_list;
   const u16 num_proc = hailo_vdma_get_num_proc(channel->host_regs);
   if (TIMESTAMPS_CIRC_SPACE(*timestamp_list) != 0) {
     timestamp_list->timestamps[timestamp_list->head].timestamp_ns =
-        ktime_get_ns();
+        timestamp_ns;
     timestamp_list->timestamps[timestamp_list->head].desc_num_processed =
         num_proc;
     timestamp_list->head =
@@ -538,6 +712,9 @@ static void hailo_vdma_pop_timestamps_to_response(
 
 static void channel_state_init(struct hailo_vdma_channel_state *state) {
   state->num_avail = state->num_proc = 0;
+  state->hw_num_avail = 0;
+  state->regs_value = 0;
+  state->regs_value_valid = false;
 
   // Special value used when the channel is not activate.
   state->desc_count_mask = U32_MAX;
@@ -577,6 +754,7 @@ void hailo_vdma_engine_init(struct hailo_vdma_engine *engine, u8 engine_index,
     channel->device_regs =
         get_channel_regs(regs_base, channel_index, false, src_channels_bitmask);
     channel->index = channel_index;
+    channel->engine_index = engine_index;
     channel->timestamp_measure_enabled = false;
 
     channel_state_init(&channel->state);
@@ -584,6 +762,11 @@ void hailo_vdma_engine_init(struct hailo_vdma_engine *engine, u8 engine_index,
 
     channel->ongoing_transfers.head = 0;
     channel->ongoing_transfers.tail = 0;
+    channel->ongoing_transfers.size = 0;
+    channel->ongoing_transfers.transfers = NULL;
+
+    channel->last_interrupt_timestamp_ns = 0;
+    memset(&channel->stats, 0, sizeof(channel->stats));
   }
 }
 
@@ -615,10 +798,13 @@ void hailo_vdma_engine_enable_channels(struct hailo_vdma_engine *engine,
  *
  * @param engine - dma engine.
  * @param bitmap - channels bitmap to enable.
- * @param measure_timestamp - if set, allow interrupts timestamp measure.
+ * @param transfer_aborted - called for each ongoing transfer of the channels.
+ * @param transfer_aborted_opaque - opaque passed to transfer_aborted.
  */
 void hailo_vdma_engine_disable_channels(struct hailo_vdma_engine *engine,
-                                        u32 bitmap) {
+                                        u32 bitmap,
+                                        transfer_done_cb_t transfer_aborted,
+                                        void *transfer_aborted_opaque) {
   struct hailo_vdma_channel *channel = NULL;
   u8 channel_index = 0;
 
@@ -631,6 +817,7 @@ void hailo_vdma_engine_disable_channels(struct hailo_vdma_engine *engine,
       while (ONGOING_TRANSFERS_CIRC_CNT(channel->ongoing_transfers) > 0) {
         struct hailo_ongoing_transfer transfer;
         ongoing_transfer_pop(channel, &transfer);
+        transfer_aborted(&transfer, transfer_aborted_opaque);
 
         if (channel->last_desc_list == NULL) {
           pr_err("Channel %d has ongoing transfers but no desc list\n",
@@ -650,11 +837,22 @@ void hailo_vdma_engine_push_timestamps(struct hailo_vdma_engine *engine,
                                        u32 bitmap) {
   struct hailo_vdma_channel *channel = NULL;
   u8 channel_index = 0;
+  u64 timestamp_ns = 0;
 
+  if (0 == bitmap) {
+    return;
+  }
+
+  timestamp_ns = ktime_get_ns();
+  trace_hailo_vdma_irq(engine->index, bitmap, timestamp_ns);
   for_each_vdma_channel(engine, channel, channel_index) {
-    if (unlikely(hailo_test_bit(channel_index, &bitmap) &&
-                 channel->timestamp_measure_enabled)) {
-      hailo_vdma_push_timestamp(channel);
+    if (!hailo_test_bit(channel_index, &bitmap)) {
+      continue;
+    }
+
+    WRITE_ONCE(channel->last_interrupt_timestamp_ns, timestamp_ns);
+    if (unlikely(channel->timestamp_measure_enabled)) {
+      hailo_vdma_push_timestamp(channel, timestamp_ns);
     }
   }
 }
@@ -683,34 +881,65 @@ void hailo_vdma_engine_set_channel_interrupts(struct hailo_vdma_engine *engine,
   engine->interrupted_channels |= bitmap;
 }
 
+static u8 read_channel_control(u8 __iomem *regs) {
+  return READ_BITS_AT_OFFSET(BYTE_SIZE * BITS_IN_BYTE,
+                             CHANNEL_CONTROL_OFFSET * BITS_IN_BYTE,
+                             ioread32(regs));
+}
+
+static u8 read_channel_error(u8 __iomem *regs) {
+  return READ_BITS_AT_OFFSET(BYTE_SIZE * BITS_IN_BYTE, 0,
+                             ioread32(regs + CHANNEL_ERROR_OFFSET));
+}
+
 static void
 fill_channel_irq_data(struct hailo_vdma_interrupts_channel_data *irq_data,
                       struct hailo_vdma_engine *engine,
                       struct hailo_vdma_channel *channel,
                       u8 transfers_completed, bool validation_success) {
-  u8 host_control = READ_BITS_AT_OFFSET(BYTE_SIZE * BITS_IN_BYTE,
-                                        CHANNEL_CONTROL_OFFSET * BITS_IN_BYTE,
-                                        ioread32(channel->host_regs));
-  u8 device_control = READ_BITS_AT_OFFSET(BYTE_SIZE * BITS_IN_BYTE,
-                                          CHANNEL_CONTROL_OFFSET * BITS_IN_BYTE,
-                                          ioread32(channel->device_regs));
+  // Each register read is a non-posted PCIe read, so the device side is read
+  // only if the host side is active, and the error registers only if the
+  // channel is not active (a channel error stops the channel).
+  const bool is_active =
+      channel_control_reg_is_active(read_channel_control(channel->host_regs)) &&
+      channel_control_reg_is_active(read_channel_control(channel->device_regs));
 
   irq_data->engine_index = engine->index;
   irq_data->channel_index = channel->index;
 
-  irq_data->is_active = channel_control_reg_is_active(host_control) &&
-                        channel_control_reg_is_active(device_control);
+  irq_data->is_active = is_active;
 
   irq_data->transfers_completed = transfers_completed;
-  irq_data->host_error =
-      READ_BITS_AT_OFFSET(BYTE_SIZE * BITS_IN_BYTE, 0,
-                          ioread32(channel->host_regs + CHANNEL_ERROR_OFFSET));
-  irq_data->device_error = READ_BITS_AT_OFFSET(
-      BYTE_SIZE * BITS_IN_BYTE, 0,
-      ioread32(channel->device_regs + CHANNEL_ERROR_OFFSET));
+  if (likely(is_active)) {
+    irq_data->host_error = 0;
+    irq_data->device_error = 0;
+  } else {
+    irq_data->host_error = read_channel_error(channel->host_regs);
+    irq_data->device_error = read_channel_error(channel->device_regs);
+  }
   irq_data->validation_success = validation_success;
 }
 
+static void update_latency_histogram(struct hailo_vdma_channel *channel,
+                                     struct hailo_ongoing_transfer *transfer) {
+  const u64 interrupt_timestamp_ns =
+      READ_ONCE(channel->last_interrupt_timestamp_ns);
+  u64 latency_us = 0;
+  u32 bucket = 0;
+
+  // The transfer may be completed without an interrupt after its launch (e.g.
+  // by an interrupt of a previous transfer).
+  if (interrupt_timestamp_ns < transfer->launch_timestamp_ns) {
+    return;
+  }
+
+  latency_us =
+      div_u64(interrupt_timestamp_ns - transfer->launch_timestamp_ns, 1000);
+  bucket = min_t(u32, fls64(latency_us),
+                 HAILO_VDMA_LATENCY_HISTOGRAM_BUCKETS - 1);
+  channel->stats.latency_histogram[bucket]++;
+}
+
 static bool is_desc_between(u16 begin, u16 end, u16 desc) {
   if (begin == end) {
     // There is nothing between
@@ -736,21 +965,78 @@ static bool is_transfer_complete(struct hailo_vdma_channel *channel,
                          transfer->last_desc);
 }
 
+// Completes all the transfers of the channel that were processed by the hw.
+// Returns the amount of transfers completed.
+// A channel interrupt is consumed by a single path (the completion ring push
+// or the interrupts wait), which is the only one that should count a spurious
+// wakeup.
+static u8 complete_channel_transfers(struct hailo_vdma_channel *channel,
+                                     transfer_done_cb_t transfer_done,
+                                     void *transfer_done_opaque,
+                                     bool count_spurious_wakeup,
+                                     bool *validation_success) {
+  u8 transfers_completed = 0;
+  u16 hw_num_proc = U16_MAX;
+
+  BUILD_BUG_ON_MSG((HAILO_VDMA_MAX_ONGOING_TRANSFERS_DEPTH - 1) > U8_MAX,
+                   "HAILO_VDMA_MAX_ONGOING_TRANSFERS_DEPTH must be at most "
+                   "U8_MAX + 1 to use transfers_completed as u8");
+
+  // Although the hw_num_processed should be a number between 0 and
+  // desc_count-1, if desc_count < 0x10000 (the maximum desc size),
+  // the actual hw_num_processed is a number between 1 and desc_count.
+  // Therefore the value can be desc_count, in this case we change it to
+  // zero.
+  hw_num_proc = hailo_vdma_get_num_proc(channel->host_regs) &
+                channel->state.desc_count_mask;
+
+  while (ONGOING_TRANSFERS_CIRC_CNT(channel->ongoing_transfers) > 0) {
+    struct hailo_ongoing_transfer *cur_transfer =
+        &channel->ongoing_transfers.transfers[channel->ongoing_transfers.tail];
+    if (!is_transfer_complete(channel, cur_transfer, hw_num_proc)) {
+      break;
+    }
+
+    // The last descriptor of a partial transfer is programmed without
+    // interrupts, and so without a status request.
+    if (cur_transfer->is_debug && !cur_transfer->is_partial &&
+        !validate_last_desc_status(channel, cur_transfer)) {
+      *validation_success = false;
+    }
+
+    clear_dirty_descs(channel, cur_transfer);
+    trace_hailo_vdma_complete(channel, cur_transfer);
+    transfer_done(cur_transfer, transfer_done_opaque);
+    channel->state.num_proc =
+        (u16)((cur_transfer->last_desc + 1) & channel->state.desc_count_mask);
+
+    // Parts of a scatter transfer are reported once, with the last part.
+    if (!cur_transfer->is_partial) {
+      update_latency_histogram(channel, cur_transfer);
+      transfers_completed++;
+    }
+    ongoing_transfer_pop(channel, NULL);
+  }
+
+  channel->stats.transfers_completed += transfers_completed;
+  if (count_spurious_wakeup && (0 == transfers_completed)) {
+    channel->stats.spurious_wakeups++;
+  }
+
+  return transfers_completed;
+}
+
 int hailo_vdma_engine_fill_irq_data(
     struct hailo_vdma_interrupts_wait_params *irq_data,
     struct hailo_vdma_engine *engine, u32 irq_channels_bitmap,
-    transfer_done_cb_t transfer_done, void *transfer_done_opaque) {
+    transfer_done_cb_t transfer_done, void *transfer_done_opaque,
+    bool count_spurious_wakeups) {
   struct hailo_vdma_channel *channel = NULL;
   u8 channel_index = 0;
   bool validation_success = true;
 
   for_each_vdma_channel(engine, channel, channel_index) {
     u8 transfers_completed = 0;
-    u16 hw_num_proc = U16_MAX;
-
-    BUILD_BUG_ON_MSG(HAILO_VDMA_MAX_ONGOING_TRANSFERS >= U8_MAX,
-                     "HAILO_VDMA_MAX_ONGOING_TRANSFERS must be less than "
-                     "U8_MAX to use transfers_completed as u8");
 
     if (!hailo_test_bit(channel->index, &irq_channels_bitmap)) {
       continue;
@@ -765,35 +1051,9 @@ int hailo_vdma_engine_fill_irq_data(
       return -EINVAL;
     }
 
-    // Although the hw_num_processed should be a number between 0 and
-    // desc_count-1, if desc_count < 0x10000 (the maximum desc size),
-    // the actual hw_num_processed is a number between 1 and desc_count.
-    // Therefore the value can be desc_count, in this case we change it to
-    // zero.
-    hw_num_proc = hailo_vdma_get_num_proc(channel->host_regs) &
-                  channel->state.desc_count_mask;
-
-    while (ONGOING_TRANSFERS_CIRC_CNT(channel->ongoing_transfers) > 0) {
-      struct hailo_ongoing_transfer *cur_transfer =
-          &channel->ongoing_transfers
-               .transfers[channel->ongoing_transfers.tail];
-      if (!is_transfer_complete(channel, cur_transfer, hw_num_proc)) {
-        break;
-      }
-
-      if (cur_transfer->is_debug &&
-          !validate_last_desc_status(channel, cur_transfer)) {
-        validation_success = false;
-      }
-
-      clear_dirty_descs(channel, cur_transfer);
-      transfer_done(cur_transfer, transfer_done_opaque);
-      channel->state.num_proc =
-          (u16)((cur_transfer->last_desc + 1) & channel->state.desc_count_mask);
-
-      ongoing_transfer_pop(channel, NULL);
-      transfers_completed++;
-    }
+    transfers_completed = complete_channel_transfers(
+        channel, transfer_done, transfer_done_opaque, count_spurious_wakeups,
+        &validation_success);
 
     fill_channel_irq_data(&irq_data->irq_data[irq_data->channels_count], engine,
                           channel, transfers_completed, validation_success);
@@ -803,6 +1063,36 @@ int hailo_vdma_engine_fill_irq_data(
   return 0;
 }
 
+bool hailo_vdma_channel_push_completion(
+    struct hailo_vdma_completion_ring *ring, u32 *head,
+    struct hailo_vdma_engine *engine, struct hailo_vdma_channel *channel,
+    transfer_done_cb_t transfer_done, void *transfer_done_opaque) {
+  // The tail is written by user space, so it is masked before use.
+  const u32 tail =
+      READ_ONCE(ring->tail) & HAILO_VDMA_COMPLETION_RING_ENTRIES_MASK;
+  bool validation_success = true;
+  u8 transfers_completed = 0;
+
+  if (channel->last_desc_list == NULL) {
+    // Channel not active or no transfer, nothing to report.
+    return true;
+  }
+
+  if (!CIRC_SPACE(*head, tail, HAILO_VDMA_COMPLETION_RING_ENTRIES)) {
+    return false;
+  }
+
+  transfers_completed = complete_channel_transfers(
+      channel, transfer_done, transfer_done_opaque, true, &validation_success);
+  fill_channel_irq_data(&ring->entries[*head], engine, channel,
+                        transfers_completed, validation_success);
+
+  *head = (*head + 1) & HAILO_VDMA_COMPLETION_RING_ENTRIES_MASK;
+  // Publish the head only after the entry is written.
+  smp_store_release(&ring->head, *head);
+  return true;
+}
+
 // For all these functions - best way to optimize might be to not call the
 // function when need to pause and then abort, Rather read value once and maybe
 // save This function reads and writes the register - should try to make more
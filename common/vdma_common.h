@@ -84,12 +84,26 @@ struct hailo_ongoing_transfer {
 
     // If set, validate descriptors status on transfer completion.
     bool is_debug;
+
+    // Transfers with more than HAILO_MAX_BUFFERS_PER_SINGLE_TRANSFER buffers are split to several ongoing
+    // transfers. Set on all but the last one, which is the only one reported as completed.
+    bool is_partial;
+
+    // Used to measure the launch to interrupt latency.
+    u64 launch_timestamp_ns;
 };
 
+// Upper bound of the ongoing transfers list size. The list holds up to size - 1 transfers, that must fit in the u8
+// transfers_completed reported to the user.
+#define HAILO_VDMA_MAX_ONGOING_TRANSFERS_DEPTH (256)
+
 struct hailo_ongoing_transfers_list {
     unsigned long head;
     unsigned long tail;
-    struct hailo_ongoing_transfer transfers[HAILO_VDMA_MAX_ONGOING_TRANSFERS];
+    // Power of two, allocated by the os layer when the channel is enabled. NULL (with size 0) while the channel is
+    // disabled.
+    u16 size;
+    struct hailo_ongoing_transfer *transfers;
 };
 
 struct hailo_vdma_channel_state {
@@ -101,10 +115,39 @@ struct hailo_vdma_channel_state {
 
     // Mask of the num-avail/num-proc counters.
     u32 desc_count_mask;
+
+    // Shadow of the num available half-word of the channel register, i.e. the value last written to the hw. Differs
+    // from num_avail while prepared transfers wait for the doorbell.
+    u16 hw_num_avail;
+
+    // Channel register word read by the last hw state validation. Since the control byte in the same word is owned by
+    // the firmware, it is used by the doorbell only if no other transfer was prepared since (the validation is done
+    // right before the transfer is pushed), otherwise the doorbell reads the word again.
+    u32 regs_value;
+    bool regs_value_valid;
+};
+
+// Bucket i of the latency histogram counts latencies in [2^(i-1), 2^i) microseconds (bucket 0 counts latencies
+// under 1 microsecond), the last bucket counts all longer latencies.
+#define HAILO_VDMA_LATENCY_HISTOGRAM_BUCKETS (24)
+
+// Channel performance counters, updated under the channel lock (including from the interrupt handler).
+struct hailo_vdma_channel_stats {
+    u64 transfers_launched;
+    u64 bytes_launched;
+    u64 descs_programmed;
+    u64 launch_failures;
+    u64 transfers_completed;
+    u64 interrupts;
+    // Channel interrupts that didn't complete any transfer.
+    u64 spurious_wakeups;
+    // Latency from transfer launch to the interrupt before its completion.
+    u64 latency_histogram[HAILO_VDMA_LATENCY_HISTOGRAM_BUCKETS];
 };
 
 struct hailo_vdma_channel {
     u8 index;
+    u8 engine_index;
 
     u8 __iomem *host_regs;
     u8 __iomem *device_regs;
@@ -118,6 +161,10 @@ struct hailo_vdma_channel {
 
     bool timestamp_measure_enabled;
     struct hailo_channel_interrupt_timestamp_list timestamp_list;
+
+    // Time of the last interrupt of the channel.
+    u64 last_interrupt_timestamp_ns;
+    struct hailo_vdma_channel_stats stats;
 };
 
 struct hailo_vdma_engine {
@@ -191,10 +238,45 @@ int hailo_vdma_program_descriptors_in_chunk(
     u8 channel_index,
     u8 data_id);
 
+// Writes num_avail to the given channel registers with a 32-bit read-modify-write of the register word.
 void hailo_vdma_set_num_avail(u8 __iomem *regs, u16 num_avail);
 
 u16 hailo_vdma_get_num_proc(u8 __iomem *regs);
 
+/**
+ * Prepare a transfer on some vdma channel without notifying the hw. Does the
+ * same as hailo_vdma_launch_transfer, except for writing the new num available
+ * to the channel registers. Used to launch multiple transfers on the same
+ * channel with a single register write - once all transfers are prepared, the
+ * caller must call hailo_vdma_channel_ring_doorbell.
+ *
+ * @param validate_hw_state whether to compare the channel hw state to the sw
+ *                          state. Must be false for any transfer prepared after
+ *                          the first one on the channel, since the hw num
+ *                          available is not updated until the doorbell.
+ *
+ * See hailo_vdma_launch_transfer for the rest of the params.
+ *
+ * @return On success - the amount of descriptors programmed, negative value on error.
+ */
+int hailo_vdma_prepare_transfer(
+    struct hailo_vdma_hw *vdma_hw,
+    struct hailo_vdma_channel *channel,
+    struct hailo_vdma_descriptors_list *desc_list,
+    u32 starting_desc,
+    u8 buffers_count,
+    struct hailo_vdma_mapped_transfer_buffer *buffers,
+    bool should_bind,
+    enum hailo_vdma_interrupts_domain first_interrupts_domain,
+    enum hailo_vdma_interrupts_domain last_desc_interrupts,
+    bool is_debug,
+    bool validate_hw_state);
+
+// Writes the channel's sw num available to the hw, starting all prepared transfers. A single 32-bit write if the
+// register word read by the hw state validation of the last prepared transfer can be reused, a read-modify-write
+// otherwise.
+void hailo_vdma_channel_ring_doorbell(struct hailo_vdma_channel *channel);
+
 /**
  * Launch a transfer on some vdma channel. Includes:
  *      1. Binding the transfer buffers to the descriptors list.
@@ -205,7 +287,11 @@ u16 hailo_vdma_get_num_proc(u8 __iomem *regs);
  * @param channel vdma channel object.
  * @param desc_list descriptors list object to program.
  * @param starting_desc index of the first descriptor to program.
- * @param buffers_count amount of transfer mapped buffers to program.
+ * @param buffers_count amount of transfer mapped buffers to program, up to
+ *                      HAILO_VDMA_MAX_BUFFERS_PER_SCATTER_TRANSFER. Transfers
+ *                      with more than HAILO_MAX_BUFFERS_PER_SINGLE_TRANSFER
+ *                      buffers take several entries of the ongoing transfers
+ *                      list.
  * @param buffers array of buffers to program to the descriptors list.
  * @param should_bind whether to bind the buffer to the descriptors list.
  * @param first_interrupts_domain - interrupts settings on first descriptor.
@@ -233,7 +319,11 @@ void hailo_vdma_engine_init(struct hailo_vdma_engine *engine, u8 engine_index,
 void hailo_vdma_engine_enable_channels(struct hailo_vdma_engine *engine, u32 bitmap,
     bool measure_timestamp);
 
-void hailo_vdma_engine_disable_channels(struct hailo_vdma_engine *engine, u32 bitmap);
+typedef void(*transfer_done_cb_t)(struct hailo_ongoing_transfer *transfer, void *opaque);
+
+// transfer_aborted is called for each ongoing transfer of the disabled channels.
+void hailo_vdma_engine_disable_channels(struct hailo_vdma_engine *engine, u32 bitmap,
+    transfer_done_cb_t transfer_aborted, void *transfer_aborted_opaque);
 
 void hailo_vdma_engine_push_timestamps(struct hailo_vdma_engine *engine, u32 bitmap);
 int hailo_vdma_engine_read_timestamps(struct hailo_vdma_engine *engine,
@@ -264,12 +354,32 @@ static inline u32 hailo_vdma_engine_read_interrupts(struct hailo_vdma_engine *en
     return irq_channels_bitmap;
 }
 
-typedef void(*transfer_done_cb_t)(struct hailo_ongoing_transfer *transfer, void *opaque);
-
 // Assuming irq_data->channels_count contains the amount of channels already
 // written (used for multiple engines).
+// count_spurious_wakeups should be cleared if the channels interrupts were already consumed by
+// hailo_vdma_channel_push_completion.
 int hailo_vdma_engine_fill_irq_data(struct hailo_vdma_interrupts_wait_params *irq_data,
     struct hailo_vdma_engine *engine, u32 irq_channels_bitmap,
+    transfer_done_cb_t transfer_done, void *transfer_done_opaque, bool count_spurious_wakeups);
+
+/**
+ * Completes the processed transfers of the given channel, and reports them as a
+ * single entry on a completion ring shared with user space.
+ *
+ * @param ring completion ring to write to.
+ * @param head driver copy of the ring head (the ring itself is writable by user
+ *             space), advanced when an entry is written.
+ * @param engine dma engine of the channel.
+ * @param channel channel to complete the transfers on.
+ * @param transfer_done callback called for each completed transfer.
+ * @param transfer_done_opaque opaque passed to transfer_done.
+ *
+ * @return false if the ring is full - on this case the channel is left
+ *         untouched, and its transfers can be completed later by
+ *         hailo_vdma_engine_fill_irq_data.
+ */
+bool hailo_vdma_channel_push_completion(struct hailo_vdma_completion_ring *ring, u32 *head,
+    struct hailo_vdma_engine *engine, struct hailo_vdma_channel *channel,
     transfer_done_cb_t transfer_done, void *transfer_done_opaque);
 
 int hailo_vdma_start_channel(u8 __iomem *regs, uint64_t desc_dma_address, uint32_t desc_count, uint8_t data_id);
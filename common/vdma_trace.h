@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: MIT
+/**
+ * Copyright (c) 2019-2024 Hailo Technologies Ltd. All rights reserved.
+ **/
+/**
+ * Tracepoints of the vDMA data path (launch, bind, program, doorbell, interrupt and completion).
+ * Can be recorded with perf/trace-cmd (e.g. "trace-cmd record -e hailo_vdma").
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM hailo_vdma
+
+#if !defined(_HAILO_COMMON_VDMA_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _HAILO_COMMON_VDMA_TRACE_H_
+
+#include "vdma_common.h"
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(hailo_vdma_launch,
+    TP_PROTO(const struct hailo_vdma_channel *channel, const struct hailo_ongoing_transfer *transfer,
+        u32 first_desc, u32 descs_count),
+    TP_ARGS(channel, transfer, first_desc, descs_count),
+    TP_STRUCT__entry(
+        __field(u8, engine_index)
+        __field(u8, channel_index)
+        __field(u8, buffers_count)
+        __field(u32, size)
+        __field(u32, first_desc)
+        __field(u32, last_desc)
+        __field(u32, descs_count)
+        __field(u64, launch_timestamp_ns)
+    ),
+    TP_fast_assign(
+        u8 i = 0;
+        __entry->engine_index = channel->engine_index;
+        __entry->channel_index = channel->index;
+        __entry->buffers_count = transfer->buffers_count;
+        __entry->size = 0;
+        for (i = 0; i < transfer->buffers_count; i++) {
+            __entry->size += transfer->buffers[i].size;
+        }
+        __entry->first_desc = first_desc;
+        __entry->last_desc = transfer->last_desc;
+        __entry->descs_count = descs_count;
+        __entry->launch_timestamp_ns = transfer->launch_timestamp_ns;
+    ),
+    TP_printk("engine=%u channel=%u buffers=%u size=%u descs=[%u, %u] descs_count=%u launch_ns=%llu",
+        __entry->engine_index, __entry->channel_index, __entry->buffers_count, __entry->size,
+        __entry->first_desc, __entry->last_desc, __entry->descs_count, __entry->launch_timestamp_ns)
+);
+
+TRACE_EVENT(hailo_vdma_bind,
+    TP_PROTO(u8 channel_index, u32 starting_desc, const struct hailo_vdma_mapped_transfer_buffer *buffer,
+        int descs_count),
+    TP_ARGS(channel_index, starting_desc, buffer, descs_count),
+    TP_STRUCT__entry(
+        __field(u8, channel_index)
+        __field(u32, starting_desc)
+        __field(u32, offset)
+        __field(u32, size)
+        __field(int, descs_count)
+    ),
+    TP_fast_assign(
+        __entry->channel_index = channel_index;
+        __entry->starting_desc = starting_desc;
+        __entry->offset = buffer->offset;
+        __entry->size = buffer->size;
+        __entry->descs_count = descs_count;
+    ),
+    TP_printk("channel=%u starting_desc=%u offset=%u size=%u descs_count=%d",
+        __entry->channel_index, __entry->starting_desc, __entry->offset, __entry->size, __entry->descs_count)
+);
+
+TRACE_EVENT(hailo_vdma_program_chunk,
+    TP_PROTO(u8 channel_index, dma_addr_t chunk_addr, u32 chunk_size, u32 starting_desc, int descs_count),
+    TP_ARGS(channel_index, chunk_addr, chunk_size, starting_desc, descs_count),
+    TP_STRUCT__entry(
+        __field(u8, channel_index)
+        __field(u64, chunk_addr)
+        __field(u32, chunk_size)
+        __field(u32, starting_desc)
+        __field(int, descs_count)
+    ),
+    TP_fast_assign(
+        __entry->channel_index = channel_index;
+        __entry->chunk_addr = (u64)chunk_addr;
+        __entry->chunk_size = chunk_size;
+        __entry->starting_desc = starting_desc;
+        __entry->descs_count = descs_count;
+    ),
+    TP_printk("channel=%u chunk_addr=0x%llx chunk_size=%u starting_desc=%u descs_count=%d",
+        __entry->channel_index, __entry->chunk_addr, __entry->chunk_size, __entry->starting_desc,
+        __entry->descs_count)
+);
+
+TRACE_EVENT(hailo_vdma_doorbell,
+    TP_PROTO(const struct hailo_vdma_channel *channel),
+    TP_ARGS(channel),
+    TP_STRUCT__entry(
+        __field(u8, engine_index)
+        __field(u8, channel_index)
+        __field(u16, num_avail)
+    ),
+    TP_fast_assign(
+        __entry->engine_index = channel->engine_index;
+        __entry->channel_index = channel->index;
+        __entry->num_avail = channel->state.num_avail;
+    ),
+    TP_printk("engine=%u channel=%u num_avail=%u",
+        __entry->engine_index, __entry->channel_index, __entry->num_avail)
+);
+
+TRACE_EVENT(hailo_vdma_irq,
+    TP_PROTO(u8 engine_index, u32 channels_bitmap, u64 timestamp_ns),
+    TP_ARGS(engine_index, channels_bitmap, timestamp_ns),
+    TP_STRUCT__entry(
+        __field(u8, engine_index)
+        __field(u32, channels_bitmap)
+        __field(u64, timestamp_ns)
+    ),
+    TP_fast_assign(
+        __entry->engine_index = engine_index;
+        __entry->channels_bitmap = channels_bitmap;
+        __entry->timestamp_ns = timestamp_ns;
+    ),
+    TP_printk("engine=%u channels_bitmap=0x%x irq_ns=%llu",
+        __entry->engine_index, __entry->channels_bitmap, __entry->timestamp_ns)
+);
+
+TRACE_EVENT(hailo_vdma_complete,
+    TP_PROTO(const struct hailo_vdma_channel *channel, const struct hailo_ongoing_transfer *transfer),
+    TP_ARGS(channel, transfer),
+    TP_STRUCT__entry(
+        __field(u8, engine_index)
+        __field(u8, channel_index)
+        __field(u32, last_desc)
+        __field(u64, launch_timestamp_ns)
+        __field(u64, interrupt_timestamp_ns)
+    ),
+    TP_fast_assign(
+        __entry->engine_index = channel->engine_index;
+        __entry->channel_index = channel->index;
+        __entry->last_desc = transfer->last_desc;
+        __entry->launch_timestamp_ns = transfer->launch_timestamp_ns;
+        __entry->interrupt_timestamp_ns = READ_ONCE(channel->last_interrupt_timestamp_ns);
+    ),
+    TP_printk("engine=%u channel=%u last_desc=%u launch_ns=%llu irq_ns=%llu",
+        __entry->engine_index, __entry->channel_index, __entry->last_desc, __entry->launch_timestamp_ns,
+        __entry->interrupt_timestamp_ns)
+);
+
+#endif /* _HAILO_COMMON_VDMA_TRACE_H_ */
+
+// Resolved through CFLAGS_vdma_common.o, set by the Kbuild of each driver.
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE vdma_trace
+
+#include <trace/define_trace.h>
@@ -59,7 +59,7 @@ static int hailo_integrated_nnc_fops_open(struct inode *inode, struct file *filp
         return -ENOMEM;
     }
 
-    hailo_vdma_file_context_init(&context->vdma_context);
+    hailo_vdma_file_context_init(&context->vdma_context, &board->vdma);
     context->offset_in_nnc_fw_shared_memory = 0;
     filp->private_data = context;
 
@@ -224,7 +224,6 @@ static long hailo_integrated_nnc_fops_unlockedioctl(struct file* filp, unsigned
     }
 
     if (down_interruptible(&board->mutex)) return -ERESTARTSYS;
-    BUG_ON(board->mutex.count != 0);
 
     switch (_IOC_TYPE(cmd)) {
     case HAILO_GENERAL_IOCTL_MAGIC:
@@ -251,7 +250,6 @@ static long hailo_integrated_nnc_fops_unlockedioctl(struct file* filp, unsigned
 
 static int hailo_integrated_nnc_fops_mmap(struct file *filp, struct vm_area_struct *vma)
 {
-    int err = 0;
     uintptr_t vdma_handle = vma->vm_pgoff << PAGE_SHIFT;
     struct hailo_board *board = inode_to_board(filp->f_inode);
     struct hailo_file_context *context = filp->private_data;
@@ -264,13 +262,9 @@ static int hailo_integrated_nnc_fops_mmap(struct file *filp, struct vm_area_stru
 
     hailo_info(board, "%d fops_mmap\n", current->tgid);
 
-    if (down_interruptible(&board->mutex)) {
-        hailo_err(board, "hailo_integrated_nnc_fops_mmap down_interruptible fail tgid:%d\n", current->tgid);
-        return -ERESTARTSYS;
-    }
-    err = hailo_vdma_mmap(&context->vdma_context, &board->vdma, vma, vdma_handle);
-    up(&board->mutex);
-    return err;
+    // Like the vdma ioctls, the mapping itself is protected by the file context lock, so the board mutex is not taken
+    // while the pages are inserted.
+    return hailo_vdma_mmap(&context->vdma_context, &board->vdma, vma, vdma_handle);
 }
 
 static long hailo_query_device_properties(struct hailo_board *board, unsigned long arg)
@@ -300,7 +300,7 @@ static int driver_probe(struct platform_device *pdev)
     err = alloc_chrdev_region(&dev, /*baseminor: */0, /*count: */1, DRIVER_NAME);
     if(0 > err){
         hailo_err(board, "Cannot allocate major number. err: %d\n", err);
-        goto l_driver_down_notification_release;
+        goto l_vdma_controller_finalize;
     }
     board->dev = dev;
 
@@ -347,6 +347,8 @@ l_cdev:
     cdev_del(&board->cdev);
 l_chrdev_region:
     unregister_chrdev_region(dev, 1);
+l_vdma_controller_finalize:
+    hailo_vdma_controller_finalize(&board->vdma);
 l_driver_down_notification_release:
     driver_down_notification_release(board);
 l_fw_notification_release:
@@ -367,6 +369,9 @@ static void driver_remove(struct platform_device *pdev)
         return;
     }
 
+    // The vdma ioctls and mmap run without the board mutex, wait for them before releasing the board resources.
+    hailo_vdma_controller_disconnect(&board->vdma);
+
     if (NNC_FW_SHARED_MEM_TYPE_CONTINOUS_BUFFER == board->nnc_fw_shared_mem_info.type) {
         hailo_vdma_continuous_buffer_free(&pdev->dev, &board->nnc_fw_shared_memory_continuous_buffer);
     }
@@ -377,6 +382,7 @@ static void driver_remove(struct platform_device *pdev)
     driver_down_notification_release(board);
     fw_notification_release(board);
     fw_control_release(board);
+    hailo_vdma_controller_finalize(&board->vdma);
 }
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(6, 10, 0)
@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * Copyright (c) 2019-2024 Hailo Technologies Ltd. All rights reserved.
+ **/
+
+#include "debugfs.h"
+#include "utils/logs.h"
+
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+// Root directory of the driver, each board has a sub directory named after its pci location.
+static struct dentry *g_hailo_debugfs_root = NULL;
+
+static bool is_channel_used(struct hailo_vdma_channel_stats *stats)
+{
+    return (0 != stats->transfers_launched) || (0 != stats->launch_failures) || (0 != stats->interrupts);
+}
+
+static int vdma_channels_show(struct seq_file *s, void *unused)
+{
+    struct hailo_pcie_board *board = (struct hailo_pcie_board *)s->private;
+    struct hailo_vdma_channel_stats stats;
+    struct hailo_vdma_engine *engine = NULL;
+    size_t engine_index = 0;
+    u8 channel_index = 0;
+
+    seq_puts(s, "engine channel launched bytes descs launch_failures completed interrupts spurious_wakeups\n");
+    for_each_vdma_engine((&board->vdma), engine, engine_index) {
+        for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE; channel_index++) {
+            hailo_vdma_read_channel_stats(&board->vdma, engine_index, channel_index, &stats);
+            if (!is_channel_used(&stats)) {
+                continue;
+            }
+
+            seq_printf(s, "%zu %u %llu %llu %llu %llu %llu %llu %llu\n", engine_index, channel_index,
+                stats.transfers_launched, stats.bytes_launched, stats.descs_programmed, stats.launch_failures,
+                stats.transfers_completed, stats.interrupts, stats.spurious_wakeups);
+        }
+    }
+
+    return 0;
+}
+
+static int vdma_latency_histogram_show(struct seq_file *s, void *unused)
+{
+    struct hailo_pcie_board *board = (struct hailo_pcie_board *)s->private;
+    struct hailo_vdma_channel_stats stats;
+    struct hailo_vdma_engine *engine = NULL;
+    size_t engine_index = 0;
+    u8 channel_index = 0;
+    int bucket = 0;
+
+    // Bucket i counts latencies below 2^i microseconds (and above the previous bucket).
+    seq_puts(s, "engine channel");
+    for (bucket = 0; bucket < HAILO_VDMA_LATENCY_HISTOGRAM_BUCKETS - 1; bucket++) {
+        seq_printf(s, " <%lluus", 1ULL << bucket);
+    }
+    seq_puts(s, " longer\n");
+
+    for_each_vdma_engine((&board->vdma), engine, engine_index) {
+        for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE; channel_index++) {
+            hailo_vdma_read_channel_stats(&board->vdma, engine_index, channel_index, &stats);
+            if (!is_channel_used(&stats)) {
+                continue;
+            }
+
+            seq_printf(s, "%zu %u", engine_index, channel_index);
+            for (bucket = 0; bucket < HAILO_VDMA_LATENCY_HISTOGRAM_BUCKETS; bucket++) {
+                seq_printf(s, " %llu", stats.latency_histogram[bucket]);
+            }
+            seq_puts(s, "\n");
+        }
+    }
+
+    return 0;
+}
+
+static int vdma_channels_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, vdma_channels_show, inode->i_private);
+}
+
+static int vdma_latency_histogram_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, vdma_latency_histogram_show, inode->i_private);
+}
+
+static const struct file_operations vdma_channels_fops = {
+    .owner = THIS_MODULE,
+    .open = vdma_channels_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static const struct file_operations vdma_latency_histogram_fops = {
+    .owner = THIS_MODULE,
+    .open = vdma_latency_histogram_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static int atomic64_counter_get(void *data, u64 *val)
+{
+    *val = (u64)atomic64_read((atomic64_t *)data);
+    return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(atomic64_counter_fops, atomic64_counter_get, NULL, "%llu\n");
+
+static void create_atomic64_counter(const char *name, struct dentry *parent, atomic64_t *counter)
+{
+    debugfs_create_file(name, 0444, parent, counter, &atomic64_counter_fops);
+}
+
+static void create_vdma_buffer_cache_stats(struct hailo_pcie_board *board)
+{
+    struct hailo_vdma_buffer_cache_stats *stats = &board->vdma.buffer_cache_stats;
+    struct dentry *dir = debugfs_create_dir("vdma_buffer_cache", board->debugfs_dir);
+    if (IS_ERR_OR_NULL(dir)) {
+        return;
+    }
+
+    create_atomic64_counter("hits", dir, &stats->hits);
+    create_atomic64_counter("misses", dir, &stats->misses);
+    create_atomic64_counter("invalidations", dir, &stats->invalidations);
+    create_atomic64_counter("evictions", dir, &stats->evictions);
+}
+
+static void create_vdma_desc_list_pool_stats(struct hailo_pcie_board *board)
+{
+    struct hailo_desc_list_pool_stats *stats = &board->vdma.desc_list_pool.stats;
+    struct dentry *dir = debugfs_create_dir("vdma_desc_list_pool", board->debugfs_dir);
+    if (IS_ERR_OR_NULL(dir)) {
+        return;
+    }
+
+    create_atomic64_counter("hits", dir, &stats->hits);
+    create_atomic64_counter("misses", dir, &stats->misses);
+    create_atomic64_counter("recycled", dir, &stats->recycled);
+    create_atomic64_counter("freed", dir, &stats->freed);
+    create_atomic64_counter("cached_bytes", dir, &stats->cached_bytes);
+}
+
+static void create_vdma_dmabuf_cache_stats(struct hailo_pcie_board *board)
+{
+    struct hailo_dmabuf_cache_stats *stats = &board->vdma.dmabuf_cache_stats;
+    struct dentry *dir = debugfs_create_dir("vdma_dmabuf_cache", board->debugfs_dir);
+    if (IS_ERR_OR_NULL(dir)) {
+        return;
+    }
+
+    create_atomic64_counter("hits", dir, &stats->hits);
+    create_atomic64_counter("misses", dir, &stats->misses);
+    create_atomic64_counter("invalidations", dir, &stats->invalidations);
+    create_atomic64_counter("evictions", dir, &stats->evictions);
+}
+
+void hailo_pcie_debugfs_init(void)
+{
+    // debugfs is best effort, the driver works without it.
+    g_hailo_debugfs_root = debugfs_create_dir(DRIVER_NAME, NULL);
+}
+
+void hailo_pcie_debugfs_finalize(void)
+{
+    debugfs_remove_recursive(g_hailo_debugfs_root);
+    g_hailo_debugfs_root = NULL;
+}
+
+void hailo_pcie_debugfs_board_init(struct hailo_pcie_board *board)
+{
+    if (IS_ERR_OR_NULL(g_hailo_debugfs_root)) {
+        board->debugfs_dir = NULL;
+        return;
+    }
+
+    board->debugfs_dir = debugfs_create_dir(pci_name(board->pDev), g_hailo_debugfs_root);
+    if (IS_ERR_OR_NULL(board->debugfs_dir)) {
+        hailo_notice(board, "Failed creating debugfs directory\n");
+        board->debugfs_dir = NULL;
+        return;
+    }
+
+    debugfs_create_file("vdma_channels", 0444, board->debugfs_dir, board, &vdma_channels_fops);
+    debugfs_create_file("vdma_latency_histogram", 0444, board->debugfs_dir, board,
+        &vdma_latency_histogram_fops);
+    debugfs_create_bool("vdma_dma_coherent", 0444, board->debugfs_dir, &board->vdma.dma_coherent);
+    debugfs_create_bool("vdma_force_dma_sync", 0644, board->debugfs_dir, &board->vdma.force_dma_sync);
+    create_vdma_buffer_cache_stats(board);
+    create_vdma_desc_list_pool_stats(board);
+    create_vdma_dmabuf_cache_stats(board);
+}
+
+void hailo_pcie_debugfs_board_finalize(struct hailo_pcie_board *board)
+{
+    // Waits for readers of the board files, so the board can be freed afterwards.
+    debugfs_remove_recursive(board->debugfs_dir);
+    board->debugfs_dir = NULL;
+}
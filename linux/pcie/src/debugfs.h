@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * Copyright (c) 2019-2024 Hailo Technologies Ltd. All rights reserved.
+ **/
+
+#ifndef _HAILO_PCI_DEBUGFS_H_
+#define _HAILO_PCI_DEBUGFS_H_
+
+#include "pcie.h"
+
+void hailo_pcie_debugfs_init(void);
+void hailo_pcie_debugfs_finalize(void);
+
+void hailo_pcie_debugfs_board_init(struct hailo_pcie_board *board);
+void hailo_pcie_debugfs_board_finalize(struct hailo_pcie_board *board);
+
+#endif /* _HAILO_PCI_DEBUGFS_H_ */
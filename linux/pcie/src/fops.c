@@ -57,7 +57,7 @@ create_file_context(struct hailo_pcie_board *board, struct file *filp) {
   }
 
   context->filp = filp;
-  hailo_vdma_file_context_init(&context->vdma_context);
+  hailo_vdma_file_context_init(&context->vdma_context, &board->vdma);
   list_add(&context->open_files_list, &board->open_files_list);
   context->is_valid = true;
   return context;
@@ -313,11 +313,11 @@ static void boot_irq_handler(struct hailo_pcie_board *board,
     hailo_dbg(board, "boot trigger IRQ\n");
     complete_all(&board->fw_boot.fw_loaded_completion);
   } else {
-    board->fw_boot.boot_used_channel_bitmap &=
-        ~irq_source->vdma_channels_bitmap;
+    atomic_andnot(irq_source->vdma_channels_bitmap,
+                  &board->fw_boot.boot_used_channel_bitmap);
     hailo_dbg(board, "boot vDMA data IRQ - channel_bitmap = 0x%x\n",
               irq_source->vdma_channels_bitmap);
-    if (0 == board->fw_boot.boot_used_channel_bitmap) {
+    if (0 == atomic_read(&board->fw_boot.boot_used_channel_bitmap)) {
       complete_all(&board->fw_boot.vdma_boot_completion);
       hailo_dbg(board, "boot vDMA data trigger IRQ\n");
     }
@@ -493,7 +493,12 @@ long hailo_pcie_fops_unlockedioctl(struct file *filp, unsigned int cmd,
     hailo_err(board, "unlockedioctl down_interruptible failed");
     return -ERESTARTSYS;
   }
-  BUG_ON(board->mutex.count != 0);
+
+  // The board may have been removed while waiting for the mutex.
+  if (!board->pDev) {
+    up(&board->mutex);
+    return -ENODEV;
+  }
 
   context = find_file_context(board, filp);
   if (NULL == context) {
@@ -548,8 +553,6 @@ long hailo_pcie_fops_unlockedioctl(struct file *filp, unsigned int cmd,
 }
 
 int hailo_pcie_fops_mmap(struct file *filp, struct vm_area_struct *vma) {
-  int err = 0;
-
   uintptr_t vdma_handle = vma->vm_pgoff << PAGE_SHIFT;
 
   struct hailo_pcie_board *board =
@@ -576,6 +579,11 @@ int hailo_pcie_fops_mmap(struct file *filp, struct vm_area_struct *vma) {
     return -ERESTARTSYS;
   }
 
+  if (!board->pDev) {
+    up(&board->mutex);
+    return -ENODEV;
+  }
+
   context = find_file_context(board, filp);
   if (NULL == context) {
     up(&board->mutex);
@@ -589,7 +597,9 @@ int hailo_pcie_fops_mmap(struct file *filp, struct vm_area_struct *vma) {
     return -EINVAL;
   }
 
-  err = hailo_vdma_mmap(&context->vdma_context, &board->vdma, vma, vdma_handle);
+  // Like the vdma ioctls, the mapping itself is protected by the file context
+  // lock, so the board mutex is not held while the pages are inserted. Device
+  // removal is synchronized by the vdma controller in-flight lock.
   up(&board->mutex);
-  return err;
+  return hailo_vdma_mmap(&context->vdma_context, &board->vdma, vma, vdma_handle);
 }
@@ -14,6 +14,7 @@
 #include <linux/pci_regs.h>
 #include <linux/sched.h>
 #include <linux/version.h>
+#include <linux/workqueue.h>
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 16, 0)
 #include <linux/dma-direct.h>
@@ -21,6 +22,7 @@
 
 #define KERNEL_CODE 1
 
+#include "debugfs.h"
 #include "fops.h"
 #include "hailo_ioctl_common.h"
 #include "nnc.h"
@@ -51,6 +53,7 @@ static int force_allocation_from_driver = HAILO_NO_FORCE_BUFFER;
 static bool force_hailo10h_legacy_mode = false;
 static bool force_boot_linux_from_eemc = false;
 static bool support_soft_reset = true;
+static bool disable_msix = false;
 
 #define DEVICE_NODE_NAME "hailo"
 static int char_major = 0;
@@ -379,41 +382,74 @@ static int pcie_vdma_program_one_file_descriptors(
   return host_desc;
 }
 
+/**
+ * Sync a range of a boot channel buffer for the device, so each chunk can be
+ * started as soon as it is copied.
+ *
+ * @param dev - pointer to the device struct we are working on.
+ * @param sg_table - the sg table of the channel buffer.
+ * @param offset - the offset of the range in the buffer.
+ * @param size - the size of the range.
+ */
+static void pcie_vdma_sync_range_for_device(struct device *dev,
+                                            struct sg_table *sg_table,
+                                            size_t offset, size_t size) {
+  struct scatterlist *sg = NULL;
+  size_t sg_start = 0, sg_end = 0, sync_start = 0, sync_end = 0;
+  const size_t range_end = offset + size;
+  int i = 0;
+
+  for_each_sg(sg_table->sgl, sg, sg_table->nents, i) {
+    sg_end = sg_start + sg_dma_len(sg);
+    if (sg_end > offset) {
+      sync_start = max(offset, sg_start);
+      sync_end = min(range_end, sg_end);
+      dma_sync_single_range_for_device(dev, sg_dma_address(sg),
+                                       (sync_start - sg_start),
+                                       (sync_end - sync_start), DMA_TO_DEVICE);
+    }
+    if (sg_end >= range_end) {
+      break;
+    }
+    sg_start = sg_end;
+  }
+}
+
 /**
  * Program one FW file to the vDMA engine.
  *
+ * The file is programmed in chunks of HAILO_PCI_OVER_VDMA_CHUNK_SIZE, and each
+ * chunk is started right after it is programmed, so the transfer of one chunk
+ * overlaps copying the next one.
+ *
  * @param board - pointer to the board struct we are working on.
  * @param boot_dma_state - pointer to the boot dma state struct which includes
  * all of the boot resources.
  * @param file_address - the address of the file in the device memory.
+ * @param firmware - the loaded file to program.
  * @param filename - the name of the file to program.
  * @param raise_int_on_completion - true if this is the last file in the boot
  * flow, false otherwise. uses to enable an IRQ for the relevant channel when
  * the transfer is finished.
- * @return 0 on success, negative error code on failure. at the end of the
- * function the firmware is released.
+ * @return 0 on success, negative error code on failure.
  */
 static int
 pcie_vdma_program_one_file(struct hailo_pcie_board *board,
                            struct hailo_pcie_boot_dma_state *boot_dma_state,
-                           u32 file_address, const char *filename,
-                           bool raise_int_on_completion) {
-  const struct firmware *firmware = NULL;
+                           u32 file_address, const struct firmware *firmware,
+                           const char *filename, bool raise_int_on_completion) {
+  struct hailo_vdma_engine *engine =
+      &board->vdma.vdma_engines[PCI_VDMA_ENGINE_INDEX];
+  struct hailo_pcie_boot_timing *timing = &board->fw_boot.timing;
   struct hailo_vdma_mapped_transfer_buffer transfer_buffer = {0};
   int desc_programmed = 0;
-  int err = 0;
   size_t bytes_copied = 0, remaining_size = 0, data_offset = 0,
          desc_num_left = 0, current_desc_to_program = 0;
+  u8 channel_index = 0;
+  ktime_t start_time = 0;
 
   hailo_notice(board, "Programing file %s for dma transfer\n", filename);
 
-  // load firmware directly without usermode helper for the relevant file
-  err = request_firmware_direct(&firmware, filename, board->vdma.dev);
-  if (err < 0) {
-    hailo_err(board, "Failed to allocate memory for file %s\n", filename);
-    return err;
-  }
-
   // set the remaining size as the whole file size to begin with
   remaining_size = firmware->size;
 
@@ -421,6 +457,7 @@ pcie_vdma_program_one_file(struct hailo_pcie_board *board,
     struct hailo_pcie_boot_dma_channel_state *channel =
         &boot_dma_state->channels[boot_dma_state->curr_channel_index];
     bool is_last_desc_chunk_of_curr_channel = false;
+    bool is_last_chunk_of_batch = false;
     bool rais_interrupt_on_last_chunk = false;
 
     hailo_dbg(
@@ -429,13 +466,13 @@ pcie_vdma_program_one_file(struct hailo_pcie_board *board,
         channel->desc_program_num, HAILO_PCI_OVER_VDMA_PAGE_SIZE,
         boot_dma_state->curr_channel_index);
 
-    // increment the channel index if the current channel is full
+    // increment the channel index if the current channel is full. The channel
+    // was already marked as used before the previous one was started.
     if ((MAX_SG_DESCS_COUNT - 1) == channel->desc_program_num) {
       boot_dma_state->curr_channel_index++;
       channel = &boot_dma_state->channels[boot_dma_state->curr_channel_index];
-      board->fw_boot.boot_used_channel_bitmap |=
-          (1 << boot_dma_state->curr_channel_index);
     }
+    channel_index = boot_dma_state->curr_channel_index;
 
     // calculate the number of descriptors left to program and the number of
     // bytes left to program
@@ -444,67 +481,160 @@ pcie_vdma_program_one_file(struct hailo_pcie_board *board,
     // prepare the transfer buffer to make sure all the fields are initialized
     transfer_buffer.sg_table = &channel->sg_table;
     transfer_buffer.size =
-        min(remaining_size, (desc_num_left * HAILO_PCI_OVER_VDMA_PAGE_SIZE));
+        min3(remaining_size, (desc_num_left * HAILO_PCI_OVER_VDMA_PAGE_SIZE),
+             (size_t)HAILO_PCI_OVER_VDMA_CHUNK_SIZE);
     // no need to check for overflow since the variables are constant and always
     // desc_program_num <= max u16 (65536) & the buffer max size is 256 Mb << 4G
     // (max u32)
     transfer_buffer.offset =
         (channel->desc_program_num * HAILO_PCI_OVER_VDMA_PAGE_SIZE);
 
-    // check if this is the last descriptor chunk to program in the whole boot
-    // flow
+    // check if this is the last descriptor chunk of the channel or of the
+    // whole boot flow
     current_desc_to_program =
         (transfer_buffer.size / HAILO_PCI_OVER_VDMA_PAGE_SIZE);
     is_last_desc_chunk_of_curr_channel =
         ((MAX_SG_DESCS_COUNT - 1) ==
          (current_desc_to_program + channel->desc_program_num));
+    is_last_chunk_of_batch =
+        (raise_int_on_completion && (remaining_size == transfer_buffer.size));
     rais_interrupt_on_last_chunk =
-        (is_last_desc_chunk_of_curr_channel ||
-         (raise_int_on_completion && (remaining_size == transfer_buffer.size)));
+        (is_last_desc_chunk_of_curr_channel || is_last_chunk_of_batch);
 
-    // try to copy the file to the buffer, if failed, release the firmware and
-    // return
+    // try to copy the chunk to the buffer
+    start_time = ktime_get();
     bytes_copied = sg_pcopy_from_buffer(
         transfer_buffer.sg_table->sgl, transfer_buffer.sg_table->orig_nents,
         &firmware->data[data_offset], transfer_buffer.size,
         transfer_buffer.offset);
+    timing->copy = ktime_add(timing->copy, ktime_sub(ktime_get(), start_time));
     if (transfer_buffer.size != bytes_copied) {
       hailo_err(board, "There is not enough memory allocated to copy file %s\n",
                 filename);
-      release_firmware(firmware);
       return -EFBIG;
     }
 
     // program the descriptors
+    start_time = ktime_get();
     desc_programmed = pcie_vdma_program_one_file_descriptors(
         &board->pDev->dev, channel, (file_address + data_offset),
-        transfer_buffer, boot_dma_state->curr_channel_index, filename,
-        rais_interrupt_on_last_chunk);
+        transfer_buffer, channel_index, filename, rais_interrupt_on_last_chunk);
+    timing->program_descriptors = ktime_add(timing->program_descriptors,
+                                            ktime_sub(ktime_get(), start_time));
     if (desc_programmed < 0) {
       hailo_err(board,
                 "Failed to program descriptors for file %s, on cahnnel = %d\n",
-                filename, boot_dma_state->curr_channel_index);
-      release_firmware(firmware);
+                filename, channel_index);
       return desc_programmed;
     }
 
+    // The channel that will carry the rest of the data must be marked as used
+    // before this channel is started, otherwise this channel's IRQ may complete
+    // the boot transfer before the next channel was started.
+    if (is_last_desc_chunk_of_curr_channel && !is_last_chunk_of_batch) {
+      if ((channel_index + 1) >= HAILO_PCI_OVER_VDMA_NUM_CHANNELS) {
+        hailo_err(board, "Not enough boot channels to program file %s\n",
+                  filename);
+        return -EFBIG;
+      }
+      atomic_or(BIT(channel_index + 1),
+                &board->fw_boot.boot_used_channel_bitmap);
+    }
+
     // Update remaining size, data_offset and desc_program_num for the next
     // iteration
     remaining_size -= transfer_buffer.size;
     data_offset += transfer_buffer.size;
     channel->desc_program_num += desc_programmed;
+
+    // start the transfer of the chunk
+    pcie_vdma_sync_range_for_device(&board->pDev->dev, transfer_buffer.sg_table,
+                                    transfer_buffer.offset,
+                                    transfer_buffer.size);
+    hailo_vdma_set_num_avail(engine->channels[channel_index].host_regs,
+                             channel->desc_program_num);
+    hailo_vdma_set_num_avail(engine->channels[channel_index].device_regs,
+                             channel->desc_program_num);
+    hailo_dbg(board, "Set num avail to %u, on channel %u\n",
+              channel->desc_program_num, channel_index);
   }
 
   hailo_notice(board, "File %s programed successfully\n", filename);
 
-  release_firmware(firmware);
+  return 0;
+}
+
+/**
+ * Reads one FW file in the background, so reading the next file of the batch
+ * overlaps programming the current one.
+ */
+struct hailo_pcie_firmware_prefetch {
+  struct work_struct work;
+  struct device *dev;
+  const char *filename;
+  const struct firmware *firmware;
+  int err;
+  ktime_t read_time;
+};
+
+static void pcie_firmware_prefetch_work(struct work_struct *work) {
+  struct hailo_pcie_firmware_prefetch *prefetch =
+      container_of(work, struct hailo_pcie_firmware_prefetch, work);
+  ktime_t start_time = ktime_get();
+
+  // load firmware directly without usermode helper for the relevant file
+  prefetch->err = request_firmware_direct(&prefetch->firmware,
+                                          prefetch->filename, prefetch->dev);
+  prefetch->read_time = ktime_sub(ktime_get(), start_time);
+}
 
-  return desc_programmed;
+static void
+pcie_firmware_prefetch_start(struct hailo_pcie_firmware_prefetch *prefetch,
+                             struct device *dev, const char *filename) {
+  prefetch->dev = dev;
+  prefetch->filename = filename;
+  prefetch->firmware = NULL;
+  prefetch->err = 0;
+  prefetch->read_time = 0;
+  INIT_WORK_ONSTACK(&prefetch->work, pcie_firmware_prefetch_work);
+  queue_work(system_unbound_wq, &prefetch->work);
+}
+
+/**
+ * Wait for a file started by pcie_firmware_prefetch_start.
+ *
+ * @param board - pointer to the board struct we are working on.
+ * @param prefetch - the prefetch to wait for.
+ * @return the loaded file on success (should be released by the caller),
+ * ERR_PTR on failure.
+ */
+static const struct firmware *
+pcie_firmware_prefetch_wait(struct hailo_pcie_board *board,
+                            struct hailo_pcie_firmware_prefetch *prefetch) {
+  struct hailo_pcie_boot_timing *timing = &board->fw_boot.timing;
+  ktime_t start_time = ktime_get();
+
+  flush_work(&prefetch->work);
+  destroy_work_on_stack(&prefetch->work);
+
+  timing->read_wait =
+      ktime_add(timing->read_wait, ktime_sub(ktime_get(), start_time));
+  timing->read_files = ktime_add(timing->read_files, prefetch->read_time);
+
+  if (prefetch->err < 0) {
+    hailo_err(board, "Failed to allocate memory for file %s\n",
+              prefetch->filename);
+    return ERR_PTR(prefetch->err);
+  }
+
+  return prefetch->firmware;
 }
 
 /**
  * Program the entire batch of firmware files to the vDMA engine.
  *
+ * While a file is programmed, the next one is read in the background.
+ *
  * @param board - pointer to the board struct we are working on.
  * @param boot_dma_state - pointer to the boot dma state struct which includes
  * all of the boot resources.
@@ -523,26 +653,62 @@ pcie_vdma_program_entire_batch(struct hailo_pcie_board *board,
       hailo_pcie_get_loading_stage_info(resources->board_type, stage);
   const struct hailo_file_batch *files_batch = stage_info->batch;
   const u8 amount_of_files = stage_info->amount_of_files_in_stage;
-  const char *filename = NULL;
-  u32 file_address = 0;
+  struct hailo_pcie_firmware_prefetch prefetch[2];
+  struct hailo_pcie_firmware_prefetch *current_prefetch = NULL;
+  struct hailo_pcie_firmware_prefetch *next_prefetch = NULL;
+  const struct firmware *firmware = NULL;
+
+  if ((0 == amount_of_files) || (NULL == files_batch[0].filename)) {
+    hailo_err(board, "The amount of files wasn't specified for stage %d\n",
+              stage);
+    return 0;
+  }
+
+  pcie_firmware_prefetch_start(&prefetch[0], board->vdma.dev,
+                               files_batch[0].filename);
 
   for (file_index = 0; file_index < amount_of_files; file_index++) {
-    filename = files_batch[file_index].filename;
-    file_address = files_batch[file_index].address;
+    current_prefetch = &prefetch[file_index % 2];
+    next_prefetch = NULL;
+
+    // start reading the next file before programming the current one
+    if ((file_index + 1) < amount_of_files) {
+      if (NULL == files_batch[file_index + 1].filename) {
+        hailo_err(board, "The amount of files wasn't specified for stage %d\n",
+                  stage);
+      } else {
+        next_prefetch = &prefetch[(file_index + 1) % 2];
+        pcie_firmware_prefetch_start(next_prefetch, board->vdma.dev,
+                                     files_batch[file_index + 1].filename);
+      }
+    }
 
-    if (NULL == filename) {
-      hailo_err(board, "The amount of files wasn't specified for stage %d\n",
-                stage);
-      break;
+    firmware = pcie_firmware_prefetch_wait(board, current_prefetch);
+    if (IS_ERR(firmware)) {
+      err = PTR_ERR(firmware);
+    } else {
+      err = pcie_vdma_program_one_file(
+          board, boot_dma_state, files_batch[file_index].address, firmware,
+          files_batch[file_index].filename,
+          ((file_index == (amount_of_files - 1)) || (NULL == next_prefetch)));
+      release_firmware(firmware);
     }
 
-    err = pcie_vdma_program_one_file(board, boot_dma_state, file_address,
-                                     filename,
-                                     (file_index == (amount_of_files - 1)));
     if (err < 0) {
-      hailo_err(board, "Failed to program file %s\n", filename);
+      hailo_err(board, "Failed to program file %s\n",
+                files_batch[file_index].filename);
+      if (NULL != next_prefetch) {
+        firmware = pcie_firmware_prefetch_wait(board, next_prefetch);
+        if (!IS_ERR(firmware)) {
+          release_firmware(firmware);
+        }
+      }
       return err;
     }
+
+    if (NULL == next_prefetch) {
+      break;
+    }
   }
 
   return 0;
@@ -666,20 +832,22 @@ static void pcie_vdme_release_boot_resources(
        channel_index++) {
     struct hailo_pcie_boot_dma_channel_state *channel =
         &boot_dma_state->channels[channel_index];
+
+    // stops all boot vDMA channels - channels are started while the batch is
+    // programmed, so they must be stopped before their memory is released
+    hailo_vdma_stop_channel(engine->channels[channel_index].host_regs);
+    hailo_vdma_stop_channel(engine->channels[channel_index].device_regs);
+
     // release descriptor lists
     if (channel->host_descriptors_buffer.kernel_address != NULL) {
-      hailo_desc_list_release(&board->pDev->dev,
+      hailo_desc_list_release(&board->pDev->dev, NULL,
                               &channel->host_descriptors_buffer);
     }
     if (channel->device_descriptors_buffer.kernel_address != NULL) {
-      hailo_desc_list_release(&board->pDev->dev,
+      hailo_desc_list_release(&board->pDev->dev, NULL,
                               &channel->device_descriptors_buffer);
     }
 
-    // stops all boot vDMA channels
-    hailo_vdma_stop_channel(engine->channels[channel_index].host_regs);
-    hailo_vdma_stop_channel(engine->channels[channel_index].device_regs);
-
     // release noncontinuous memory (virtual continuous memory)
     if (channel->kernel_addrs != NULL) {
       pcie_vdma_release_noncontinuous_memory(
@@ -715,7 +883,7 @@ static long pcie_vdme_allocate_boot_resources(
 
     // create 2 descriptors list - 1 for the host & 1 for the device for each
     // channel
-    err = hailo_desc_list_create(&board->pDev->dev, MAX_SG_DESCS_COUNT,
+    err = hailo_desc_list_create(&board->pDev->dev, NULL, MAX_SG_DESCS_COUNT,
                                  desc_page_size, host_handle, false,
                                  &channel->host_descriptors_buffer);
     if (err < 0) {
@@ -723,7 +891,7 @@ static long pcie_vdme_allocate_boot_resources(
       goto release_all_resources;
     }
 
-    err = hailo_desc_list_create(&board->pDev->dev, MAX_SG_DESCS_COUNT,
+    err = hailo_desc_list_create(&board->pDev->dev, NULL, MAX_SG_DESCS_COUNT,
                                  desc_page_size, device_handle, false,
                                  &channel->device_descriptors_buffer);
     if (err < 0) {
@@ -778,7 +946,8 @@ release_all_resources:
  *
  * The function is divided into the following steps:
  * 1) Allocate resources for the boot process.
- * 2) Programs descriptors to point to the memory and start the vDMA.
+ * 2) Programs descriptors to point to the memory and start the vDMA, chunk by
+ * chunk, while the next file is read in the background.
  * 3) Waits until the vDMA is done and triggers the device to start the boot
  * process. 4) Releases all the resources.
  *
@@ -793,7 +962,12 @@ static long pcie_write_firmware_batch_over_dma(struct hailo_pcie_board *board,
   long err = 0;
   struct hailo_vdma_engine *engine =
       &board->vdma.vdma_engines[PCI_VDMA_ENGINE_INDEX];
-  u8 channel_index = 0;
+  ktime_t start_time = 0;
+
+  // reset the state left by a previous boot (e.g. on resume)
+  memset(&board->fw_boot.boot_dma_state, 0,
+         sizeof(board->fw_boot.boot_dma_state));
+  atomic_set(&board->fw_boot.boot_used_channel_bitmap, BIT(0));
 
   err = pcie_vdme_allocate_boot_resources(
       desc_page_size, board, &board->fw_boot.boot_dma_state, engine);
@@ -812,30 +986,7 @@ static long pcie_write_firmware_batch_over_dma(struct hailo_pcie_board *board,
     goto release_all;
   }
 
-  // sync the sg tables for the device before statirng the vDMA
-  for (channel_index = 0; channel_index < HAILO_PCI_OVER_VDMA_NUM_CHANNELS;
-       channel_index++) {
-    dma_sync_sgtable_for_device(
-        &board->pDev->dev,
-        &board->fw_boot.boot_dma_state.channels[channel_index].sg_table,
-        DMA_TO_DEVICE);
-  }
-
-  // start the vDMA transfer on all channels
-  for (channel_index = 0; channel_index < HAILO_PCI_OVER_VDMA_NUM_CHANNELS;
-       channel_index++) {
-    struct hailo_pcie_boot_dma_channel_state *channel =
-        &board->fw_boot.boot_dma_state.channels[channel_index];
-    if (channel->desc_program_num != 0) {
-      hailo_vdma_set_num_avail(engine->channels[channel_index].host_regs,
-                               channel->desc_program_num);
-      hailo_vdma_set_num_avail(engine->channels[channel_index].device_regs,
-                               channel->desc_program_num);
-      hailo_dbg(board, "Set num avail to %u, on channel %u\n",
-                channel->desc_program_num, channel_index);
-    }
-  }
-
+  start_time = ktime_get();
   if (!wait_for_firmware_completion(
           &board->fw_boot.vdma_boot_completion,
           hailo_pcie_get_loading_stage_info(board->pcie_resources.board_type,
@@ -845,6 +996,7 @@ static long pcie_write_firmware_batch_over_dma(struct hailo_pcie_board *board,
     err = -ETIMEDOUT;
     goto release_all;
   }
+  board->fw_boot.timing.vdma_wait = ktime_sub(ktime_get(), start_time);
 
   hailo_notice(board, "vDMA transfer completed, triggering boot\n");
   reinit_completion(&board->fw_boot.fw_loaded_completion);
@@ -864,6 +1016,8 @@ static int load_soc_firmware(struct hailo_pcie_board *board,
   int err = 0;
   u32 second_stage =
       force_boot_linux_from_eemc ? SECOND_STAGE_LINUX_IN_EMMC : SECOND_STAGE;
+  struct hailo_pcie_boot_timing *timing = &board->fw_boot.timing;
+  ktime_t start_time = 0;
 
   if (hailo_pcie_is_firmware_loaded(resources)) {
     hailo_dev_warn(dev, "SOC Firmware batch was already loaded\n");
@@ -876,6 +1030,9 @@ static int load_soc_firmware(struct hailo_pcie_board *board,
   init_completion(fw_load_completion);
   init_completion(&board->fw_boot.vdma_boot_completion);
 
+  memset(timing, 0, sizeof(*timing));
+  start_time = ktime_get();
+
   err = hailo_pcie_write_firmware_batch(dev, resources, FIRST_STAGE);
   if (err < 0) {
     hailo_dev_err(
@@ -896,6 +1053,8 @@ static int load_soc_firmware(struct hailo_pcie_board *board,
   }
 
   reinit_completion(fw_load_completion);
+  timing->first_stage = ktime_sub(ktime_get(), start_time);
+  start_time = ktime_get();
 
   err = (int)pcie_write_firmware_batch_over_dma(board, second_stage,
                                                 HAILO_PCI_OVER_VDMA_PAGE_SIZE);
@@ -921,8 +1080,17 @@ static int load_soc_firmware(struct hailo_pcie_board *board,
 
   reinit_completion(fw_load_completion);
   reinit_completion(&board->fw_boot.vdma_boot_completion);
+  timing->second_stage = ktime_sub(ktime_get(), start_time);
 
   hailo_dev_notice(dev, "SOC Firmware Batch loaded successfully\n");
+  hailo_dev_notice(
+      dev,
+      "Boot timing (us): first stage %lld, second stage %lld (read files %lld, "
+      "read wait %lld, copy %lld, program descriptors %lld, vDMA wait %lld)\n",
+      ktime_to_us(timing->first_stage), ktime_to_us(timing->second_stage),
+      ktime_to_us(timing->read_files), ktime_to_us(timing->read_wait),
+      ktime_to_us(timing->copy), ktime_to_us(timing->program_descriptors),
+      ktime_to_us(timing->vdma_wait));
 
   return 0;
 }
@@ -1065,6 +1233,46 @@ static int hailo_activate_board(struct hailo_pcie_board *board) {
   return 0;
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0)
+static int hailo_alloc_irq_vector(struct hailo_pcie_board *board) {
+  // All interrupt sources (boot, fw control/notifications and the vDMA
+  // channels) are reported on a single status register, so a single vector is
+  // allocated. MSI-X is preferred when exposed by the device.
+  const unsigned int irq_types =
+      disable_msix ? PCI_IRQ_MSI : (PCI_IRQ_MSIX | PCI_IRQ_MSI);
+  int err = pci_alloc_irq_vectors(board->pDev, 1, 1, irq_types);
+  if (err < 0) {
+    hailo_err(board, "Failed to allocate irq vector %d\n", err);
+    return err;
+  }
+
+  board->irq = pci_irq_vector(board->pDev, 0);
+  hailo_info(board, "Enabled %s interrupt\n",
+             board->pDev->msix_enabled ? "MSI-X" : "MSI");
+  return 0;
+}
+
+static void hailo_free_irq_vector(struct hailo_pcie_board *board) {
+  pci_free_irq_vectors(board->pDev);
+}
+#else
+static int hailo_alloc_irq_vector(struct hailo_pcie_board *board) {
+  int err = pci_enable_msi(board->pDev);
+  if (err) {
+    hailo_err(board, "Failed to enable MSI %d\n", err);
+    return err;
+  }
+
+  board->irq = board->pDev->irq;
+  hailo_info(board, "Enabled MSI interrupt\n");
+  return 0;
+}
+
+static void hailo_free_irq_vector(struct hailo_pcie_board *board) {
+  pci_disable_msi(board->pDev);
+}
+#endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(4, 8, 0) */
+
 int hailo_enable_interrupts(struct hailo_pcie_board *board) {
   int err = 0;
 
@@ -1073,21 +1281,19 @@ int hailo_enable_interrupts(struct hailo_pcie_board *board) {
     return -EINVAL;
   }
 
-  // TODO HRT-2253: use new api for enabling msi: (pci_alloc_irq_vectors)
-  if ((err = pci_enable_msi(board->pDev))) {
-    hailo_err(board, "Failed to enable MSI %d\n", err);
+  err = hailo_alloc_irq_vector(board);
+  if (err < 0) {
     return err;
   }
-  hailo_info(board, "Enabled MSI interrupt\n");
 
-  err = request_irq(board->pDev->irq, hailo_irqhandler, HAILO_IRQ_FLAGS,
-                    DRIVER_NAME, board);
+  err = request_irq(board->irq, hailo_irqhandler, HAILO_IRQ_FLAGS, DRIVER_NAME,
+                    board);
   if (err) {
     hailo_err(board, "request_irq failed %d\n", err);
-    pci_disable_msi(board->pDev);
+    hailo_free_irq_vector(board);
     return err;
   }
-  hailo_info(board, "irq enabled %u\n", board->pDev->irq);
+  hailo_info(board, "irq enabled %d\n", board->irq);
 
   hailo_pcie_enable_interrupts(&board->pcie_resources);
 
@@ -1108,8 +1314,8 @@ void hailo_disable_interrupts(struct hailo_pcie_board *board) {
 
   board->interrupts_enabled = false;
   hailo_pcie_disable_interrupts(&board->pcie_resources);
-  free_irq(board->pDev->irq, board);
-  pci_disable_msi(board->pDev);
+  free_irq(board->irq, board);
+  hailo_free_irq_vector(board);
 }
 
 static int hailo_bar_iomap(struct pci_dev *pdev, int bar,
@@ -1380,18 +1586,18 @@ static int hailo_pcie_probe(struct pci_dev *pDev,
             "Failed determining allocation of buffers from driver. error type: "
             "%d\n",
             err);
-    goto probe_release_pcie_resources;
+    goto probe_finalize_vdma_controller;
   }
 
   // Initialize the boot channel bitmap to 1 since channel 0 is always used for
   // boot (we will always use at least 1 channel which is LSB in the bitmap)
-  pBoard->fw_boot.boot_used_channel_bitmap = (1 << 0);
+  atomic_set(&pBoard->fw_boot.boot_used_channel_bitmap, BIT(0));
   memset(&pBoard->fw_boot.boot_dma_state, 0,
          sizeof(pBoard->fw_boot.boot_dma_state));
   err = hailo_activate_board(pBoard);
   if (err < 0) {
     hailo_err(pBoard, "Failed activating board %d\n", err);
-    goto probe_release_pcie_resources;
+    goto probe_finalize_vdma_controller;
   }
 
   /* Keep track on the device, in order, to be able to remove it later */
@@ -1409,6 +1615,8 @@ static int hailo_pcie_probe(struct pci_dev *pDev,
     goto probe_remove_board;
   }
 
+  hailo_pcie_debugfs_board_init(pBoard);
+
   hailo_notice(pBoard, "Probing: Added board %0x-%0x, /dev/hailo%d\n",
                pDev->vendor, pDev->device, pBoard->board_index);
 
@@ -1417,6 +1625,9 @@ static int hailo_pcie_probe(struct pci_dev *pDev,
 probe_remove_board:
   hailo_pcie_remove_board(pBoard);
 
+probe_finalize_vdma_controller:
+  hailo_vdma_controller_finalize(&pBoard->vdma);
+
 probe_release_pcie_resources:
   pcie_resources_release(pBoard->pDev, &pBoard->pcie_resources);
 
@@ -1449,12 +1660,20 @@ static void hailo_pcie_remove(struct pci_dev *pDev) {
     /* Delete the device node */
     device_destroy(chardev_class, MKDEV(char_major, pBoard->board_index));
 
+    hailo_pcie_debugfs_board_finalize(pBoard);
+
     // disable interrupts - will only disable if they have not been disabled in
     // release already
     hailo_disable_interrupts(pBoard);
 
+    // The vdma data path runs without the board mutex, wait for it before
+    // releasing the device resources.
+    hailo_vdma_controller_disconnect(&pBoard->vdma);
+
     pcie_resources_release(pBoard->pDev, &pBoard->pcie_resources);
 
+    hailo_vdma_controller_finalize(&pBoard->vdma);
+
     // deassociate device from board to be picked up by char device
     pBoard->pDev = NULL;
 
@@ -1645,8 +1864,11 @@ static int __init hailo_pcie_module_init(void) {
     return char_major;
   }
 
+  hailo_pcie_debugfs_init();
+
   if (0 != (err = pci_register_driver(&hailo_pci_driver))) {
     pr_err(DRIVER_NAME ": Init Error, failed to call pci_register_driver.\n");
+    hailo_pcie_debugfs_finalize();
     class_destroy(chardev_class);
     hailo_pcie_unregister_chrdev(char_major, DRIVER_NAME);
     return err;
@@ -1661,6 +1883,7 @@ static void __exit hailo_pcie_module_exit(void) {
 
   // Unregister the driver from pci bus
   pci_unregister_driver(&hailo_pci_driver);
+  hailo_pcie_debugfs_finalize();
   hailo_pcie_unregister_chrdev(char_major, DRIVER_NAME);
 
   pr_notice(DRIVER_NAME ": Hailo PCIe driver unloaded.\n");
@@ -1697,6 +1920,10 @@ module_param(support_soft_reset, bool, S_IRUGO);
 MODULE_PARM_DESC(support_soft_reset,
                  "enables driver reload to reload a new firmware as well");
 
+module_param(disable_msix, bool, S_IRUGO);
+MODULE_PARM_DESC(disable_msix,
+                 "Use MSI interrupt even if the device supports MSI-X");
+
 MODULE_AUTHOR("Hailo Technologies Ltd.");
 MODULE_DESCRIPTION("Hailo PCIe driver");
 MODULE_LICENSE("GPL v2");
@@ -21,6 +21,8 @@
 
 #define HAILO_PCI_OVER_VDMA_NUM_CHANNELS                (8)
 #define HAILO_PCI_OVER_VDMA_PAGE_SIZE                   (512)
+// Files are copied and transferred in chunks of this size, so transferring a chunk overlaps copying the next one.
+#define HAILO_PCI_OVER_VDMA_CHUNK_SIZE                  (1024 * 1024)
 
 struct hailo_fw_control_info {
     // protects that only one fw control will be send at a time
@@ -86,12 +88,27 @@ struct hailo_pcie_boot_dma_state {
     u8 curr_channel_index;
 };
 
+// Time spent on each phase of the last boot
+struct hailo_pcie_boot_timing {
+    ktime_t first_stage;
+    // Reading the files is done in the background, read_wait is the time the boot waited for it.
+    ktime_t read_files;
+    ktime_t read_wait;
+    ktime_t copy;
+    ktime_t program_descriptors;
+    // Time waiting for the vDMA transfers to finish, after all of them were started.
+    ktime_t vdma_wait;
+    ktime_t second_stage;
+};
+
 struct hailo_pcie_fw_boot {
     struct hailo_pcie_boot_dma_state boot_dma_state;
     // is_in_boot is set to true when the board is in boot mode
     bool is_in_boot;
-    // boot_used_channel_bitmap is a bitmap of the channels that are used for boot
-    u16 boot_used_channel_bitmap;
+    // boot_used_channel_bitmap is a bitmap of the channels that are used for boot. Channels are started while the
+    // next ones are programmed, so it is updated atomically.
+    atomic_t boot_used_channel_bitmap;
+    struct hailo_pcie_boot_timing timing;
     // fw_loaded_completion is used to notify that the FW was loaded - SOC & NNC
     struct completion fw_loaded_completion;
     // vdma_boot_completion is used to notify that the vDMA boot data was transferred completely on all used channels for boot
@@ -118,6 +135,10 @@ struct hailo_pcie_board {
     u32 desc_max_page_size;
     enum hailo_allocation_mode allocation_mode;
     bool interrupts_enabled;
+    // Linux irq number of the vector allocated for the device (valid while interrupts are enabled).
+    int irq;
+    // debugfs directory of the board, NULL if debugfs is not available.
+    struct dentry *debugfs_dir;
 };
 
 bool power_mode_enabled(void);
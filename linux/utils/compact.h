@@ -9,6 +9,7 @@
 #include <linux/version.h>
 #include <linux/scatterlist.h>
 #include <linux/vmalloc.h>
+#include <linux/mm.h>
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
 #define class_create_compat class_create
@@ -48,6 +49,82 @@ static inline long get_user_pages_compact(unsigned long start, unsigned long nr_
 }
 #endif
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+#define vm_flags_set_compat vm_flags_set
+#else
+static inline void vm_flags_set_compat(struct vm_area_struct *vma, unsigned long flags)
+{
+    vma->vm_flags |= flags;
+}
+#endif
+
+// Inserts all the given pages to the vma (at addr), returns 0 only if all of them were inserted.
+static inline int vm_insert_pages_compat(struct vm_area_struct *vma, unsigned long addr, struct page **pages,
+    unsigned long num)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+    unsigned long not_inserted = num;
+    int err = vm_insert_pages(vma, addr, pages, &not_inserted);
+    if ((0 == err) && (0 != not_inserted)) {
+        err = -EFAULT;
+    }
+    return err;
+#else
+    unsigned long i = 0;
+    int err = 0;
+    for (i = 0; i < num; i++) {
+        err = vm_insert_page(vma, addr + (i * PAGE_SIZE), pages[i]);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return 0;
+#endif
+}
+
+// FOLL_ flags are enum values on newer kernels, so their existence is checked by version.
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 2, 0)
+#define FOLL_LONGTERM (0)
+#endif
+
+// Pinning user mapped p2pdma pages (memory of other PCIe devices) is supported from 6.2, where dma_map_sg also maps
+// them for peer to peer DMA.
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 2, 0)
+#define FOLL_PCI_P2PDMA (0)
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 20, 0)
+static inline bool is_pci_p2pdma_page(const struct page *page)
+{
+    (void)page;
+    return false;
+}
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+#define pin_user_pages_compact pin_user_pages
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+#define pin_user_pages_compact(start, nr_pages, gup_flags, pages) \
+    pin_user_pages(start, nr_pages, gup_flags, pages, NULL)
+#else
+// On kernels < 5.6, pinned pages are not distinguished from other page references, so fall back to
+// get_user_pages/put_page.
+#define pin_user_pages_compact get_user_pages_compact
+
+static inline void unpin_user_page(struct page *page)
+{
+    put_page(page);
+}
+
+static inline void unpin_user_pages(struct page **pages, unsigned long npages)
+{
+    unsigned long i = 0;
+    for (i = 0; i < npages; i++) {
+        put_page(pages[i]);
+    }
+}
+#endif
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 8, 0)
 static inline void dma_sync_sgtable_for_device(struct device *dev,
     struct sg_table *sgt, enum dma_data_direction dir)
@@ -158,4 +235,54 @@ static inline bool is_dma_capable(struct device *dev, dma_addr_t dma_addr, size_
 }
 #endif // LINUX_VERSION_CODE >= KERNEL_VERSION(4, 19, 0)
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+#include <linux/xarray.h>
+
+static inline void *xa_first_entry_compat(struct xarray *xa)
+{
+    unsigned long index = 0;
+    return xa_find(xa, &index, ULONG_MAX, XA_PRESENT);
+}
+#else
+#include <linux/radix-tree.h>
+
+// On kernels < 4.20, xarray is not implemented. Implementing the small subset used by the driver over the radix
+// tree. Unlike xarray, the accesses are not locked internally, so the caller must serialize them.
+struct xarray {
+    struct radix_tree_root root;
+};
+
+static inline void xa_init(struct xarray *xa)
+{
+    INIT_RADIX_TREE(&xa->root, GFP_KERNEL);
+}
+
+static inline void *xa_load(struct xarray *xa, unsigned long index)
+{
+    return radix_tree_lookup(&xa->root, index);
+}
+
+static inline int xa_insert(struct xarray *xa, unsigned long index, void *entry, gfp_t gfp)
+{
+    (void)gfp; // Taken from the root
+    return radix_tree_insert(&xa->root, index, entry);
+}
+
+static inline void *xa_erase(struct xarray *xa, unsigned long index)
+{
+    return radix_tree_delete(&xa->root, index);
+}
+
+static inline void xa_destroy(struct xarray *xa)
+{
+    (void)xa; // Nothing to free once all entries are erased
+}
+
+static inline void *xa_first_entry_compat(struct xarray *xa)
+{
+    void *entry = NULL;
+    return (1 == radix_tree_gang_lookup(&xa->root, &entry, 0, 1)) ? entry : NULL;
+}
+#endif // LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+
 #endif /* _HAILO_PCI_COMPACT_H_ */
\ No newline at end of file
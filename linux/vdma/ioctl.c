@@ -10,6 +10,7 @@
 
 #include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 
 long hailo_vdma_enable_channels_ioctl(struct hailo_vdma_controller *controller,
                                       unsigned long arg,
@@ -17,7 +18,9 @@ long hailo_vdma_enable_channels_ioctl(struct hailo_vdma_controller *controller,
   struct hailo_vdma_enable_channels_params input;
   struct hailo_vdma_engine *engine = NULL;
   u8 engine_index = 0;
+  u8 allocated_engine_index = 0;
   u32 channels_bitmap = 0;
+  int err = 0;
 
   if (copy_from_user(&input, (void *)arg, sizeof(input))) {
     hailo_dev_err(controller->dev, "copy_from_user fail\n");
@@ -34,6 +37,22 @@ long hailo_vdma_enable_channels_ioctl(struct hailo_vdma_controller *controller,
     }
   }
 
+  // Allocate the ongoing transfers lists of all channels before enabling any.
+  for_each_vdma_engine(controller, engine, engine_index) {
+    channels_bitmap = input.channels_bitmap_per_engine[engine_index];
+    err = hailo_vdma_alloc_engine_ongoing_transfers(controller, engine_index,
+                                                    channels_bitmap);
+    if (err < 0) {
+      for (allocated_engine_index = 0; allocated_engine_index < engine_index;
+           allocated_engine_index++) {
+        hailo_vdma_free_engine_ongoing_transfers(
+            controller, allocated_engine_index,
+            input.channels_bitmap_per_engine[allocated_engine_index]);
+      }
+      return err;
+    }
+  }
+
   for_each_vdma_engine(controller, engine, engine_index) {
     channels_bitmap = input.channels_bitmap_per_engine[engine_index];
     hailo_vdma_engine_enable_channels(engine, channels_bitmap,
@@ -75,7 +94,8 @@ long hailo_vdma_disable_channels_ioctl(
 
   for_each_vdma_engine(controller, engine, engine_index) {
     channels_bitmap = input.channels_bitmap_per_engine[engine_index];
-    hailo_vdma_engine_disable_channels(engine, channels_bitmap);
+    hailo_vdma_disable_engine_channels(controller, engine_index,
+                                       channels_bitmap);
     hailo_vdma_update_interrupts_mask(controller, engine_index);
 
     spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
@@ -88,10 +108,10 @@ long hailo_vdma_disable_channels_ioctl(
 
     // Update the context with the disabled channels bitmap
     context->enabled_channels_bitmap[engine_index] &= ~channels_bitmap;
-  }
 
-  // Wake up threads waiting
-  wake_up_interruptible_all(&controller->interrupts_wq);
+    // Wake up threads waiting on the disabled channels
+    hailo_vdma_wakeup_waiters(controller, engine_index, channels_bitmap);
+  }
 
   return 0;
 }
@@ -100,6 +120,10 @@ static bool got_interrupt(struct hailo_vdma_controller *controller,
                           u32 channels_bitmap_per_engine[MAX_VDMA_ENGINES]) {
   struct hailo_vdma_engine *engine = NULL;
   u8 engine_index = 0;
+  // Waiters are woken up on device removal, and must not go back to sleep.
+  if (READ_ONCE(controller->is_removed)) {
+    return true;
+  }
   for_each_vdma_engine(controller, engine, engine_index) {
     if (hailo_vdma_engine_got_interrupt(
             engine, channels_bitmap_per_engine[engine_index])) {
@@ -109,30 +133,20 @@ static bool got_interrupt(struct hailo_vdma_controller *controller,
   return false;
 }
 
-static void transfer_done(struct hailo_ongoing_transfer *transfer,
-                          void *opaque) {
-  u8 i = 0;
-  struct hailo_vdma_controller *controller =
-      (struct hailo_vdma_controller *)opaque;
-  for (i = 0; i < transfer->buffers_count; i++) {
-    struct hailo_vdma_buffer *mapped_buffer =
-        (struct hailo_vdma_buffer *)transfer->buffers[i].opaque;
-    hailo_vdma_buffer_sync_cyclic(controller, mapped_buffer, HAILO_SYNC_FOR_CPU,
-                                  transfer->buffers[i].offset,
-                                  transfer->buffers[i].size);
-  }
-}
-
 long hailo_vdma_interrupts_wait_ioctl(struct hailo_vdma_controller *controller,
-                                      unsigned long arg,
-                                      struct semaphore *mutex,
-                                      bool *should_up_board_mutex) {
+                                      unsigned long arg) {
   long err = 0;
   struct hailo_vdma_interrupts_wait_params params = {0};
+  struct hailo_vdma_interrupts_waiter waiter;
   struct hailo_vdma_engine *engine = NULL;
+  spinlock_t *channel_lock = NULL;
   bool bitmap_not_empty = false;
   u8 engine_index = 0;
+  u8 channel_index = 0;
   u32 irq_bitmap = 0;
+  // Channels with a completion ring, their interrupts are consumed by the
+  // irq handler.
+  u32 ring_channels_bitmap = 0;
   unsigned long irq_saved_flags = 0;
 
   if (copy_from_user(&params, (void *)arg, sizeof(params))) {
@@ -156,40 +170,61 @@ long hailo_vdma_interrupts_wait_ioctl(struct hailo_vdma_controller *controller,
     return -EINVAL;
   }
 
-  up(mutex);
+  // Registered before checking the condition, so an interrupt can't be missed.
+  hailo_vdma_add_interrupts_waiter(controller, &waiter,
+                                   params.channels_bitmap_per_engine);
   err = wait_event_interruptible(
-      controller->interrupts_wq,
-      got_interrupt(controller, params.channels_bitmap_per_engine));
+      waiter.wq, got_interrupt(controller, params.channels_bitmap_per_engine));
+  hailo_vdma_remove_interrupts_waiter(controller, &waiter);
   if (err < 0) {
     hailo_dev_info(controller->dev,
                    "wait channel interrupts failed with err=%ld (process was "
                    "interrupted or killed)\n",
                    err);
-    *should_up_board_mutex = false;
     return err;
   }
 
-  if (down_interruptible(mutex)) {
-    hailo_dev_info(
-        controller->dev,
-        "down_interruptible error (process was interrupted or killed)\n");
-    *should_up_board_mutex = false;
-    return -ERESTARTSYS;
+  if (READ_ONCE(controller->is_removed)) {
+    return -ENODEV;
   }
 
   params.channels_count = 0;
   for_each_vdma_engine(controller, engine, engine_index) {
-
     spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
     irq_bitmap = hailo_vdma_engine_read_interrupts(
         engine, params.channels_bitmap_per_engine[engine->index]);
+    ring_channels_bitmap = 0;
+    for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE;
+         channel_index++) {
+      if (NULL != controller->completion_rings[engine_index][channel_index]) {
+        hailo_set_bit(channel_index, &ring_channels_bitmap);
+      }
+    }
     spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
 
-    err = hailo_vdma_engine_fill_irq_data(&params, engine, irq_bitmap,
-                                          transfer_done, controller);
-    if (err < 0) {
-      hailo_dev_err(controller->dev, "Failed fill irq data %ld", err);
-      return err;
+    // Transfers may be launched (or completed from the irq handler)
+    // concurrently, so each channel is completed under its lock.
+    for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE;
+         channel_index++) {
+      if (!hailo_test_bit(channel_index, &irq_bitmap)) {
+        continue;
+      }
+
+      channel_lock =
+          hailo_vdma_channel_lock(controller, engine_index, channel_index);
+      spin_lock_irqsave(channel_lock, irq_saved_flags);
+      err = hailo_vdma_engine_fill_irq_data(&params, engine,
+                                            BIT(channel_index),
+                                            hailo_vdma_transfer_done,
+                                            controller,
+                                            !hailo_test_bit(
+                                                channel_index,
+                                                &ring_channels_bitmap));
+      spin_unlock_irqrestore(channel_lock, irq_saved_flags);
+      if (err < 0) {
+        hailo_dev_err(controller->dev, "Failed fill irq data %ld", err);
+        return err;
+      }
     }
   }
 
@@ -220,6 +255,7 @@ long hailo_vdma_buffer_map_ioctl(struct hailo_vdma_file_context *context,
   struct hailo_vdma_buffer *mapped_buffer = NULL;
   enum dma_data_direction direction = DMA_NONE;
   struct hailo_vdma_low_memory_buffer *low_memory_buffer = NULL;
+  int err = -EINVAL;
 
   if (copy_from_user(&buf_info, (void __user *)arg, sizeof(buf_info))) {
     hailo_dev_err(controller->dev, "copy from user fail\n");
@@ -236,12 +272,22 @@ long hailo_vdma_buffer_map_ioctl(struct hailo_vdma_file_context *context,
     return -EINVAL;
   }
 
+  mutex_lock(&context->lock);
   low_memory_buffer = hailo_vdma_find_low_memory_buffer(
       context, buf_info.allocated_buffer_handle);
-
-  mapped_buffer = hailo_vdma_buffer_map(
-      controller->dev, buf_info.user_address, buf_info.size, direction,
-      buf_info.buffer_type, low_memory_buffer);
+  if (NULL != low_memory_buffer) {
+    // The low memory buffer may be freed once the lock is released.
+    mapped_buffer = hailo_vdma_buffer_map(
+        controller->dev, &context->dmabuf_cache, buf_info.user_address,
+        buf_info.size, direction, buf_info.buffer_type, low_memory_buffer);
+    mutex_unlock(&context->lock);
+  } else {
+    // Pinning user pages may take a while, so it is done without the lock.
+    mutex_unlock(&context->lock);
+    mapped_buffer = hailo_vdma_buffer_cache_map(
+        &context->buffer_cache, controller->dev, buf_info.user_address,
+        buf_info.size, direction, buf_info.buffer_type, NULL);
+  }
   if (IS_ERR(mapped_buffer)) {
     hailo_dev_err(controller->dev, "failed map buffer %lx\n",
                   buf_info.user_address);
@@ -253,12 +299,20 @@ long hailo_vdma_buffer_map_ioctl(struct hailo_vdma_file_context *context,
   buf_info.mapped_handle = mapped_buffer->handle;
   if (copy_to_user((void __user *)arg, &buf_info, sizeof(buf_info))) {
     hailo_dev_err(controller->dev, "copy_to_user fail\n");
-    hailo_vdma_buffer_put(mapped_buffer);
+    hailo_vdma_buffer_cache_release(mapped_buffer);
     return -EFAULT;
   }
 
-  list_add(&mapped_buffer->mapped_user_buffer_list,
-           &context->mapped_user_buffer_list);
+  mutex_lock(&context->lock);
+  err = hailo_vdma_add_mapped_user_buffer(context, mapped_buffer);
+  mutex_unlock(&context->lock);
+  if (err < 0) {
+    hailo_dev_err(controller->dev, "Failed adding buffer handle %zu, err %d\n",
+                  mapped_buffer->handle, err);
+    hailo_vdma_buffer_cache_release(mapped_buffer);
+    return err;
+  }
+
   hailo_dev_dbg(controller->dev, "buffer %lx (handle %zu) is mapped\n",
                 buf_info.user_address, buf_info.mapped_handle);
   return 0;
@@ -279,16 +333,20 @@ long hailo_vdma_buffer_unmap_ioctl(struct hailo_vdma_file_context *context,
   hailo_dev_dbg(controller->dev, "unmap user buffer handle %zu\n",
                 buffer_unmap_params.mapped_handle);
 
+  mutex_lock(&context->lock);
   mapped_buffer = hailo_vdma_find_mapped_user_buffer(
       context, buffer_unmap_params.mapped_handle);
   if (mapped_buffer == NULL) {
+    mutex_unlock(&context->lock);
     hailo_dev_warn(controller->dev, "buffer handle %zu not found\n",
                    buffer_unmap_params.mapped_handle);
     return -EINVAL;
   }
 
-  list_del(&mapped_buffer->mapped_user_buffer_list);
-  hailo_vdma_buffer_put(mapped_buffer);
+  hailo_vdma_remove_mapped_user_buffer(context, mapped_buffer);
+  mutex_unlock(&context->lock);
+
+  hailo_vdma_buffer_cache_unmap(&context->buffer_cache, mapped_buffer);
   return 0;
 }
 
@@ -303,13 +361,6 @@ long hailo_vdma_buffer_sync_ioctl(struct hailo_vdma_file_context *context,
     return -EFAULT;
   }
 
-  if (!(mapped_buffer =
-            hailo_vdma_find_mapped_user_buffer(context, sync_info.handle))) {
-    hailo_dev_err(controller->dev, "buffer handle %zu doesn't exist\n",
-                  sync_info.handle);
-    return -EINVAL;
-  }
-
   if ((sync_info.sync_type != HAILO_SYNC_FOR_CPU) &&
       (sync_info.sync_type != HAILO_SYNC_FOR_DEVICE)) {
     hailo_dev_err(controller->dev,
@@ -317,16 +368,33 @@ long hailo_vdma_buffer_sync_ioctl(struct hailo_vdma_file_context *context,
     return -EINVAL;
   }
 
+  // Holding a reference instead of the lock, since syncing big buffers may
+  // take a while.
+  mutex_lock(&context->lock);
+  mapped_buffer = hailo_vdma_find_mapped_user_buffer(context, sync_info.handle);
+  if (NULL != mapped_buffer) {
+    hailo_vdma_buffer_get(mapped_buffer);
+  }
+  mutex_unlock(&context->lock);
+
+  if (NULL == mapped_buffer) {
+    hailo_dev_err(controller->dev, "buffer handle %zu doesn't exist\n",
+                  sync_info.handle);
+    return -EINVAL;
+  }
+
   if (sync_info.offset + sync_info.count > mapped_buffer->size) {
     hailo_dev_err(controller->dev,
                   "Invalid offset/count given for vdma buffer sync. offset %zu "
                   "count %zu buffer size %u\n",
                   sync_info.offset, sync_info.count, mapped_buffer->size);
+    hailo_vdma_buffer_put(mapped_buffer);
     return -EINVAL;
   }
 
   hailo_vdma_buffer_sync(controller, mapped_buffer, sync_info.sync_type,
                          sync_info.offset, sync_info.count);
+  hailo_vdma_buffer_put(mapped_buffer);
   return 0;
 }
 
@@ -370,18 +438,16 @@ long hailo_desc_list_create_ioctl(struct hailo_vdma_file_context *context,
 
   next_handle = hailo_get_next_vdma_handle(context);
 
-  err = hailo_desc_list_create(controller->dev, params.desc_count,
-                               params.desc_page_size, next_handle,
-                               params.is_circular, descriptors_buffer);
+  err = hailo_desc_list_create(
+      controller->dev, &controller->desc_list_pool, params.desc_count,
+      params.desc_page_size, next_handle, params.is_circular,
+      descriptors_buffer);
   if (err < 0) {
     hailo_dev_err(controller->dev, "failed to allocate descriptors buffer\n");
     kfree(descriptors_buffer);
     return err;
   }
 
-  list_add(&descriptors_buffer->descriptors_buffer_list,
-           &context->descriptors_buffer_list);
-
   // Note: The physical address is required for CONTEXT_SWITCH firmware controls
   BUILD_BUG_ON(sizeof(params.dma_address) <
                sizeof(descriptors_buffer->dma_address));
@@ -390,12 +456,24 @@ long hailo_desc_list_create_ioctl(struct hailo_vdma_file_context *context,
 
   if (copy_to_user((void __user *)arg, &params, sizeof(params))) {
     hailo_dev_err(controller->dev, "copy_to_user fail\n");
-    list_del(&descriptors_buffer->descriptors_buffer_list);
-    hailo_desc_list_release(controller->dev, descriptors_buffer);
+    hailo_desc_list_release(controller->dev, &controller->desc_list_pool,
+                            descriptors_buffer);
     kfree(descriptors_buffer);
     return -EFAULT;
   }
 
+  mutex_lock(&context->lock);
+  err = hailo_vdma_add_descriptors_buffer(context, descriptors_buffer);
+  mutex_unlock(&context->lock);
+  if (err < 0) {
+    hailo_dev_err(controller->dev, "Failed adding desc handle %zu, err %ld\n",
+                  (size_t)descriptors_buffer->handle, err);
+    hailo_desc_list_release(controller->dev, &controller->desc_list_pool,
+                            descriptors_buffer);
+    kfree(descriptors_buffer);
+    return err;
+  }
+
   hailo_dev_info(controller->dev, "Created desc list, handle 0x%llu\n",
                  (u64)params.desc_handle);
   return 0;
@@ -412,17 +490,21 @@ long hailo_desc_list_release_ioctl(struct hailo_vdma_file_context *context,
     return -EFAULT;
   }
 
+  mutex_lock(&context->lock);
   descriptors_buffer =
       hailo_vdma_find_descriptors_buffer(context, params.desc_handle);
   if (descriptors_buffer == NULL) {
+    mutex_unlock(&context->lock);
     hailo_dev_warn(controller->dev, "not found desc handle %llu\n",
                    (unsigned long long)params.desc_handle);
     return -EINVAL;
   }
 
-  list_del(&descriptors_buffer->descriptors_buffer_list);
-  hailo_desc_list_release(controller->dev, descriptors_buffer);
-  kfree(descriptors_buffer);
+  hailo_vdma_remove_descriptors_buffer(context, descriptors_buffer);
+  mutex_unlock(&context->lock);
+
+  // Released once launches in progress on the list are done.
+  hailo_vdma_descriptors_buffer_put(descriptors_buffer);
   return 0;
 }
 
@@ -433,6 +515,7 @@ long hailo_desc_list_program_ioctl(struct hailo_vdma_file_context *context,
   struct hailo_vdma_buffer *mapped_buffer = NULL;
   struct hailo_descriptors_list_buffer *descriptors_buffer = NULL;
   struct hailo_vdma_mapped_transfer_buffer transfer_buffer = {0};
+  long err = -EFAULT;
 
   if (copy_from_user(&configure_info, (void __user *)arg,
                      sizeof(configure_info))) {
@@ -444,6 +527,7 @@ long hailo_desc_list_program_ioctl(struct hailo_vdma_file_context *context,
                  configure_info.buffer_handle, (u64)configure_info.desc_handle,
                  configure_info.starting_desc);
 
+  mutex_lock(&context->lock);
   mapped_buffer =
       hailo_vdma_find_mapped_user_buffer(context, configure_info.buffer_handle);
   descriptors_buffer =
@@ -451,23 +535,29 @@ long hailo_desc_list_program_ioctl(struct hailo_vdma_file_context *context,
 
   if (mapped_buffer == NULL || descriptors_buffer == NULL) {
     hailo_dev_err(controller->dev, "invalid user/descriptors buffer\n");
-    return -EFAULT;
+    err = -EFAULT;
+    goto unlock;
   }
 
   if (configure_info.buffer_size > mapped_buffer->size) {
     hailo_dev_err(controller->dev, "invalid buffer size. \n");
-    return -EFAULT;
+    err = -EFAULT;
+    goto unlock;
   }
 
   transfer_buffer.sg_table = &mapped_buffer->sg_table;
   transfer_buffer.size = configure_info.buffer_size;
   transfer_buffer.offset = configure_info.buffer_offset;
 
-  return hailo_vdma_program_descriptors_list(
+  err = hailo_vdma_program_descriptors_list(
       controller->hw, &descriptors_buffer->desc_list,
       configure_info.starting_desc, &transfer_buffer,
       configure_info.should_bind, configure_info.channel_index,
       configure_info.last_interrupts_domain, configure_info.is_debug);
+
+unlock:
+  mutex_unlock(&context->lock);
+  return err;
 }
 
 long hailo_vdma_low_memory_buffer_alloc_ioctl(
@@ -499,18 +589,23 @@ long hailo_vdma_low_memory_buffer_alloc_ioctl(
   // Get handle for allocated buffer
   low_memory_buffer->handle = hailo_get_next_vdma_handle(context);
 
-  list_add(&low_memory_buffer->vdma_low_memory_buffer_list,
-           &context->vdma_low_memory_buffer_list);
-
   buf_info.buffer_handle = low_memory_buffer->handle;
   if (copy_to_user((void __user *)arg, &buf_info, sizeof(buf_info))) {
     hailo_dev_err(controller->dev, "copy_to_user fail\n");
-    list_del(&low_memory_buffer->vdma_low_memory_buffer_list);
-    hailo_vdma_low_memory_buffer_free(low_memory_buffer);
-    kfree(low_memory_buffer);
+    hailo_vdma_low_memory_buffer_put(low_memory_buffer);
     return -EFAULT;
   }
 
+  mutex_lock(&context->lock);
+  err = hailo_vdma_add_low_memory_buffer(context, low_memory_buffer);
+  mutex_unlock(&context->lock);
+  if (err < 0) {
+    hailo_dev_err(controller->dev, "Failed adding buffer handle %zu, err %ld\n",
+                  (size_t)low_memory_buffer->handle, err);
+    hailo_vdma_low_memory_buffer_put(low_memory_buffer);
+    return err;
+  }
+
   return 0;
 }
 
@@ -525,17 +620,21 @@ long hailo_vdma_low_memory_buffer_free_ioctl(
     return -EFAULT;
   }
 
+  mutex_lock(&context->lock);
   low_memory_buffer =
       hailo_vdma_find_low_memory_buffer(context, params.buffer_handle);
   if (NULL == low_memory_buffer) {
+    mutex_unlock(&context->lock);
     hailo_dev_warn(controller->dev, "vdma buffer handle %lx not found\n",
                    params.buffer_handle);
     return -EINVAL;
   }
 
-  list_del(&low_memory_buffer->vdma_low_memory_buffer_list);
-  hailo_vdma_low_memory_buffer_free(low_memory_buffer);
-  kfree(low_memory_buffer);
+  hailo_vdma_remove_low_memory_buffer(context, low_memory_buffer);
+  mutex_unlock(&context->lock);
+
+  // The buffer is freed once it is no longer exported.
+  hailo_vdma_low_memory_buffer_put(low_memory_buffer);
   return 0;
 }
 
@@ -590,19 +689,25 @@ long hailo_vdma_continuous_buffer_alloc_ioctl(
   }
 
   continuous_buffer->handle = hailo_get_next_vdma_handle(context);
-  list_add(&continuous_buffer->continuous_buffer_list,
-           &context->continuous_buffer_list);
 
   buf_info.buffer_handle = continuous_buffer->handle;
   buf_info.dma_address = continuous_buffer->dma_address;
   if (copy_to_user((void __user *)arg, &buf_info, sizeof(buf_info))) {
     hailo_dev_err(controller->dev, "copy_to_user fail\n");
-    list_del(&continuous_buffer->continuous_buffer_list);
-    hailo_vdma_continuous_buffer_free(controller->dev, continuous_buffer);
-    kfree(continuous_buffer);
+    hailo_vdma_continuous_buffer_put(continuous_buffer);
     return -EFAULT;
   }
 
+  mutex_lock(&context->lock);
+  err = hailo_vdma_add_continuous_buffer(context, continuous_buffer);
+  mutex_unlock(&context->lock);
+  if (err < 0) {
+    hailo_dev_err(controller->dev, "Failed adding buffer handle %zu, err %ld\n",
+                  (size_t)continuous_buffer->handle, err);
+    hailo_vdma_continuous_buffer_put(continuous_buffer);
+    return err;
+  }
+
   return 0;
 }
 
@@ -617,17 +722,69 @@ long hailo_vdma_continuous_buffer_free_ioctl(
     return -EFAULT;
   }
 
+  mutex_lock(&context->lock);
   continuous_buffer =
       hailo_vdma_find_continuous_buffer(context, params.buffer_handle);
   if (NULL == continuous_buffer) {
+    mutex_unlock(&context->lock);
+    hailo_dev_warn(controller->dev, "vdma buffer handle %lx not found\n",
+                   params.buffer_handle);
+    return -EINVAL;
+  }
+
+  hailo_vdma_remove_continuous_buffer(context, continuous_buffer);
+  mutex_unlock(&context->lock);
+
+  // The buffer is freed once it is no longer exported.
+  hailo_vdma_continuous_buffer_put(continuous_buffer);
+  return 0;
+}
+
+long hailo_vdma_buffer_export_dmabuf_ioctl(
+    struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller, unsigned long arg) {
+  struct hailo_vdma_buffer_export_dmabuf_params params = {0};
+  struct hailo_vdma_low_memory_buffer *low_memory_buffer = NULL;
+  struct hailo_vdma_continuous_buffer *continuous_buffer = NULL;
+  int fd = -EINVAL;
+
+  if (copy_from_user(&params, (void __user *)arg, sizeof(params))) {
+    hailo_dev_err(controller->dev, "copy from user fail\n");
+    return -EFAULT;
+  }
+
+  // The lock is held until the dmabuf takes its reference to the buffer.
+  mutex_lock(&context->lock);
+  low_memory_buffer =
+      hailo_vdma_find_low_memory_buffer(context, params.buffer_handle);
+  if (NULL == low_memory_buffer) {
+    continuous_buffer =
+        hailo_vdma_find_continuous_buffer(context, params.buffer_handle);
+  }
+  if ((NULL == low_memory_buffer) && (NULL == continuous_buffer)) {
+    mutex_unlock(&context->lock);
     hailo_dev_warn(controller->dev, "vdma buffer handle %lx not found\n",
                    params.buffer_handle);
     return -EINVAL;
   }
 
-  list_del(&continuous_buffer->continuous_buffer_list);
-  hailo_vdma_continuous_buffer_free(controller->dev, continuous_buffer);
-  kfree(continuous_buffer);
+  fd = hailo_vdma_buffer_export_dmabuf(low_memory_buffer, continuous_buffer,
+                                       O_RDWR | O_CLOEXEC);
+  mutex_unlock(&context->lock);
+  if (fd < 0) {
+    hailo_dev_err(controller->dev, "Failed exporting buffer %lx, err %d\n",
+                  params.buffer_handle, fd);
+    return fd;
+  }
+
+  // The fd is already installed, so on failure it is left to be closed by the
+  // process (as any other open fd).
+  params.dmabuf_fd = fd;
+  if (copy_to_user((void __user *)arg, &params, sizeof(params))) {
+    hailo_dev_err(controller->dev, "copy_to_user fail\n");
+    return -EFAULT;
+  }
+
   return 0;
 }
 
@@ -666,90 +823,167 @@ long hailo_vdma_interrupts_read_timestamps_ioctl(
   return 0;
 }
 
-long hailo_vdma_launch_transfer_ioctl(struct hailo_vdma_file_context *context,
-                                      struct hailo_vdma_controller *controller,
-                                      unsigned long arg) {
-  struct hailo_vdma_launch_transfer_params params;
-  struct hailo_vdma_engine *engine = NULL;
-  struct hailo_vdma_channel *channel = NULL;
-  struct hailo_descriptors_list_buffer *descriptors_buffer = NULL;
-  struct hailo_vdma_mapped_transfer_buffer
-      mapped_transfer_buffers[ARRAY_SIZE(params.buffers)] = {0};
-  int ret = -EINVAL;
-  u8 i = 0;
-
-  if (copy_from_user(&params, (void __user *)arg, sizeof(params))) {
-    hailo_dev_err(controller->dev, "copy from user fail\n");
-    return -EFAULT;
+// Drops the references taken by prepare_launch_transfer_buffers, if the
+// transfer was not launched.
+static void release_launch_transfer_buffers(
+    struct hailo_vdma_mapped_transfer_buffer *buffers, u32 buffers_count) {
+  u32 i = 0;
+  for (i = 0; i < buffers_count; i++) {
+    hailo_vdma_buffer_put((struct hailo_vdma_buffer *)buffers[i].opaque);
   }
+}
+
+// Validates the given transfer params, finds its channel, descriptors list and
+// buffers.
+// Must be called with the context lock held. On success, a reference is taken
+// on the descriptors list (dropped by the caller once the transfer is launched)
+// and on each buffer (owned by the ongoing transfer once launched), so they stay
+// valid after the lock is released.
+static int prepare_launch_transfer_buffers(
+    struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller, u8 engine_index,
+    u8 channel_index, uintptr_t desc_handle, u32 buffers_count,
+    const struct hailo_vdma_transfer_buffer *transfer_buffers,
+    u32 max_buffers_count, struct hailo_vdma_channel **channel,
+    struct hailo_descriptors_list_buffer **desc_buffer,
+    struct hailo_vdma_mapped_transfer_buffer *buffers) {
+  struct hailo_vdma_engine *engine = NULL;
+  u32 i = 0;
+  int err = -EINVAL;
 
-  if (params.engine_index >= controller->vdma_engines_count) {
-    hailo_dev_err(controller->dev, "Invalid engine %u", params.engine_index);
+  if (engine_index >= controller->vdma_engines_count) {
+    hailo_dev_err(controller->dev, "Invalid engine %u", engine_index);
     return -EINVAL;
   }
-  engine = &controller->vdma_engines[params.engine_index];
+  engine = &controller->vdma_engines[engine_index];
 
-  if (params.channel_index >= ARRAY_SIZE(engine->channels)) {
-    hailo_dev_err(controller->dev, "Invalid channel %u", params.channel_index);
+  if (channel_index >= ARRAY_SIZE(engine->channels)) {
+    hailo_dev_err(controller->dev, "Invalid channel %u", channel_index);
     return -EINVAL;
   }
-  channel = &engine->channels[params.channel_index];
+  *channel = &engine->channels[channel_index];
 
-  if (params.buffers_count > ARRAY_SIZE(params.buffers)) {
-    hailo_dev_err(controller->dev, "too many buffers %u\n",
-                  params.buffers_count);
+  if (buffers_count > max_buffers_count) {
+    hailo_dev_err(controller->dev, "too many buffers %u\n", buffers_count);
     return -EINVAL;
   }
 
-  descriptors_buffer =
-      hailo_vdma_find_descriptors_buffer(context, params.desc_handle);
-  if (descriptors_buffer == NULL) {
+  *desc_buffer = hailo_vdma_find_descriptors_buffer(context, desc_handle);
+  if (*desc_buffer == NULL) {
     hailo_dev_err(controller->dev, "invalid descriptors list handle\n");
     return -EFAULT;
   }
 
-  for (i = 0; i < params.buffers_count; i++) {
+  for (i = 0; i < buffers_count; i++) {
     struct hailo_vdma_buffer *mapped_buffer =
         hailo_vdma_find_mapped_user_buffer(
-            context, params.buffers[i].mapped_buffer_handle);
+            context, transfer_buffers[i].mapped_buffer_handle);
     if (mapped_buffer == NULL) {
       hailo_dev_err(controller->dev, "invalid user buffer\n");
-      return -EFAULT;
+      err = -EFAULT;
+      goto release_buffers;
     }
 
-    if (params.buffers[i].size > mapped_buffer->size) {
+    if (transfer_buffers[i].size > mapped_buffer->size) {
       hailo_dev_err(controller->dev,
                     "Syncing size %u while buffer size is %u\n",
-                    params.buffers[i].size, mapped_buffer->size);
-      return -EINVAL;
+                    transfer_buffers[i].size, mapped_buffer->size);
+      err = -EINVAL;
+      goto release_buffers;
     }
 
-    if (params.buffers[i].offset > mapped_buffer->size) {
+    if (transfer_buffers[i].offset > mapped_buffer->size) {
       hailo_dev_err(controller->dev,
                     "Syncing offset %u while buffer size is %u\n",
-                    params.buffers[i].offset, mapped_buffer->size);
-      return -EINVAL;
+                    transfer_buffers[i].offset, mapped_buffer->size);
+      err = -EINVAL;
+      goto release_buffers;
     }
 
+    buffers[i].sg_table = &mapped_buffer->sg_table;
+    buffers[i].size = transfer_buffers[i].size;
+    buffers[i].offset = transfer_buffers[i].offset;
+    // The buffer may be unmapped by the user while the transfer is ongoing.
+    hailo_vdma_buffer_get(mapped_buffer);
+    buffers[i].opaque = mapped_buffer;
+  }
+
+  hailo_vdma_descriptors_buffer_get(*desc_buffer);
+  return 0;
+
+release_buffers:
+  release_launch_transfer_buffers(buffers, i);
+  return err;
+}
+
+// Syncs the buffers found by prepare_launch_transfer_buffers for the device.
+// Called with the channel launch lock held, so the buffers of the transfers on a
+// channel are synced in the order the transfers are launched.
+static void sync_launch_transfer_buffers(
+    struct hailo_vdma_controller *controller,
+    struct hailo_vdma_mapped_transfer_buffer *buffers, u32 buffers_count) {
+  u32 i = 0;
+  for (i = 0; i < buffers_count; i++) {
     // Syncing the buffer to device change its ownership from host to the
     // device. We sync on D2H as well if the user owns the buffer since the
-    // buffer might have been changed by the host between the time it was mapped
-    // and the current async transfer.
+    // buffer might have been changed by the host between the time it was
+    // mapped and the current async transfer.
     hailo_vdma_buffer_sync_cyclic(
-        controller, mapped_buffer, HAILO_SYNC_FOR_DEVICE,
-        params.buffers[i].offset, params.buffers[i].size);
+        controller, (struct hailo_vdma_buffer *)buffers[i].opaque,
+        HAILO_SYNC_FOR_DEVICE, buffers[i].offset, buffers[i].size);
+  }
+}
 
-    mapped_transfer_buffers[i].sg_table = &mapped_buffer->sg_table;
-    mapped_transfer_buffers[i].size = params.buffers[i].size;
-    mapped_transfer_buffers[i].offset = params.buffers[i].offset;
-    mapped_transfer_buffers[i].opaque = mapped_buffer;
+long hailo_vdma_launch_transfer_ioctl(struct hailo_vdma_file_context *context,
+                                      struct hailo_vdma_controller *controller,
+                                      unsigned long arg) {
+  struct hailo_vdma_launch_transfer_params params;
+  struct hailo_vdma_channel *channel = NULL;
+  struct hailo_descriptors_list_buffer *descriptors_buffer = NULL;
+  struct hailo_vdma_mapped_transfer_buffer
+      mapped_transfer_buffers[ARRAY_SIZE(params.buffers)] = {0};
+  struct mutex *launch_lock = NULL;
+  spinlock_t *channel_lock = NULL;
+  unsigned long irq_saved_flags = 0;
+  int ret = -EINVAL;
+
+  if (copy_from_user(&params, (void __user *)arg, sizeof(params))) {
+    hailo_dev_err(controller->dev, "copy from user fail\n");
+    return -EFAULT;
   }
 
+  mutex_lock(&context->lock);
+  ret = prepare_launch_transfer_buffers(
+      context, controller, params.engine_index, params.channel_index,
+      params.desc_handle, params.buffers_count, params.buffers,
+      ARRAY_SIZE(params.buffers), &channel, &descriptors_buffer,
+      mapped_transfer_buffers);
+  mutex_unlock(&context->lock);
+  if (ret < 0) {
+    return ret;
+  }
+
+  launch_lock = hailo_vdma_channel_launch_lock(
+      controller, params.engine_index, params.channel_index);
+  mutex_lock(launch_lock);
+  sync_launch_transfer_buffers(controller, mapped_transfer_buffers,
+                               params.buffers_count);
+
+  channel_lock = hailo_vdma_channel_lock(controller, params.engine_index,
+                                         params.channel_index);
+  spin_lock_irqsave(channel_lock, irq_saved_flags);
   ret = hailo_vdma_launch_transfer(
       controller->hw, channel, &descriptors_buffer->desc_list,
       params.starting_desc, params.buffers_count, mapped_transfer_buffers,
       params.should_bind, params.first_interrupts_domain,
       params.last_interrupts_domain, params.is_debug);
+  spin_unlock_irqrestore(channel_lock, irq_saved_flags);
+  mutex_unlock(launch_lock);
+  if (ret < 0) {
+    release_launch_transfer_buffers(mapped_transfer_buffers,
+                                    params.buffers_count);
+  }
+  hailo_vdma_descriptors_buffer_put(descriptors_buffer);
   if (ret < 0) {
     params.launch_transfer_status = ret;
     if (-ECONNRESET != ret) {
@@ -772,3 +1006,324 @@ long hailo_vdma_launch_transfer_ioctl(struct hailo_vdma_file_context *context,
 
   return 0;
 }
+
+long hailo_vdma_launch_transfers_batch_ioctl(
+    struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller, unsigned long arg) {
+  struct hailo_vdma_launch_transfers_batch_params *params = NULL;
+  struct hailo_vdma_launch_transfer_params *transfer = NULL;
+  struct hailo_vdma_engine *engine = NULL;
+  struct hailo_vdma_channel *channel = NULL;
+  struct hailo_descriptors_list_buffer *descriptors_buffer = NULL;
+  struct hailo_vdma_mapped_transfer_buffer
+      mapped_transfer_buffers[HAILO_MAX_BUFFERS_PER_SINGLE_TRANSFER];
+  // Channels with transfers prepared on this batch, waiting for the doorbell.
+  u32 pending_channels_per_engine[MAX_VDMA_ENGINES] = {0};
+  struct mutex *launch_lock = NULL;
+  spinlock_t *channel_lock = NULL;
+  unsigned long irq_saved_flags = 0;
+  u8 engine_index = 0;
+  u8 channel_index = 0;
+  long err = 0;
+  int ret = 0;
+  u32 i = 0;
+
+  // The params are too big for the stack
+  params = kmalloc(sizeof(*params), GFP_KERNEL);
+  if (NULL == params) {
+    hailo_dev_err(controller->dev, "Failed allocating batch params\n");
+    return -ENOMEM;
+  }
+
+  if (copy_from_user(params, (void __user *)arg, sizeof(*params))) {
+    hailo_dev_err(controller->dev, "copy from user fail\n");
+    err = -EFAULT;
+    goto free_params;
+  }
+
+  if (params->transfers_count > ARRAY_SIZE(params->transfers)) {
+    hailo_dev_err(controller->dev, "too many transfers in batch %u\n",
+                  params->transfers_count);
+    err = -EINVAL;
+    goto free_params;
+  }
+
+  for (i = 0; i < params->transfers_count; i++) {
+    transfer = &params->transfers[i];
+    memset(mapped_transfer_buffers, 0, sizeof(mapped_transfer_buffers));
+
+    mutex_lock(&context->lock);
+    ret = prepare_launch_transfer_buffers(
+        context, controller, transfer->engine_index, transfer->channel_index,
+        transfer->desc_handle, transfer->buffers_count, transfer->buffers,
+        ARRAY_SIZE(transfer->buffers), &channel, &descriptors_buffer,
+        mapped_transfer_buffers);
+    mutex_unlock(&context->lock);
+    if (ret == 0) {
+      launch_lock = hailo_vdma_channel_launch_lock(
+          controller, transfer->engine_index, transfer->channel_index);
+      mutex_lock(launch_lock);
+      sync_launch_transfer_buffers(controller, mapped_transfer_buffers,
+                                   transfer->buffers_count);
+
+      // The hw state is valid only until the first transfer of the channel
+      // is prepared.
+      channel_lock = hailo_vdma_channel_lock(
+          controller, transfer->engine_index, transfer->channel_index);
+      spin_lock_irqsave(channel_lock, irq_saved_flags);
+      ret = hailo_vdma_prepare_transfer(
+          controller->hw, channel, &descriptors_buffer->desc_list,
+          transfer->starting_desc, transfer->buffers_count,
+          mapped_transfer_buffers, transfer->should_bind,
+          transfer->first_interrupts_domain, transfer->last_interrupts_domain,
+          transfer->is_debug,
+          !hailo_test_bit(
+              transfer->channel_index,
+              &pending_channels_per_engine[transfer->engine_index]));
+      spin_unlock_irqrestore(channel_lock, irq_saved_flags);
+      mutex_unlock(launch_lock);
+      if (ret < 0) {
+        release_launch_transfer_buffers(mapped_transfer_buffers,
+                                        transfer->buffers_count);
+      }
+      hailo_vdma_descriptors_buffer_put(descriptors_buffer);
+    }
+
+    if (ret < 0) {
+      if (-ECONNRESET != ret) {
+        hailo_dev_err(controller->dev,
+                      "Failed launch transfer %u in batch %d\n", i, ret);
+      }
+      transfer->descs_programed = 0;
+      transfer->launch_transfer_status = ret;
+      // Return the first error, the rest of the transfers are still launched.
+      if (0 == err) {
+        err = ret;
+      }
+      continue;
+    }
+
+    hailo_set_bit(transfer->channel_index,
+                  &pending_channels_per_engine[transfer->engine_index]);
+    transfer->descs_programed = ret;
+    transfer->launch_transfer_status = 0;
+  }
+
+  // Single num available write for each channel, for all its transfers.
+  for_each_vdma_engine(controller, engine, engine_index) {
+    for_each_vdma_channel(engine, channel, channel_index) {
+      if (hailo_test_bit(channel_index,
+                         &pending_channels_per_engine[engine_index])) {
+        channel_lock =
+            hailo_vdma_channel_lock(controller, engine_index, channel_index);
+        spin_lock_irqsave(channel_lock, irq_saved_flags);
+        hailo_vdma_channel_ring_doorbell(channel);
+        spin_unlock_irqrestore(channel_lock, irq_saved_flags);
+      }
+    }
+  }
+
+  // Still need to copy statuses back to userspace - success oriented
+  if (copy_to_user((void __user *)arg, params, sizeof(*params))) {
+    hailo_dev_err(controller->dev, "copy_to_user fail\n");
+    if (0 == err) {
+      err = -EFAULT;
+    }
+  }
+
+free_params:
+  kfree(params);
+  return err;
+}
+
+long hailo_vdma_launch_scatter_transfer_ioctl(
+    struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller, unsigned long arg) {
+  struct hailo_vdma_launch_scatter_transfer_params params;
+  struct hailo_vdma_transfer_buffer *transfer_buffers = NULL;
+  struct hailo_vdma_mapped_transfer_buffer *mapped_transfer_buffers = NULL;
+  struct hailo_vdma_channel *channel = NULL;
+  struct hailo_descriptors_list_buffer *descriptors_buffer = NULL;
+  struct mutex *launch_lock = NULL;
+  spinlock_t *channel_lock = NULL;
+  unsigned long irq_saved_flags = 0;
+  long err = 0;
+  int ret = -EINVAL;
+
+  if (copy_from_user(&params, (void __user *)arg, sizeof(params))) {
+    hailo_dev_err(controller->dev, "copy from user fail\n");
+    return -EFAULT;
+  }
+
+  if ((0 == params.buffers_count) ||
+      (params.buffers_count > HAILO_VDMA_MAX_BUFFERS_PER_SCATTER_TRANSFER)) {
+    hailo_dev_err(controller->dev, "Invalid scatter buffers count %u\n",
+                  params.buffers_count);
+    return -EINVAL;
+  }
+
+  // The buffers lists are too big for the stack
+  transfer_buffers = kmalloc_array(params.buffers_count,
+                                   sizeof(*transfer_buffers), GFP_KERNEL);
+  mapped_transfer_buffers = kcalloc(
+      params.buffers_count, sizeof(*mapped_transfer_buffers), GFP_KERNEL);
+  if ((NULL == transfer_buffers) || (NULL == mapped_transfer_buffers)) {
+    hailo_dev_err(controller->dev, "Failed allocating scatter buffers\n");
+    err = -ENOMEM;
+    goto free_buffers;
+  }
+
+  if (copy_from_user(transfer_buffers, u64_to_user_ptr(params.buffers),
+                     params.buffers_count * sizeof(*transfer_buffers))) {
+    hailo_dev_err(controller->dev, "copy from user fail\n");
+    err = -EFAULT;
+    goto free_buffers;
+  }
+
+  mutex_lock(&context->lock);
+  ret = prepare_launch_transfer_buffers(
+      context, controller, params.engine_index, params.channel_index,
+      params.desc_handle, params.buffers_count, transfer_buffers,
+      HAILO_VDMA_MAX_BUFFERS_PER_SCATTER_TRANSFER, &channel,
+      &descriptors_buffer, mapped_transfer_buffers);
+  mutex_unlock(&context->lock);
+  if (ret < 0) {
+    err = ret;
+    goto free_buffers;
+  }
+
+  launch_lock = hailo_vdma_channel_launch_lock(
+      controller, params.engine_index, params.channel_index);
+  mutex_lock(launch_lock);
+  sync_launch_transfer_buffers(controller, mapped_transfer_buffers,
+                               params.buffers_count);
+
+  channel_lock = hailo_vdma_channel_lock(controller, params.engine_index,
+                                         params.channel_index);
+  spin_lock_irqsave(channel_lock, irq_saved_flags);
+  ret = hailo_vdma_launch_transfer(
+      controller->hw, channel, &descriptors_buffer->desc_list,
+      params.starting_desc, (u8)params.buffers_count, mapped_transfer_buffers,
+      params.should_bind, params.first_interrupts_domain,
+      params.last_interrupts_domain, params.is_debug);
+  spin_unlock_irqrestore(channel_lock, irq_saved_flags);
+  mutex_unlock(launch_lock);
+  if (ret < 0) {
+    release_launch_transfer_buffers(mapped_transfer_buffers,
+                                    params.buffers_count);
+  }
+  hailo_vdma_descriptors_buffer_put(descriptors_buffer);
+  if (ret < 0) {
+    params.launch_transfer_status = ret;
+    if (-ECONNRESET != ret) {
+      hailo_dev_err(controller->dev, "Failed launch scatter transfer %d\n",
+                    ret);
+    }
+    // Still need to copy fail status back to userspace - success oriented
+    if (copy_to_user((void __user *)arg, &params, sizeof(params))) {
+      hailo_dev_err(controller->dev, "copy_to_user fail\n");
+    }
+    err = ret;
+    goto free_buffers;
+  }
+
+  params.descs_programed = ret;
+  params.launch_transfer_status = 0;
+
+  if (copy_to_user((void __user *)arg, &params, sizeof(params))) {
+    hailo_dev_err(controller->dev, "copy_to_user fail\n");
+    err = -EFAULT;
+  }
+
+free_buffers:
+  kfree(mapped_transfer_buffers);
+  kfree(transfer_buffers);
+  return err;
+}
+
+long hailo_vdma_completion_ring_create_ioctl(
+    struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller, unsigned long arg) {
+  struct hailo_vdma_completion_ring_create_params params;
+  struct hailo_vdma_completion_ring_buffer *ring_buffer = NULL;
+  struct hailo_vdma_engine *engine = NULL;
+  u8 engine_index = 0;
+  u8 channel_index = 0;
+  u32 channels_bitmap = 0;
+  unsigned long irq_saved_flags = 0;
+  long err = -EINVAL;
+
+  if (copy_from_user(&params, (void __user *)arg, sizeof(params))) {
+    hailo_dev_err(controller->dev, "copy from user fail\n");
+    return -EFAULT;
+  }
+
+  if (NULL != context->completion_ring) {
+    hailo_dev_err(controller->dev, "Completion ring already created\n");
+    return -EBUSY;
+  }
+
+  // Validate params (ignoring engine_index >= controller->vdma_engines_count).
+  for_each_vdma_engine(controller, engine, engine_index) {
+    channels_bitmap = params.channels_bitmap_per_engine[engine_index];
+    if (channels_bitmap !=
+        (channels_bitmap & context->enabled_channels_bitmap[engine_index])) {
+      hailo_dev_err(controller->dev,
+                    "Completion ring channels must be enabled by the same "
+                    "file, engine %u bitmap 0x%x\n",
+                    engine_index, channels_bitmap);
+      return -EINVAL;
+    }
+  }
+
+  ring_buffer = kzalloc(sizeof(*ring_buffer), GFP_KERNEL);
+  if (NULL == ring_buffer) {
+    hailo_dev_err(controller->dev, "memory alloc failed\n");
+    return -ENOMEM;
+  }
+
+  ring_buffer->size = PAGE_ALIGN(sizeof(*ring_buffer->ring));
+  // vmalloc_user zeroes the memory, so the ring starts empty.
+  ring_buffer->ring = vmalloc_user(ring_buffer->size);
+  if (NULL == ring_buffer->ring) {
+    hailo_dev_err(controller->dev, "Failed allocating completion ring\n");
+    err = -ENOMEM;
+    goto free_ring_buffer;
+  }
+  ring_buffer->head = 0;
+  ring_buffer->handle = hailo_get_next_vdma_handle(context);
+
+  params.ring_handle = ring_buffer->handle;
+  params.ring_size = ring_buffer->size;
+  if (copy_to_user((void __user *)arg, &params, sizeof(params))) {
+    hailo_dev_err(controller->dev, "copy_to_user fail\n");
+    err = -EFAULT;
+    goto free_ring;
+  }
+
+  // Taking the lock, since mmap may look the ring up concurrently.
+  mutex_lock(&context->lock);
+  context->completion_ring = ring_buffer;
+  mutex_unlock(&context->lock);
+
+  spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
+  for_each_vdma_engine(controller, engine, engine_index) {
+    channels_bitmap = params.channels_bitmap_per_engine[engine_index];
+    for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE;
+         channel_index++) {
+      if (hailo_test_bit(channel_index, &channels_bitmap)) {
+        controller->completion_rings[engine_index][channel_index] =
+            ring_buffer;
+      }
+    }
+  }
+  spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+
+  return 0;
+
+free_ring:
+  vfree(ring_buffer->ring);
+free_ring_buffer:
+  kfree(ring_buffer);
+  return err;
+}
@@ -10,8 +10,7 @@
 
 long hailo_vdma_enable_channels_ioctl(struct hailo_vdma_controller *controller, unsigned long arg, struct hailo_vdma_file_context *context);
 long hailo_vdma_disable_channels_ioctl(struct hailo_vdma_controller *controller, unsigned long arg, struct hailo_vdma_file_context *context);
-long hailo_vdma_interrupts_wait_ioctl(struct hailo_vdma_controller *controller, unsigned long arg,
-    struct semaphore *mutex, bool *should_up_board_mutex);
+long hailo_vdma_interrupts_wait_ioctl(struct hailo_vdma_controller *controller, unsigned long arg);
 
 long hailo_vdma_buffer_map_ioctl(struct hailo_vdma_file_context *context, struct hailo_vdma_controller *controller, unsigned long arg);
 long hailo_vdma_buffer_unmap_ioctl(struct hailo_vdma_file_context *context, struct hailo_vdma_controller *controller, unsigned long handle);
@@ -28,10 +27,19 @@ long hailo_mark_as_in_use(struct hailo_vdma_controller *controller, unsigned lon
 
 long hailo_vdma_continuous_buffer_alloc_ioctl(struct hailo_vdma_file_context *context, struct hailo_vdma_controller *controller, unsigned long arg);
 long hailo_vdma_continuous_buffer_free_ioctl(struct hailo_vdma_file_context *context, struct hailo_vdma_controller *controller, unsigned long arg);
+long hailo_vdma_buffer_export_dmabuf_ioctl(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller, unsigned long arg);
 
 long hailo_vdma_interrupts_read_timestamps_ioctl(struct hailo_vdma_controller *controller, unsigned long arg);
 
 long hailo_vdma_launch_transfer_ioctl(struct hailo_vdma_file_context *context, struct hailo_vdma_controller *controller,
     unsigned long arg);
+long hailo_vdma_launch_transfers_batch_ioctl(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller, unsigned long arg);
+long hailo_vdma_launch_scatter_transfer_ioctl(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller, unsigned long arg);
+
+long hailo_vdma_completion_ring_create_ioctl(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller, unsigned long arg);
 
 #endif /* _HAILO_VDMA_IOCTL_H_ */
\ No newline at end of file
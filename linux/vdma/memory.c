@@ -13,6 +13,11 @@
 #include <linux/scatterlist.h>
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/log2.h>
+#include <linux/llist.h>
+#if defined(HAILO_SUPPORT_VDMA_BUFFER_CACHE)
+#include <linux/mmu_notifier.h>
+#endif
 
 // See linux/mm.h
 #define MMIO_AND_NO_PAGES_VMA_MASK (VM_IO | VM_PFNMAP)
@@ -21,9 +26,9 @@
 
 static int map_mmio_address(uintptr_t user_address, u32 size, struct vm_area_struct *vma,
     struct sg_table *sgt);
-static int prepare_sg_table(struct sg_table *sg_table, uintptr_t user_address, u32 size,
-    struct hailo_vdma_low_memory_buffer *low_mem_driver_allocated_buffer);
-static void clear_sg_table(struct sg_table *sgt);
+static int prepare_sg_table(struct device *dev, struct sg_table *sg_table, uintptr_t user_address, u32 size,
+    enum dma_data_direction direction, struct hailo_vdma_low_memory_buffer *low_mem_driver_allocated_buffer);
+static void clear_sg_table(struct sg_table *sgt, bool is_pinned_user_memory, enum dma_data_direction direction);
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION( 3, 3, 0 )
 
@@ -38,14 +43,269 @@ static void clear_sg_table(struct sg_table *sgt);
 MODULE_IMPORT_NS(DMA_NS_NAME);
 #endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0) */
 
-static int hailo_map_dmabuf(struct device *dev, int dmabuf_fd, enum dma_data_direction direction, struct sg_table *sgt,
-    struct hailo_dmabuf_info *dmabuf_info)
+#if defined(HAILO_SUPPORT_DMABUF_ATTACHMENT_CACHE)
+
+static unsigned int dmabuf_cache_max_entries = 16;
+module_param(dmabuf_cache_max_entries, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(dmabuf_cache_max_entries,
+    "Max unmapped dmabufs kept attached and mapped per file for reuse (0 disables the cache)");
+
+// Attachment of the device to a dmabuf, shared by all the mapped buffers of the dmabuf (with the same direction).
+struct hailo_dmabuf_cache_entry {
+    struct hailo_dmabuf_cache *cache;
+    // Link in cache->entries.
+    struct list_head list;
+    // Link in cache->lru, while the entry is idle.
+    struct list_head lru_list;
+    struct dma_buf *dmabuf;
+    struct dma_buf_attachment *attachment;
+    enum dma_data_direction direction;
+    // The attachment mapping, NULL if not mapped. Protected by the dmabuf reservation lock.
+    struct sg_table *sgt;
+    // Set by the exporter when the (unpinned) buffer is moved. Protected by the dmabuf reservation lock.
+    bool is_invalidated;
+    // Number of mapped buffers using the entry, the attachment is pinned while it is not 0.
+    size_t users;
+};
+
+// Called by the exporter with the dmabuf reservation lock held. Attachments in use are pinned, so the buffer may only
+// be moved while the entry is idle - its mapping is replaced on the next use.
+static void dmabuf_cache_move_notify(struct dma_buf_attachment *attachment)
+{
+    struct hailo_dmabuf_cache_entry *entry = attachment->importer_priv;
+
+    entry->is_invalidated = true;
+    atomic64_inc(&entry->cache->stats->invalidations);
+}
+
+static const struct dma_buf_attach_ops dmabuf_cache_attach_ops = {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+    // Exporters check the pci topology themselves before mapping their device memory for peer to peer DMA.
+    .allow_peer2peer = true,
+#endif
+    .move_notify = dmabuf_cache_move_notify,
+};
+
+// Takes ownership of the dmabuf reference. Called with the cache lock held.
+static struct hailo_dmabuf_cache_entry *dmabuf_cache_entry_create(struct hailo_dmabuf_cache *cache,
+    struct device *dev, struct dma_buf *dmabuf, enum dma_data_direction direction)
+{
+    struct hailo_dmabuf_cache_entry *entry = NULL;
+    struct dma_buf_attachment *attachment = NULL;
+
+    entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+    if (NULL == entry) {
+        dma_buf_put(dmabuf);
+        return ERR_PTR(-ENOMEM);
+    }
+
+    attachment = dma_buf_dynamic_attach(dmabuf, dev, &dmabuf_cache_attach_ops, entry);
+    if (IS_ERR(attachment)) {
+        dev_err(dev, "dma_buf_attach failed, err=%ld\n", PTR_ERR(attachment));
+        kfree(entry);
+        dma_buf_put(dmabuf);
+        return ERR_PTR(-EINVAL);
+    }
+
+    entry->cache = cache;
+    entry->dmabuf = dmabuf;
+    entry->attachment = attachment;
+    entry->direction = direction;
+    INIT_LIST_HEAD(&entry->lru_list);
+    list_add(&entry->list, &cache->entries);
+    return entry;
+}
+
+// Called with the cache lock held, on an entry that is not used.
+static void dmabuf_cache_entry_release(struct hailo_dmabuf_cache_entry *entry)
+{
+    struct dma_buf *dmabuf = entry->dmabuf;
+
+    list_del(&entry->list);
+
+    dma_resv_lock(dmabuf->resv, NULL);
+    if (NULL != entry->sgt) {
+        dma_buf_unmap_attachment(entry->attachment, entry->sgt, entry->direction);
+    }
+    dma_resv_unlock(dmabuf->resv);
+
+    dma_buf_detach(dmabuf, entry->attachment);
+    dma_buf_put(dmabuf);
+    kfree(entry);
+}
+
+// Pins the entry attachment for a new user, mapping it if needed. Called with the cache lock held.
+static int dmabuf_cache_entry_use(struct hailo_dmabuf_cache_entry *entry, struct device *dev)
+{
+    struct sg_table *sgt = NULL;
+    int err = 0;
+
+    dma_resv_lock(entry->dmabuf->resv, NULL);
+    if (0 == entry->users) {
+        err = dma_buf_pin(entry->attachment);
+        if (err < 0) {
+            dev_err(dev, "dma_buf_pin failed, err=%d\n", err);
+            goto unlock;
+        }
+    }
+
+    if ((NULL != entry->sgt) && entry->is_invalidated) {
+        dma_buf_unmap_attachment(entry->attachment, entry->sgt, entry->direction);
+        entry->sgt = NULL;
+    }
+
+    if (NULL == entry->sgt) {
+        sgt = dma_buf_map_attachment(entry->attachment, entry->direction);
+        if (IS_ERR(sgt)) {
+            err = PTR_ERR(sgt);
+            dev_err(dev, "dma_buf_map_attachment failed, err=%d\n", err);
+            if (0 == entry->users) {
+                dma_buf_unpin(entry->attachment);
+            }
+            goto unlock;
+        }
+        entry->sgt = sgt;
+        entry->is_invalidated = false;
+    }
+
+    entry->users++;
+
+unlock:
+    dma_resv_unlock(entry->dmabuf->resv);
+    return err;
+}
+
+static int hailo_map_dmabuf(struct hailo_dmabuf_cache *cache, struct device *dev, int dmabuf_fd,
+    enum dma_data_direction direction, struct sg_table *sgt, struct hailo_dmabuf_info *dmabuf_info)
+{
+    int ret = -EINVAL;
+    struct dma_buf *dmabuf = NULL;
+    struct hailo_dmabuf_cache_entry *entry = NULL, *cur = NULL;
+
+    dmabuf = dma_buf_get(dmabuf_fd);
+    if (IS_ERR(dmabuf)) {
+        dev_err(dev, "dma_buf_get failed, err=%ld\n", PTR_ERR(dmabuf));
+        return -EINVAL;
+    }
+
+    mutex_lock(&cache->lock);
+    list_for_each_entry(cur, &cache->entries, list) {
+        if ((cur->dmabuf == dmabuf) && (cur->direction == direction)) {
+            entry = cur;
+            break;
+        }
+    }
+
+    if (NULL != entry) {
+        atomic64_inc(&cache->stats->hits);
+        // The entry holds its own reference.
+        dma_buf_put(dmabuf);
+    } else {
+        atomic64_inc(&cache->stats->misses);
+        entry = dmabuf_cache_entry_create(cache, dev, dmabuf, direction);
+        if (IS_ERR(entry)) {
+            mutex_unlock(&cache->lock);
+            return PTR_ERR(entry);
+        }
+    }
+
+    ret = dmabuf_cache_entry_use(entry, dev);
+    if (ret < 0) {
+        if (0 == entry->users) {
+            if (!list_empty(&entry->lru_list)) {
+                list_del_init(&entry->lru_list);
+                cache->idle_count--;
+            }
+            dmabuf_cache_entry_release(entry);
+        }
+        mutex_unlock(&cache->lock);
+        return ret;
+    }
+
+    if (!list_empty(&entry->lru_list)) {
+        list_del_init(&entry->lru_list);
+        cache->idle_count--;
+    }
+    mutex_unlock(&cache->lock);
+
+    // The entry is pinned, so its mapping is valid until the buffer is unmapped.
+    *sgt = *entry->sgt;
+
+    dmabuf_info->dmabuf = entry->dmabuf;
+    dmabuf_info->dmabuf_attachment = entry->attachment;
+    dmabuf_info->dmabuf_sg_table = entry->sgt;
+    dmabuf_info->cache_entry = entry;
+    return 0;
+}
+
+static void hailo_unmap_dmabuf(struct hailo_vdma_buffer *vdma_buffer)
+{
+    struct hailo_dmabuf_cache_entry *entry = vdma_buffer->dmabuf_info.cache_entry;
+    struct hailo_dmabuf_cache *cache = entry->cache;
+    struct hailo_dmabuf_cache_entry *evicted = NULL;
+
+    mutex_lock(&cache->lock);
+    dma_resv_lock(entry->dmabuf->resv, NULL);
+    entry->users--;
+    if (0 == entry->users) {
+        dma_buf_unpin(entry->attachment);
+    }
+    dma_resv_unlock(entry->dmabuf->resv);
+
+    if (0 == entry->users) {
+        if (cache->is_finalized || (0 == READ_ONCE(dmabuf_cache_max_entries))) {
+            dmabuf_cache_entry_release(entry);
+        } else {
+            list_add(&entry->lru_list, &cache->lru);
+            cache->idle_count++;
+            if (cache->idle_count > READ_ONCE(dmabuf_cache_max_entries)) {
+                evicted = list_last_entry(&cache->lru, struct hailo_dmabuf_cache_entry, lru_list);
+                list_del_init(&evicted->lru_list);
+                cache->idle_count--;
+                atomic64_inc(&cache->stats->evictions);
+                dmabuf_cache_entry_release(evicted);
+            }
+        }
+    }
+    mutex_unlock(&cache->lock);
+}
+
+void hailo_dmabuf_cache_init(struct hailo_dmabuf_cache *cache, struct hailo_dmabuf_cache_stats *stats)
+{
+    mutex_init(&cache->lock);
+    INIT_LIST_HEAD(&cache->entries);
+    INIT_LIST_HEAD(&cache->lru);
+    cache->idle_count = 0;
+    cache->is_finalized = false;
+    cache->stats = stats;
+}
+
+void hailo_dmabuf_cache_finalize(struct hailo_dmabuf_cache *cache)
+{
+    struct hailo_dmabuf_cache_entry *cur = NULL, *next = NULL;
+
+    mutex_lock(&cache->lock);
+    cache->is_finalized = true;
+    list_for_each_entry_safe(cur, next, &cache->lru, lru_list) {
+        list_del_init(&cur->lru_list);
+        dmabuf_cache_entry_release(cur);
+    }
+    cache->idle_count = 0;
+    mutex_unlock(&cache->lock);
+}
+
+#else /* defined(HAILO_SUPPORT_DMABUF_ATTACHMENT_CACHE) */
+
+static int hailo_map_dmabuf(struct hailo_dmabuf_cache *cache, struct device *dev, int dmabuf_fd,
+    enum dma_data_direction direction, struct sg_table *sgt, struct hailo_dmabuf_info *dmabuf_info)
 {
     int ret = -EINVAL;
     struct dma_buf *dmabuf = NULL;
     struct dma_buf_attachment *dmabuf_attachment = NULL;
     struct sg_table *res_sgt = NULL;
 
+    (void)cache;
+
     dmabuf = dma_buf_get(dmabuf_fd);
     if (IS_ERR(dmabuf)) {
         dev_err(dev, "dma_buf_get failed, err=%ld\n", PTR_ERR(dmabuf));
@@ -88,11 +348,14 @@ static void hailo_unmap_dmabuf(struct hailo_vdma_buffer *vdma_buffer)
     dma_buf_put(vdma_buffer->dmabuf_info.dmabuf);
 }
 
+#endif /* defined(HAILO_SUPPORT_DMABUF_ATTACHMENT_CACHE) */
+
 #else /* LINUX_VERSION_CODE >= KERNEL_VERSION( 3, 3, 0 ) */
 
-static int hailo_map_dmabuf(struct device *dev, int dmabuf_fd, enum dma_data_direction direction, struct sg_table *sgt,
-    struct hailo_dmabuf_info *dmabuf_info)
+static int hailo_map_dmabuf(struct hailo_dmabuf_cache *cache, struct device *dev, int dmabuf_fd,
+    enum dma_data_direction direction, struct sg_table *sgt, struct hailo_dmabuf_info *dmabuf_info)
 {
+    (void) cache;
     (void) dmabuf_fd;
     (void) direction;
     (void) sgt;
@@ -109,6 +372,25 @@ static void hailo_unmap_dmabuf(struct hailo_vdma_buffer *vdma_buffer)
 
 #endif /* LINUX_VERSION_CODE >= KERNEL_VERSION( 3, 3, 0 ) */
 
+#if !defined(HAILO_SUPPORT_DMABUF_ATTACHMENT_CACHE)
+
+void hailo_dmabuf_cache_init(struct hailo_dmabuf_cache *cache, struct hailo_dmabuf_cache_stats *stats)
+{
+    mutex_init(&cache->lock);
+    INIT_LIST_HEAD(&cache->entries);
+    INIT_LIST_HEAD(&cache->lru);
+    cache->idle_count = 0;
+    cache->is_finalized = false;
+    cache->stats = stats;
+}
+
+void hailo_dmabuf_cache_finalize(struct hailo_dmabuf_cache *cache)
+{
+    (void)cache;
+}
+
+#endif /* !defined(HAILO_SUPPORT_DMABUF_ATTACHMENT_CACHE) */
+
 // Function that checks if the vma is backed by a mapped dmabuf
 static bool is_dmabuf_vma(struct vm_area_struct *vma)
 {
@@ -142,7 +424,73 @@ static int create_fd_from_vma(struct device *dev, struct vm_area_struct *vma) {
     return fd;
 }
 
-struct hailo_vdma_buffer *hailo_vdma_buffer_map(struct device *dev,
+// On coherent devices, syncs are needed only for buffers that are bounced (e.g. by swiotlb).
+static bool buffer_needs_sync(struct device *dev, struct sg_table *sgt)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+    struct scatterlist *sg_entry = NULL;
+    int i = 0;
+
+    for_each_sg(sgt->sgl, sg_entry, sgt->nents, i) {
+        if (dma_need_sync(dev, sg_dma_address(sg_entry))) {
+            return true;
+        }
+    }
+    return false;
+#else
+    return true;
+#endif
+}
+
+// Sg entries are merged only from pages of the same pagemap, so checking the first page of each entry is enough.
+// Buffers mixing host memory and p2pdma pages are not supported (the host memory part would need syncs), so
+// -EINVAL is returned for them.
+static int get_sg_table_p2pdma_type(struct sg_table *sgt, bool *is_p2pdma)
+{
+    struct scatterlist *sg_entry = NULL;
+    unsigned int p2pdma_entries = 0;
+    int i = 0;
+
+    for_each_sg(sgt->sgl, sg_entry, sgt->orig_nents, i) {
+        if ((NULL != sg_page(sg_entry)) && is_pci_p2pdma_page(sg_page(sg_entry))) {
+            p2pdma_entries++;
+        }
+    }
+
+    if ((0 != p2pdma_entries) && (p2pdma_entries != sgt->orig_nents)) {
+        return -EINVAL;
+    }
+
+    *is_p2pdma = (0 != p2pdma_entries);
+    return 0;
+}
+
+// Index every HAILO_VDMA_SG_INDEX_STRIDE'th dma mapped sg entry of the buffer. The index is an optimization for
+// partial syncs, so allocation failure is not an error.
+static void build_sg_index(struct hailo_vdma_buffer *mapped_buffer, struct sg_table *sgt)
+{
+    struct scatterlist *sg_entry = NULL;
+    size_t offset = 0;
+    int i = 0;
+
+    mapped_buffer->sg_index_count = DIV_ROUND_UP(sgt->nents, HAILO_VDMA_SG_INDEX_STRIDE);
+    mapped_buffer->sg_index = kmalloc_array(mapped_buffer->sg_index_count, sizeof(*mapped_buffer->sg_index),
+        GFP_KERNEL);
+    if (NULL == mapped_buffer->sg_index) {
+        mapped_buffer->sg_index_count = 0;
+        return;
+    }
+
+    for_each_sg(sgt->sgl, sg_entry, sgt->nents, i) {
+        if (0 == (i % HAILO_VDMA_SG_INDEX_STRIDE)) {
+            mapped_buffer->sg_index[i / HAILO_VDMA_SG_INDEX_STRIDE].sg_entry = sg_entry;
+            mapped_buffer->sg_index[i / HAILO_VDMA_SG_INDEX_STRIDE].offset = offset;
+        }
+        offset += sg_dma_len(sg_entry);
+    }
+}
+
+struct hailo_vdma_buffer *hailo_vdma_buffer_map(struct device *dev, struct hailo_dmabuf_cache *dmabuf_cache,
     uintptr_t user_address, size_t size, enum dma_data_direction direction,
     enum hailo_dma_buffer_type buffer_type, struct hailo_vdma_low_memory_buffer *low_mem_driver_allocated_buffer)
 {
@@ -205,7 +553,7 @@ struct hailo_vdma_buffer *hailo_vdma_buffer_map(struct device *dev,
         }
     } else if (HAILO_DMA_DMABUF_BUFFER == buffer_type) {
         // Content user_address in case of dmabuf is fd - for now
-        ret = hailo_map_dmabuf(dev, user_address, direction, &sgt, &dmabuf_info);
+        ret = hailo_map_dmabuf(dmabuf_cache, dev, user_address, direction, &sgt, &dmabuf_info);
         if (ret < 0) {
             dev_err(dev, "Failed mapping dmabuf\n");
             goto cleanup;
@@ -217,17 +565,28 @@ struct hailo_vdma_buffer *hailo_vdma_buffer_map(struct device *dev,
         }
     } else {
         // user_address is a standard 'struct page' backed memory address
-        ret = prepare_sg_table(&sgt, user_address, size, low_mem_driver_allocated_buffer);
+        ret = prepare_sg_table(dev, &sgt, user_address, size, direction, low_mem_driver_allocated_buffer);
         if (ret < 0) {
             dev_err(dev, "failed to set sg list for user buffer %d\n", ret);
             goto free_buffer_struct;
         }
+        ret = get_sg_table_p2pdma_type(&sgt, &mapped_buffer->is_p2pdma);
+        if (ret < 0) {
+            dev_err(dev, "user buffer mixes host memory and peer device memory\n");
+            goto clear_sg_table;
+        }
+        // The dma api checks the pci topology between the device and the owner of p2pdma pages, and fails the
+        // mapping if peer to peer DMA isn't supported between them (rather than bouncing through host memory).
         sgt.nents = dma_map_sg(dev, sgt.sgl, sgt.orig_nents, direction);
         if (0 == sgt.nents) {
-            dev_err(dev, "failed to map sg list for user buffer\n");
-            ret = -ENXIO;
+            dev_err(dev, "failed to map sg list for user buffer%s\n",
+                mapped_buffer->is_p2pdma ? " (peer to peer DMA may not be supported between the devices)" : "");
+            ret = mapped_buffer->is_p2pdma ? -EREMOTEIO : -ENXIO;
             goto clear_sg_table;
         }
+        build_sg_index(mapped_buffer, &sgt);
+        mapped_buffer->needs_sync = !mapped_buffer->is_p2pdma && buffer_needs_sync(dev, &sgt);
+        mapped_buffer->is_pinned_user_memory = (NULL == low_mem_driver_allocated_buffer);
     }
 
     kref_init(&mapped_buffer->kref);
@@ -242,7 +601,7 @@ struct hailo_vdma_buffer *hailo_vdma_buffer_map(struct device *dev,
     return mapped_buffer;
 
 clear_sg_table:
-    clear_sg_table(&sgt);
+    clear_sg_table(&sgt, (NULL == low_mem_driver_allocated_buffer), direction);
 free_buffer_struct:
     kfree(mapped_buffer);
 cleanup:
@@ -261,8 +620,9 @@ static void unmap_buffer(struct kref *kref)
             dma_unmap_sg(buf->device, buf->sg_table.sgl, buf->sg_table.orig_nents, buf->data_direction);
         }
 
-        clear_sg_table(&buf->sg_table);
+        clear_sg_table(&buf->sg_table, buf->is_pinned_user_memory, buf->data_direction);
     }
+    kfree(buf->sg_index);
     kfree(buf);
 }
 
@@ -276,6 +636,39 @@ void hailo_vdma_buffer_put(struct hailo_vdma_buffer *buf)
     kref_put(&buf->kref, unmap_buffer);
 }
 
+// Buffers whose last reference was dropped from atomic context, unmapped by deferred_unmap_work.
+static LLIST_HEAD(deferred_unmap_buffers);
+
+static void deferred_unmap_work_func(struct work_struct *work)
+{
+    struct llist_node *buffers = llist_del_all(&deferred_unmap_buffers);
+    struct hailo_vdma_buffer *buf = NULL, *next = NULL;
+
+    llist_for_each_entry_safe(buf, next, buffers, deferred_unmap_node) {
+        unmap_buffer(&buf->kref);
+    }
+}
+
+static DECLARE_WORK(deferred_unmap_work, deferred_unmap_work_func);
+
+static void defer_unmap_buffer(struct kref *kref)
+{
+    struct hailo_vdma_buffer *buf = container_of(kref, struct hailo_vdma_buffer, kref);
+
+    llist_add(&buf->deferred_unmap_node, &deferred_unmap_buffers);
+    schedule_work(&deferred_unmap_work);
+}
+
+void hailo_vdma_buffer_put_deferred(struct hailo_vdma_buffer *buf)
+{
+    kref_put(&buf->kref, defer_unmap_buffer);
+}
+
+void hailo_vdma_buffer_flush_deferred_puts(void)
+{
+    flush_work(&deferred_unmap_work);
+}
+
 static void vdma_sync_entire_buffer(struct hailo_vdma_controller *controller,
     struct hailo_vdma_buffer *mapped_buffer, enum hailo_vdma_buffer_sync_type sync_type)
 {
@@ -288,30 +681,64 @@ static void vdma_sync_entire_buffer(struct hailo_vdma_controller *controller,
     }
 }
 
-typedef void (*dma_sync_single_callback)(struct device *, dma_addr_t, size_t, enum dma_data_direction);
-// Map sync_info->count bytes starting at sync_info->offset
+typedef void (*dma_sync_single_range_callback)(struct device *, dma_addr_t, unsigned long, size_t,
+    enum dma_data_direction);
+
+// Returns the first sg entry that may overlap the given offset, its number in the table and its dma offset in the
+// buffer.
+static struct scatterlist *seek_sg_entry(struct hailo_vdma_buffer *mapped_buffer, size_t offset,
+    unsigned int *sg_entry_number, size_t *sg_entry_offset)
+{
+    size_t low = 0, high = mapped_buffer->sg_index_count, mid = 0;
+
+    if (NULL == mapped_buffer->sg_index) {
+        *sg_entry_number = 0;
+        *sg_entry_offset = 0;
+        return mapped_buffer->sg_table.sgl;
+    }
+
+    // Find the last index entry starting at or before offset (the first entry always starts at 0).
+    while (high - low > 1) {
+        mid = low + (high - low) / 2;
+        if (mapped_buffer->sg_index[mid].offset <= offset) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    *sg_entry_number = (unsigned int)(low * HAILO_VDMA_SG_INDEX_STRIDE);
+    *sg_entry_offset = mapped_buffer->sg_index[low].offset;
+    return mapped_buffer->sg_index[low].sg_entry;
+}
+
+// Sync size bytes starting at offset. Only the bytes of the interval are synced, not the whole sg entries.
 static void vdma_sync_buffer_interval(struct hailo_vdma_controller *controller,
     struct hailo_vdma_buffer *mapped_buffer,
     size_t offset, size_t size, enum hailo_vdma_buffer_sync_type sync_type)
 {
-    size_t sync_start_offset = offset;
-    size_t sync_end_offset = offset + size;
-    dma_sync_single_callback dma_sync_single = (sync_type == HAILO_SYNC_FOR_CPU) ?
-        dma_sync_single_for_cpu :
-        dma_sync_single_for_device;
-    struct scatterlist* sg_entry = NULL;
+    const size_t sync_end_offset = offset + size;
+    dma_sync_single_range_callback dma_sync_single_range = (sync_type == HAILO_SYNC_FOR_CPU) ?
+        dma_sync_single_range_for_cpu :
+        dma_sync_single_range_for_device;
+    struct scatterlist *sg_entry = NULL;
+    unsigned int sg_entry_number = 0;
     size_t current_iter_offset = 0;
-    int i = 0;
-
-    for_each_sg(mapped_buffer->sg_table.sgl, sg_entry, mapped_buffer->sg_table.nents, i) {
-        // Check if the intervals: [current_iter_offset, sg_dma_len(sg_entry)] and [sync_start_offset, sync_end_offset]
-        // have any intersection. If offset isn't at the start of a sg_entry, we still want to sync it.
-        if (max(sync_start_offset, current_iter_offset) <= min(sync_end_offset, current_iter_offset + sg_dma_len(sg_entry))) {
-            dma_sync_single(controller->dev, sg_dma_address(sg_entry), sg_dma_len(sg_entry),
-                mapped_buffer->data_direction);
+    size_t sg_entry_end_offset = 0;
+    size_t start_in_entry = 0, end_in_entry = 0;
+
+    for (sg_entry = seek_sg_entry(mapped_buffer, offset, &sg_entry_number, &current_iter_offset);
+         (sg_entry_number < mapped_buffer->sg_table.nents) && (current_iter_offset < sync_end_offset);
+         sg_entry_number++, current_iter_offset = sg_entry_end_offset, sg_entry = sg_next(sg_entry)) {
+        sg_entry_end_offset = current_iter_offset + sg_dma_len(sg_entry);
+        if (sg_entry_end_offset <= offset) {
+            continue;
         }
 
-        current_iter_offset += sg_dma_len(sg_entry);
+        start_in_entry = max(offset, current_iter_offset) - current_iter_offset;
+        end_in_entry = min(sync_end_offset, sg_entry_end_offset) - current_iter_offset;
+        dma_sync_single_range(controller->dev, sg_dma_address(sg_entry), start_in_entry,
+            end_in_entry - start_in_entry, mapped_buffer->data_direction);
     }
 }
 
@@ -320,8 +747,12 @@ void hailo_vdma_buffer_sync(struct hailo_vdma_controller *controller,
     size_t offset, size_t size)
 {
     if ((IS_ENABLED(HAILO_SUPPORT_MMIO_DMA_MAPPING) && mapped_buffer->is_mmio) || 
-        (NULL != mapped_buffer->dmabuf_info.dmabuf)) {
-        // MMIO buffers and dmabufs don't need to be sync'd
+        (NULL != mapped_buffer->dmabuf_info.dmabuf) || mapped_buffer->is_p2pdma) {
+        // MMIO buffers, dmabufs and other devices memory don't need to be sync'd
+        return;
+    }
+
+    if (!mapped_buffer->needs_sync && !READ_ONCE(controller->force_dma_sync)) {
         return;
     }
 
@@ -346,177 +777,832 @@ void hailo_vdma_buffer_sync_cyclic(struct hailo_vdma_controller *controller,
     }
 }
 
+// Handles returned by hailo_get_next_vdma_handle are page aligned (so they can be passed as mmap offset). The tables
+// are indexed by the page number to keep them dense. Returns false for handles that can't belong to any table.
+static bool vdma_handle_to_index(uintptr_t handle, unsigned long *index)
+{
+    if (0 != (handle & ~PAGE_MASK)) {
+        return false;
+    }
+
+    *index = handle >> PAGE_SHIFT;
+    return true;
+}
+
+int hailo_vdma_add_mapped_user_buffer(struct hailo_vdma_file_context *context, struct hailo_vdma_buffer *buffer)
+{
+    return xa_insert(&context->mapped_user_buffers, buffer->handle, buffer, GFP_KERNEL);
+}
+
+void hailo_vdma_remove_mapped_user_buffer(struct hailo_vdma_file_context *context, struct hailo_vdma_buffer *buffer)
+{
+    xa_erase(&context->mapped_user_buffers, buffer->handle);
+}
+
 struct hailo_vdma_buffer* hailo_vdma_find_mapped_user_buffer(struct hailo_vdma_file_context *context,
     size_t buffer_handle)
 {
-    struct hailo_vdma_buffer *cur = NULL;
-    list_for_each_entry(cur, &context->mapped_user_buffer_list, mapped_user_buffer_list) {
-        if (cur->handle == buffer_handle) {
-            return cur;
-        }
-    }
-    return NULL;
+    return xa_load(&context->mapped_user_buffers, buffer_handle);
 }
 
 void hailo_vdma_clear_mapped_user_buffer_list(struct hailo_vdma_file_context *context,
     struct hailo_vdma_controller *controller)
 {
-    struct hailo_vdma_buffer *cur = NULL, *next = NULL;
-    list_for_each_entry_safe(cur, next, &context->mapped_user_buffer_list, mapped_user_buffer_list) {
-        list_del(&cur->mapped_user_buffer_list);
-        hailo_vdma_buffer_put(cur);
+    struct hailo_vdma_buffer *cur = NULL;
+    while (NULL != (cur = xa_first_entry_compat(&context->mapped_user_buffers))) {
+        hailo_vdma_remove_mapped_user_buffer(context, cur);
+        hailo_vdma_buffer_cache_release(cur);
     }
+    xa_destroy(&context->mapped_user_buffers);
 }
 
-
-int hailo_desc_list_create(struct device *dev, u32 descriptors_count, u16 desc_page_size,
-    uintptr_t desc_handle, bool is_circular, struct hailo_descriptors_list_buffer *descriptors)
+static unsigned int buffer_cache_max_entries = 64;
+module_param(buffer_cache_max_entries, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(buffer_cache_max_entries,
+    "Max unmapped user buffers kept pinned and mapped per open file for reuse (0 disables the cache)");
+
+#if defined(HAILO_SUPPORT_VDMA_BUFFER_CACHE)
+
+// Tracks a pinned user buffer from before it is pinned, so any change of the user mapping invalidates it.
+struct hailo_vdma_buffer_cache_entry {
+    struct mmu_interval_notifier    notifier;
+    struct hailo_vdma_buffer_cache  *cache;
+    struct hailo_vdma_buffer        *buffer;
+    // Entry in cache->lru or cache->invalidated (only while cached).
+    struct list_head                cache_list;
+    // Both protected by cache->lock
+    bool                            is_cached;
+    bool                            is_invalidated;
+    // Notifier sequence read before the buffer is pinned, checked once it is mapped.
+    unsigned long                   notifier_seq;
+};
+
+static bool buffer_cache_invalidate(struct mmu_interval_notifier *notifier, const struct mmu_notifier_range *range,
+    unsigned long cur_seq)
 {
-    size_t buffer_size = 0;
-    const u64 align = VDMA_DESCRIPTOR_LIST_ALIGN; //First addr must be aligned on 64 KB  (from the VDMA registers documentation)
-
-    if (MAX_POWER_OF_2_VALUE < descriptors_count) {
-        dev_err(dev, "Invalid descriptors count %u\n", descriptors_count);
-        return -EINVAL;
+    struct hailo_vdma_buffer_cache_entry *entry =
+        container_of(notifier, struct hailo_vdma_buffer_cache_entry, notifier);
+    struct hailo_vdma_buffer_cache *cache = entry->cache;
+
+    spin_lock(&cache->lock);
+    mmu_interval_set_seq(notifier, cur_seq);
+    if (!entry->is_invalidated) {
+        entry->is_invalidated = true;
+        atomic64_inc(&cache->stats->invalidations);
+
+        // The notifier can't be removed from its own callback, so the entry is released from a work.
+        if (entry->is_cached) {
+            list_move(&entry->cache_list, &cache->invalidated);
+            cache->count--;
+            schedule_work(&cache->release_work);
+        }
     }
+    spin_unlock(&cache->lock);
 
-    buffer_size = descriptors_count * sizeof(struct hailo_vdma_descriptor);
-    buffer_size = ALIGN(buffer_size, align);
+    return true;
+}
 
-    descriptors->kernel_address = dma_alloc_coherent(dev, buffer_size,
-        &descriptors->dma_address, GFP_KERNEL | __GFP_ZERO);
-    if (descriptors->kernel_address == NULL) {
-        dev_err(dev, "Failed to allocate descriptors list, desc_count 0x%x, buffer_size 0x%zx, This failure means there is not a sufficient amount of CMA memory "
-            "(contiguous physical memory), This usually is caused by lack of general system memory. Please check you have sufficient memory.\n",
-            descriptors_count, buffer_size);
-        return -ENOBUFS;
+static const struct mmu_interval_notifier_ops buffer_cache_notifier_ops = {
+    .invalidate = buffer_cache_invalidate,
+};
+
+static struct hailo_vdma_buffer_cache_entry *buffer_cache_track(struct hailo_vdma_buffer_cache *cache,
+    uintptr_t user_address, size_t size)
+{
+    int err = -EINVAL;
+    struct hailo_vdma_buffer_cache_entry *entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+    if (NULL == entry) {
+        return NULL;
     }
 
-    descriptors->buffer_size = buffer_size;
-    descriptors->handle = desc_handle;
+    entry->cache = cache;
+    INIT_LIST_HEAD(&entry->cache_list);
+    err = mmu_interval_notifier_insert(&entry->notifier, current->mm, user_address, size,
+        &buffer_cache_notifier_ops);
+    if (err < 0) {
+        pr_warn("Failed tracking user buffer for cache, err %d\n", err);
+        kfree(entry);
+        return NULL;
+    }
 
-    descriptors->desc_list.desc_list = descriptors->kernel_address;
-    descriptors->desc_list.desc_count = descriptors_count;
-    // No need to check the return value of get_nearest_powerof_2 because we already checked the input
-    descriptors->desc_list.desc_count_mask = is_circular ? (descriptors_count - 1) : (get_nearest_powerof_2(descriptors_count) - 1);
-    descriptors->desc_list.desc_page_size = desc_page_size;
-    descriptors->desc_list.is_circular = is_circular;
+    entry->notifier_seq = mmu_interval_read_begin(&entry->notifier);
+    return entry;
+}
 
-    return 0;
+static void buffer_cache_untrack(struct hailo_vdma_buffer_cache_entry *entry)
+{
+    // Waits for running invalidations, after that the entry isn't accessed by the notifier.
+    mmu_interval_notifier_remove(&entry->notifier);
+    kfree(entry);
 }
 
-void hailo_desc_list_release(struct device *dev, struct hailo_descriptors_list_buffer *descriptors)
+// Releases a buffer entry that is not cached.
+static void buffer_cache_release_entry(struct hailo_vdma_buffer_cache_entry *entry)
 {
-    dma_free_coherent(dev, descriptors->buffer_size, descriptors->kernel_address, descriptors->dma_address);
+    struct hailo_vdma_buffer *buffer = entry->buffer;
+
+    buffer->cache_entry = NULL;
+    buffer_cache_untrack(entry);
+    hailo_vdma_buffer_put(buffer);
 }
 
-struct hailo_descriptors_list_buffer* hailo_vdma_find_descriptors_buffer(struct hailo_vdma_file_context *context,
-    uintptr_t desc_handle)
+static void buffer_cache_release_work(struct work_struct *work)
 {
-    struct hailo_descriptors_list_buffer *cur = NULL;
-    list_for_each_entry(cur, &context->descriptors_buffer_list, descriptors_buffer_list) {
-        if (cur->handle == desc_handle) {
-            return cur;
-        }
+    struct hailo_vdma_buffer_cache *cache = container_of(work, struct hailo_vdma_buffer_cache, release_work);
+    struct hailo_vdma_buffer_cache_entry *cur = NULL, *next = NULL;
+    LIST_HEAD(to_release);
+
+    spin_lock(&cache->lock);
+    list_splice_init(&cache->invalidated, &to_release);
+    list_for_each_entry(cur, &to_release, cache_list) {
+        cur->is_cached = false;
+    }
+    spin_unlock(&cache->lock);
+
+    list_for_each_entry_safe(cur, next, &to_release, cache_list) {
+        list_del(&cur->cache_list);
+        buffer_cache_release_entry(cur);
     }
-    return NULL;
 }
 
-void hailo_vdma_clear_descriptors_buffer_list(struct hailo_vdma_file_context *context,
-    struct hailo_vdma_controller *controller)
+// Removes the buffer matching the given params from the cache. The cache reference moves to the caller.
+static struct hailo_vdma_buffer *buffer_cache_take(struct hailo_vdma_buffer_cache *cache, struct mm_struct *mm,
+    uintptr_t user_address, size_t size, enum dma_data_direction direction)
 {
-    struct hailo_descriptors_list_buffer *cur = NULL, *next = NULL;
-    list_for_each_entry_safe(cur, next, &context->descriptors_buffer_list, descriptors_buffer_list) {
-        list_del(&cur->descriptors_buffer_list);
-        hailo_desc_list_release(controller->dev, cur);
-        kfree(cur);
+    struct hailo_vdma_buffer_cache_entry *cur = NULL;
+    struct hailo_vdma_buffer *buffer = NULL;
+
+    spin_lock(&cache->lock);
+    list_for_each_entry(cur, &cache->lru, cache_list) {
+        if ((cur->notifier.mm == mm) && (cur->buffer->user_address == user_address) &&
+            (cur->buffer->size == size) && (cur->buffer->data_direction == direction)) {
+            list_del_init(&cur->cache_list);
+            cur->is_cached = false;
+            cache->count--;
+            buffer = cur->buffer;
+            break;
+        }
     }
+    spin_unlock(&cache->lock);
+
+    return buffer;
 }
 
-int hailo_vdma_low_memory_buffer_alloc(size_t size, struct hailo_vdma_low_memory_buffer *low_memory_buffer)
+void hailo_vdma_buffer_cache_init(struct hailo_vdma_buffer_cache *cache, struct hailo_vdma_buffer_cache_stats *stats,
+    struct hailo_dmabuf_cache *dmabuf_cache)
 {
-    int ret = -EINVAL;
-    void *kernel_address = NULL;
-    size_t pages_count = (size + PAGE_SIZE - 1) >> PAGE_SHIFT;
-    size_t num_allocated = 0, i = 0;
-    void **pages = NULL;
+    spin_lock_init(&cache->lock);
+    INIT_LIST_HEAD(&cache->lru);
+    cache->count = 0;
+    INIT_LIST_HEAD(&cache->invalidated);
+    INIT_WORK(&cache->release_work, buffer_cache_release_work);
+    cache->stats = stats;
+    cache->dmabuf_cache = dmabuf_cache;
+}
 
-    pages = kcalloc(pages_count, sizeof(*pages), GFP_KERNEL);
-    if (NULL == pages) {
-        pr_err("Failed to allocate pages for buffer (size %zu)\n", size);
-        ret = -ENOMEM;
-        goto cleanup;
+void hailo_vdma_buffer_cache_finalize(struct hailo_vdma_buffer_cache *cache)
+{
+    struct hailo_vdma_buffer_cache_entry *cur = NULL, *next = NULL;
+    LIST_HEAD(to_release);
+
+    spin_lock(&cache->lock);
+    list_splice_init(&cache->lru, &to_release);
+    list_for_each_entry(cur, &to_release, cache_list) {
+        cur->is_cached = false;
     }
+    cache->count = 0;
+    spin_unlock(&cache->lock);
 
-    for (num_allocated = 0; num_allocated < pages_count; num_allocated++) {
-        // __GFP_DMA32 flag is used to limit system memory allocations to the lowest 4 GB of physical memory in order to guarantee DMA 
-        // Operations will not have to use bounce buffers on certain architectures (e.g 32-bit DMA enabled architectures)
-        kernel_address = (void*)__get_free_page(__GFP_DMA32);
-        if (NULL == kernel_address) {
-            pr_err("Failed to allocate %zu coherent bytes\n", (size_t)PAGE_SIZE);
-            ret = -ENOMEM;
-            goto cleanup;
-        }
+    list_for_each_entry_safe(cur, next, &to_release, cache_list) {
+        list_del(&cur->cache_list);
+        buffer_cache_release_entry(cur);
+    }
+
+    // No entry is cached anymore, so the work won't be scheduled again.
+    flush_work(&cache->release_work);
+}
 
-        pages[num_allocated] = kernel_address;
+struct hailo_vdma_buffer *hailo_vdma_buffer_cache_map(struct hailo_vdma_buffer_cache *cache, struct device *dev,
+    uintptr_t user_address, size_t size, enum dma_data_direction direction, enum hailo_dma_buffer_type buffer_type,
+    struct hailo_vdma_low_memory_buffer *low_mem_driver_allocated_buffer)
+{
+    struct hailo_vdma_buffer *buffer = NULL;
+    struct hailo_vdma_buffer_cache_entry *entry = NULL;
+
+    // Only buffers pinned by the driver are cached.
+    if ((HAILO_DMA_USER_PTR_BUFFER != buffer_type) || (NULL != low_mem_driver_allocated_buffer) ||
+        (0 == size) || (0 == READ_ONCE(buffer_cache_max_entries))) {
+        return hailo_vdma_buffer_map(dev, cache->dmabuf_cache, user_address, size, direction, buffer_type,
+            low_mem_driver_allocated_buffer);
     }
 
-    low_memory_buffer->pages_count = pages_count;
-    low_memory_buffer->pages_address = pages;
+    buffer = buffer_cache_take(cache, current->mm, user_address, size, direction);
+    if (NULL != buffer) {
+        atomic64_inc(&cache->stats->hits);
+        // Same as the implicit sync done by dma_map_sg on a new mapping.
+        dma_sync_sgtable_for_device(dev, &buffer->sg_table, buffer->data_direction);
+        return buffer;
+    }
+    atomic64_inc(&cache->stats->misses);
 
-    return 0;
+    // On failure the buffer is just not cached.
+    entry = buffer_cache_track(cache, user_address, size);
 
-cleanup:
-    if (NULL != pages) {
-        for (i = 0; i < num_allocated; i++) {
-            free_page((long unsigned)pages[i]);
+    buffer = hailo_vdma_buffer_map(dev, cache->dmabuf_cache, user_address, size, direction, buffer_type, NULL);
+    if (IS_ERR(buffer) || buffer->is_mmio || (NULL != buffer->dmabuf_info.dmabuf)) {
+        if (NULL != entry) {
+            buffer_cache_untrack(entry);
         }
-
-        kfree(pages);
+        return buffer;
     }
 
-    return ret;
+    if (NULL != entry) {
+        // The user mapping may have changed while the buffer was pinned, so it is never cached.
+        spin_lock(&cache->lock);
+        if (mmu_interval_read_retry(&entry->notifier, entry->notifier_seq)) {
+            entry->is_invalidated = true;
+        }
+        spin_unlock(&cache->lock);
+
+        entry->buffer = buffer;
+        buffer->cache_entry = entry;
+    }
+    return buffer;
 }
 
-void hailo_vdma_low_memory_buffer_free(struct hailo_vdma_low_memory_buffer *low_memory_buffer)
+// Evicts the least recently used entries, until at most max_entries are cached. The limit may be lowered at
+// runtime, so more than one entry may be evicted.
+static void buffer_cache_evict(struct hailo_vdma_buffer_cache *cache, size_t max_entries)
 {
-    size_t i = 0;
-    if (NULL == low_memory_buffer) {
-        return;
+    struct hailo_vdma_buffer_cache_entry *cur = NULL, *next = NULL;
+    LIST_HEAD(evicted);
+
+    spin_lock(&cache->lock);
+    while (cache->count > max_entries) {
+        cur = list_last_entry(&cache->lru, struct hailo_vdma_buffer_cache_entry, cache_list);
+        list_move(&cur->cache_list, &evicted);
+        cur->is_cached = false;
+        cache->count--;
     }
+    spin_unlock(&cache->lock);
 
-    for (i = 0; i < low_memory_buffer->pages_count; i++) {
-        free_page((long unsigned)low_memory_buffer->pages_address[i]);
+    list_for_each_entry_safe(cur, next, &evicted, cache_list) {
+        list_del(&cur->cache_list);
+        atomic64_inc(&cache->stats->evictions);
+        buffer_cache_release_entry(cur);
     }
-
-    kfree(low_memory_buffer->pages_address);
 }
 
-struct hailo_vdma_low_memory_buffer* hailo_vdma_find_low_memory_buffer(struct hailo_vdma_file_context *context,
-    uintptr_t buf_handle)
+void hailo_vdma_buffer_cache_unmap(struct hailo_vdma_buffer_cache *cache, struct hailo_vdma_buffer *buffer)
 {
-    struct hailo_vdma_low_memory_buffer *cur = NULL;
-    list_for_each_entry(cur, &context->vdma_low_memory_buffer_list, vdma_low_memory_buffer_list) {
-        if (cur->handle == buf_handle) {
-            return cur;
+    struct hailo_vdma_buffer_cache_entry *entry = buffer->cache_entry;
+    const size_t max_entries = READ_ONCE(buffer_cache_max_entries);
+    bool is_cached = false;
+
+    if (NULL == entry) {
+        hailo_vdma_buffer_put(buffer);
+    } else {
+        spin_lock(&cache->lock);
+        if (!entry->is_invalidated && (0 != max_entries)) {
+            list_add(&entry->cache_list, &cache->lru);
+            entry->is_cached = true;
+            cache->count++;
+            is_cached = true;
+        }
+        spin_unlock(&cache->lock);
+
+        if (!is_cached) {
+            buffer_cache_release_entry(entry);
         }
     }
 
-    return NULL;
+    buffer_cache_evict(cache, max_entries);
 }
 
-void hailo_vdma_clear_low_memory_buffer_list(struct hailo_vdma_file_context *context)
+void hailo_vdma_buffer_cache_release(struct hailo_vdma_buffer *buffer)
 {
-    struct hailo_vdma_low_memory_buffer *cur = NULL, *next = NULL;
-    list_for_each_entry_safe(cur, next, &context->vdma_low_memory_buffer_list, vdma_low_memory_buffer_list) {
-        list_del(&cur->vdma_low_memory_buffer_list);
-        hailo_vdma_low_memory_buffer_free(cur);
-        kfree(cur);
+    if (NULL != buffer->cache_entry) {
+        buffer_cache_release_entry(buffer->cache_entry);
+    } else {
+        hailo_vdma_buffer_put(buffer);
     }
 }
 
-int hailo_vdma_continuous_buffer_alloc(struct device *dev, size_t size,
-    struct hailo_vdma_continuous_buffer *continuous_buffer)
+#else /* defined(HAILO_SUPPORT_VDMA_BUFFER_CACHE) */
+
+void hailo_vdma_buffer_cache_init(struct hailo_vdma_buffer_cache *cache, struct hailo_vdma_buffer_cache_stats *stats,
+    struct hailo_dmabuf_cache *dmabuf_cache)
+{
+    spin_lock_init(&cache->lock);
+    INIT_LIST_HEAD(&cache->lru);
+    cache->count = 0;
+    INIT_LIST_HEAD(&cache->invalidated);
+    cache->stats = stats;
+    cache->dmabuf_cache = dmabuf_cache;
+}
+
+void hailo_vdma_buffer_cache_finalize(struct hailo_vdma_buffer_cache *cache)
+{
+    (void)cache;
+}
+
+struct hailo_vdma_buffer *hailo_vdma_buffer_cache_map(struct hailo_vdma_buffer_cache *cache, struct device *dev,
+    uintptr_t user_address, size_t size, enum dma_data_direction direction, enum hailo_dma_buffer_type buffer_type,
+    struct hailo_vdma_low_memory_buffer *low_mem_driver_allocated_buffer)
+{
+    (void)cache;
+    return hailo_vdma_buffer_map(dev, cache->dmabuf_cache, user_address, size, direction, buffer_type,
+        low_mem_driver_allocated_buffer);
+}
+
+void hailo_vdma_buffer_cache_unmap(struct hailo_vdma_buffer_cache *cache, struct hailo_vdma_buffer *buffer)
+{
+    (void)cache;
+    hailo_vdma_buffer_put(buffer);
+}
+
+void hailo_vdma_buffer_cache_release(struct hailo_vdma_buffer *buffer)
+{
+    hailo_vdma_buffer_put(buffer);
+}
+
+#endif /* defined(HAILO_SUPPORT_VDMA_BUFFER_CACHE) */
+
+
+static unsigned int desc_list_pool_max_per_class = 4;
+module_param(desc_list_pool_max_per_class, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(desc_list_pool_max_per_class,
+    "Max released descriptors lists of each size class kept per device for reuse (0 disables the pool)");
+
+static unsigned int desc_list_pool_prealloc = 0;
+module_param(desc_list_pool_prealloc, uint, S_IRUGO);
+MODULE_PARM_DESC(desc_list_pool_prealloc,
+    "Descriptors lists of each size class allocated to the pool when the device is probed");
+
+#define DESC_LIST_POOL_MAX_SIZE (VDMA_DESCRIPTOR_LIST_ALIGN << (HAILO_DESC_LIST_POOL_CLASSES_COUNT - 1))
+
+struct hailo_desc_list_pool_entry {
+    struct list_head    list;
+    void                *kernel_address;
+    dma_addr_t          dma_address;
+};
+
+// Returns the size class of the given buffer size, or -1 if buffers of this size are not pooled.
+static int desc_list_pool_class(size_t buffer_size)
+{
+    const size_t units = buffer_size / VDMA_DESCRIPTOR_LIST_ALIGN;
+
+    if ((0 == buffer_size) || (buffer_size > DESC_LIST_POOL_MAX_SIZE) ||
+        (0 != (buffer_size % VDMA_DESCRIPTOR_LIST_ALIGN)) || !is_power_of_2(units)) {
+        return -1;
+    }
+
+    return ilog2(units);
+}
+
+static size_t desc_list_pool_class_size(int class)
+{
+    return (size_t)VDMA_DESCRIPTOR_LIST_ALIGN << class;
+}
+
+static struct hailo_desc_list_pool_entry *desc_list_pool_take(struct hailo_desc_list_pool *pool, int class)
+{
+    struct hailo_desc_list_pool_entry *entry = NULL;
+
+    spin_lock(&pool->lock);
+    entry = list_first_entry_or_null(&pool->free_lists[class], struct hailo_desc_list_pool_entry, list);
+    if (NULL != entry) {
+        list_del(&entry->list);
+        pool->free_count[class]--;
+        atomic64_sub(desc_list_pool_class_size(class), &pool->stats.cached_bytes);
+    }
+    spin_unlock(&pool->lock);
+
+    return entry;
+}
+
+// Returns false if the buffer wasn't added to the pool (and should be freed by the caller).
+static bool desc_list_pool_put(struct hailo_desc_list_pool *pool, int class, void *kernel_address,
+    dma_addr_t dma_address)
+{
+    struct hailo_desc_list_pool_entry *entry = NULL;
+    const size_t max_per_class = READ_ONCE(desc_list_pool_max_per_class);
+
+    if (0 == max_per_class) {
+        return false;
+    }
+
+    entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+    if (NULL == entry) {
+        return false;
+    }
+    entry->kernel_address = kernel_address;
+    entry->dma_address = dma_address;
+
+    spin_lock(&pool->lock);
+    if (pool->is_finalized || (pool->free_count[class] >= max_per_class)) {
+        spin_unlock(&pool->lock);
+        kfree(entry);
+        return false;
+    }
+    list_add(&entry->list, &pool->free_lists[class]);
+    pool->free_count[class]++;
+    atomic64_add(desc_list_pool_class_size(class), &pool->stats.cached_bytes);
+    spin_unlock(&pool->lock);
+
+    return true;
+}
+
+void hailo_desc_list_pool_init(struct hailo_desc_list_pool *pool, struct device *dev)
+{
+    const unsigned int prealloc = min(READ_ONCE(desc_list_pool_prealloc), READ_ONCE(desc_list_pool_max_per_class));
+    void *kernel_address = NULL;
+    dma_addr_t dma_address = 0;
+    unsigned int i = 0;
+    int class = 0;
+
+    BUILD_BUG_ON_MSG(DESC_LIST_POOL_MAX_SIZE != (MAX_SG_DESCS_COUNT * sizeof(struct hailo_vdma_descriptor)),
+        "The largest descriptors list pool class must fit MAX_SG_DESCS_COUNT descriptors");
+
+    spin_lock_init(&pool->lock);
+    for (class = 0; class < HAILO_DESC_LIST_POOL_CLASSES_COUNT; class++) {
+        INIT_LIST_HEAD(&pool->free_lists[class]);
+        pool->free_count[class] = 0;
+    }
+    pool->is_finalized = false;
+    atomic64_set(&pool->stats.hits, 0);
+    atomic64_set(&pool->stats.misses, 0);
+    atomic64_set(&pool->stats.recycled, 0);
+    atomic64_set(&pool->stats.freed, 0);
+    atomic64_set(&pool->stats.cached_bytes, 0);
+
+    // Best effort, lists missing from the pool are allocated when created.
+    for (class = 0; class < HAILO_DESC_LIST_POOL_CLASSES_COUNT; class++) {
+        for (i = 0; i < prealloc; i++) {
+            kernel_address = dma_alloc_coherent(dev, desc_list_pool_class_size(class), &dma_address, GFP_KERNEL);
+            if (NULL == kernel_address) {
+                dev_notice(dev, "Failed preallocating descriptors lists of size 0x%zx\n",
+                    desc_list_pool_class_size(class));
+                break;
+            }
+
+            if (!desc_list_pool_put(pool, class, kernel_address, dma_address)) {
+                dma_free_coherent(dev, desc_list_pool_class_size(class), kernel_address, dma_address);
+                break;
+            }
+        }
+    }
+}
+
+void hailo_desc_list_pool_finalize(struct hailo_desc_list_pool *pool, struct device *dev)
+{
+    struct hailo_desc_list_pool_entry *cur = NULL, *next = NULL;
+    LIST_HEAD(to_free);
+    int class = 0;
+
+    for (class = 0; class < HAILO_DESC_LIST_POOL_CLASSES_COUNT; class++) {
+        spin_lock(&pool->lock);
+        pool->is_finalized = true;
+        list_splice_init(&pool->free_lists[class], &to_free);
+        pool->free_count[class] = 0;
+        spin_unlock(&pool->lock);
+
+        list_for_each_entry_safe(cur, next, &to_free, list) {
+            list_del(&cur->list);
+            dma_free_coherent(dev, desc_list_pool_class_size(class), cur->kernel_address, cur->dma_address);
+            kfree(cur);
+        }
+    }
+    atomic64_set(&pool->stats.cached_bytes, 0);
+}
+
+static int desc_list_buffer_alloc(struct device *dev, struct hailo_desc_list_pool *pool, size_t buffer_size,
+    struct hailo_descriptors_list_buffer *descriptors)
+{
+    struct hailo_desc_list_pool_entry *entry = NULL;
+    int class = -1;
+
+    if ((NULL != pool) && (0 != buffer_size) && (buffer_size <= DESC_LIST_POOL_MAX_SIZE)) {
+        class = desc_list_pool_class(roundup_pow_of_two(buffer_size));
+    }
+
+    if (class >= 0) {
+        // Allocated in the class size (even if not taken from the pool), so it can be pooled when released.
+        buffer_size = desc_list_pool_class_size(class);
+        entry = desc_list_pool_take(pool, class);
+        if (NULL != entry) {
+            atomic64_inc(&pool->stats.hits);
+            memset(entry->kernel_address, 0, buffer_size);
+            descriptors->kernel_address = entry->kernel_address;
+            descriptors->dma_address = entry->dma_address;
+            descriptors->buffer_size = buffer_size;
+            kfree(entry);
+            return 0;
+        }
+        atomic64_inc(&pool->stats.misses);
+    }
+
+    descriptors->kernel_address = dma_alloc_coherent(dev, buffer_size,
+        &descriptors->dma_address, GFP_KERNEL | __GFP_ZERO);
+    if (NULL == descriptors->kernel_address) {
+        return -ENOBUFS;
+    }
+
+    descriptors->buffer_size = buffer_size;
+    return 0;
+}
+
+int hailo_desc_list_create(struct device *dev, struct hailo_desc_list_pool *pool, u32 descriptors_count,
+    u16 desc_page_size, uintptr_t desc_handle, bool is_circular, struct hailo_descriptors_list_buffer *descriptors)
+{
+    size_t buffer_size = 0;
+    const u64 align = VDMA_DESCRIPTOR_LIST_ALIGN; //First addr must be aligned on 64 KB  (from the VDMA registers documentation)
+
+    if (MAX_POWER_OF_2_VALUE < descriptors_count) {
+        dev_err(dev, "Invalid descriptors count %u\n", descriptors_count);
+        return -EINVAL;
+    }
+
+    buffer_size = descriptors_count * sizeof(struct hailo_vdma_descriptor);
+    buffer_size = ALIGN(buffer_size, align);
+
+    if (desc_list_buffer_alloc(dev, pool, buffer_size, descriptors) < 0) {
+        dev_err(dev, "Failed to allocate descriptors list, desc_count 0x%x, buffer_size 0x%zx, This failure means there is not a sufficient amount of CMA memory "
+            "(contiguous physical memory), This usually is caused by lack of general system memory. Please check you have sufficient memory.\n",
+            descriptors_count, buffer_size);
+        return -ENOBUFS;
+    }
+
+    kref_init(&descriptors->kref);
+    descriptors->dev = dev;
+    descriptors->pool = pool;
+    descriptors->handle = desc_handle;
+
+    descriptors->desc_list.desc_list = descriptors->kernel_address;
+    descriptors->desc_list.desc_count = descriptors_count;
+    // No need to check the return value of get_nearest_powerof_2 because we already checked the input
+    descriptors->desc_list.desc_count_mask = is_circular ? (descriptors_count - 1) : (get_nearest_powerof_2(descriptors_count) - 1);
+    descriptors->desc_list.desc_page_size = desc_page_size;
+    descriptors->desc_list.is_circular = is_circular;
+
+    return 0;
+}
+
+void hailo_desc_list_release(struct device *dev, struct hailo_desc_list_pool *pool,
+    struct hailo_descriptors_list_buffer *descriptors)
+{
+    const int class = (NULL != pool) ? desc_list_pool_class(descriptors->buffer_size) : -1;
+
+    if (class >= 0) {
+        if (desc_list_pool_put(pool, class, descriptors->kernel_address, descriptors->dma_address)) {
+            atomic64_inc(&pool->stats.recycled);
+            return;
+        }
+        atomic64_inc(&pool->stats.freed);
+    }
+
+    dma_free_coherent(dev, descriptors->buffer_size, descriptors->kernel_address, descriptors->dma_address);
+}
+
+int hailo_vdma_add_descriptors_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_descriptors_list_buffer *descriptors)
+{
+    unsigned long index = 0;
+    if (!vdma_handle_to_index(descriptors->handle, &index)) {
+        return -EINVAL;
+    }
+    return xa_insert(&context->descriptors_buffers, index, descriptors, GFP_KERNEL);
+}
+
+void hailo_vdma_remove_descriptors_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_descriptors_list_buffer *descriptors)
+{
+    xa_erase(&context->descriptors_buffers, descriptors->handle >> PAGE_SHIFT);
+}
+
+struct hailo_descriptors_list_buffer* hailo_vdma_find_descriptors_buffer(struct hailo_vdma_file_context *context,
+    uintptr_t desc_handle)
+{
+    unsigned long index = 0;
+    if (!vdma_handle_to_index(desc_handle, &index)) {
+        return NULL;
+    }
+    return xa_load(&context->descriptors_buffers, index);
+}
+
+void hailo_vdma_descriptors_buffer_get(struct hailo_descriptors_list_buffer *descriptors)
+{
+    kref_get(&descriptors->kref);
+}
+
+static void descriptors_buffer_release(struct kref *kref)
+{
+    struct hailo_descriptors_list_buffer *descriptors =
+        container_of(kref, struct hailo_descriptors_list_buffer, kref);
+    hailo_desc_list_release(descriptors->dev, descriptors->pool, descriptors);
+    kfree(descriptors);
+}
+
+void hailo_vdma_descriptors_buffer_put(struct hailo_descriptors_list_buffer *descriptors)
+{
+    kref_put(&descriptors->kref, descriptors_buffer_release);
+}
+
+void hailo_vdma_clear_descriptors_buffer_list(struct hailo_vdma_file_context *context)
+{
+    struct hailo_descriptors_list_buffer *cur = NULL;
+    while (NULL != (cur = xa_first_entry_compat(&context->descriptors_buffers))) {
+        hailo_vdma_remove_descriptors_buffer(context, cur);
+        hailo_vdma_descriptors_buffer_put(cur);
+    }
+    xa_destroy(&context->descriptors_buffers);
+}
+
+static void free_low_memory_chunk(struct hailo_vdma_low_memory_chunk *chunk)
+{
+    size_t i = 0;
+    for (i = 0; i < (1UL << chunk->order); i++) {
+        __free_page(chunk->first_page + i);
+    }
+}
+
+// Allocates the buffer in chunks of up to max_order, falling back to smaller orders when an order fails.
+static int low_memory_buffer_alloc(size_t size, unsigned int max_order,
+    struct hailo_vdma_low_memory_buffer *low_memory_buffer)
+{
+    int ret = -EINVAL;
+    struct page *page = NULL;
+    size_t pages_count = (size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    size_t num_allocated = 0, chunks_count = 0, i = 0;
+    struct hailo_vdma_low_memory_chunk *chunks = NULL;
+    unsigned int order = max_order;
+    // __GFP_DMA32 flag is used to limit system memory allocations to the lowest 4 GB of physical memory in order to guarantee DMA
+    // Operations will not have to use bounce buffers on certain architectures (e.g 32-bit DMA enabled architectures)
+    const gfp_t gfp = GFP_KERNEL | __GFP_DMA32;
+
+    // Worst case, every chunk is a single page.
+    chunks = kvmalloc_array(pages_count, sizeof(*chunks), GFP_KERNEL);
+    if (NULL == chunks) {
+        pr_err("Failed to allocate pages for buffer (size %zu)\n", size);
+        ret = -ENOMEM;
+        goto cleanup;
+    }
+
+    while (num_allocated < pages_count) {
+        // Try the largest chunk first. Once an order fails, larger orders are not tried again for this buffer.
+        order = min_t(unsigned int, order, ilog2(pages_count - num_allocated));
+        for (;;) {
+            page = alloc_pages((0 == order) ? gfp : (gfp | __GFP_NOWARN | __GFP_NORETRY), order);
+            if ((NULL != page) || (0 == order)) {
+                break;
+            }
+            order--;
+        }
+
+        if (NULL == page) {
+            pr_err("Failed to allocate low memory buffer (size %zu), order %u failed after %zu/%zu pages\n",
+                size, order, num_allocated, pages_count);
+            ret = -ENOMEM;
+            goto cleanup;
+        }
+
+        // Each page is referenced separately when the buffer is mapped.
+        if (order > 0) {
+            split_page(page, order);
+        }
+
+        chunks[chunks_count].first_page = page;
+        chunks[chunks_count].order = order;
+        chunks_count++;
+        num_allocated += (1UL << order);
+    }
+
+    kref_init(&low_memory_buffer->kref);
+    low_memory_buffer->pages_count = pages_count;
+    low_memory_buffer->chunks = chunks;
+    low_memory_buffer->chunks_count = chunks_count;
+
+    return 0;
+
+cleanup:
+    if (NULL != chunks) {
+        for (i = 0; i < chunks_count; i++) {
+            free_low_memory_chunk(&chunks[i]);
+        }
+
+        kvfree(chunks);
+    }
+
+    return ret;
+}
+
+int hailo_vdma_low_memory_buffer_alloc(size_t size, struct hailo_vdma_low_memory_buffer *low_memory_buffer)
+{
+    return low_memory_buffer_alloc(size, HAILO_LOW_MEMORY_MAX_CHUNK_ORDER, low_memory_buffer);
+}
+
+void hailo_vdma_low_memory_buffer_free(struct hailo_vdma_low_memory_buffer *low_memory_buffer)
+{
+    struct hailo_vdma_low_memory_chunk *chunk = NULL;
+    size_t chunk_index = 0;
+    if (NULL == low_memory_buffer) {
+        return;
+    }
+
+    for_each_low_memory_chunk(low_memory_buffer, chunk, chunk_index) {
+        free_low_memory_chunk(chunk);
+    }
+
+    kvfree(low_memory_buffer->chunks);
+}
+
+static void low_memory_buffer_release(struct kref *kref)
+{
+    struct hailo_vdma_low_memory_buffer *low_memory_buffer =
+        container_of(kref, struct hailo_vdma_low_memory_buffer, kref);
+
+    hailo_vdma_low_memory_buffer_free(low_memory_buffer);
+    kfree(low_memory_buffer);
+}
+
+void hailo_vdma_low_memory_buffer_put(struct hailo_vdma_low_memory_buffer *low_memory_buffer)
+{
+    kref_put(&low_memory_buffer->kref, low_memory_buffer_release);
+}
+
+int hailo_vdma_low_memory_buffer_insert_pages(struct hailo_vdma_low_memory_buffer *low_memory_buffer,
+    struct vm_area_struct *vma)
+{
+    int err = 0;
+    unsigned long address = vma->vm_start;
+    struct hailo_vdma_low_memory_chunk *chunk = NULL;
+    size_t chunk_index = 0;
+    struct page **pages = NULL;
+    size_t i = 0;
+
+    pages = kmalloc_array(1UL << HAILO_LOW_MEMORY_MAX_CHUNK_ORDER, sizeof(*pages), GFP_KERNEL);
+    if (NULL == pages) {
+        return -ENOMEM;
+    }
+
+    // The pages are inserted (rather than remapped as pfns), so the mapping holds a reference to them, and they stay
+    // valid until unmapped (even partially) even if the buffer is freed before. The mapping is not inherited on
+    // fork and can't be expanded beyond the buffer.
+    vm_flags_set_compat(vma, VM_DONTCOPY | VM_DONTEXPAND);
+    for_each_low_memory_chunk(low_memory_buffer, chunk, chunk_index) {
+        for (i = 0; i < (1UL << chunk->order); i++) {
+            pages[i] = chunk->first_page + i;
+        }
+
+        err = vm_insert_pages_compat(vma, address, pages, 1UL << chunk->order);
+        if (err < 0) {
+            break;
+        }
+        address += PAGE_SIZE << chunk->order;
+    }
+
+    kfree(pages);
+    return err;
+}
+
+int hailo_vdma_add_low_memory_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_low_memory_buffer *low_memory_buffer)
+{
+    unsigned long index = 0;
+    if (!vdma_handle_to_index(low_memory_buffer->handle, &index)) {
+        return -EINVAL;
+    }
+    return xa_insert(&context->vdma_low_memory_buffers, index, low_memory_buffer, GFP_KERNEL);
+}
+
+void hailo_vdma_remove_low_memory_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_low_memory_buffer *low_memory_buffer)
+{
+    xa_erase(&context->vdma_low_memory_buffers, low_memory_buffer->handle >> PAGE_SHIFT);
+}
+
+struct hailo_vdma_low_memory_buffer* hailo_vdma_find_low_memory_buffer(struct hailo_vdma_file_context *context,
+    uintptr_t buf_handle)
+{
+    unsigned long index = 0;
+    if (!vdma_handle_to_index(buf_handle, &index)) {
+        return NULL;
+    }
+    return xa_load(&context->vdma_low_memory_buffers, index);
+}
+
+void hailo_vdma_clear_low_memory_buffer_list(struct hailo_vdma_file_context *context)
+{
+    struct hailo_vdma_low_memory_buffer *cur = NULL;
+    while (NULL != (cur = xa_first_entry_compat(&context->vdma_low_memory_buffers))) {
+        hailo_vdma_remove_low_memory_buffer(context, cur);
+        hailo_vdma_low_memory_buffer_put(cur);
+    }
+    xa_destroy(&context->vdma_low_memory_buffers);
+}
+
+int hailo_vdma_continuous_buffer_alloc(struct device *dev, size_t size,
+    struct hailo_vdma_continuous_buffer *continuous_buffer)
 {
     dma_addr_t dma_address = 0;
     void *kernel_address = NULL;
@@ -528,6 +1614,8 @@ int hailo_vdma_continuous_buffer_alloc(struct device *dev, size_t size,
         return -ENOBUFS;
     }
 
+    kref_init(&continuous_buffer->kref);
+    continuous_buffer->dev = dev;
     continuous_buffer->kernel_address = kernel_address;
     continuous_buffer->dma_address = dma_address;
     continuous_buffer->size = size;
@@ -541,30 +1629,336 @@ void hailo_vdma_continuous_buffer_free(struct device *dev,
         continuous_buffer->dma_address);
 }
 
+static void continuous_buffer_release(struct kref *kref)
+{
+    struct hailo_vdma_continuous_buffer *continuous_buffer =
+        container_of(kref, struct hailo_vdma_continuous_buffer, kref);
+
+    hailo_vdma_continuous_buffer_free(continuous_buffer->dev, continuous_buffer);
+    kfree(continuous_buffer);
+}
+
+void hailo_vdma_continuous_buffer_put(struct hailo_vdma_continuous_buffer *continuous_buffer)
+{
+    kref_put(&continuous_buffer->kref, continuous_buffer_release);
+}
+
+int hailo_vdma_add_continuous_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_continuous_buffer *continuous_buffer)
+{
+    unsigned long index = 0;
+    if (!vdma_handle_to_index(continuous_buffer->handle, &index)) {
+        return -EINVAL;
+    }
+    return xa_insert(&context->continuous_buffers, index, continuous_buffer, GFP_KERNEL);
+}
+
+void hailo_vdma_remove_continuous_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_continuous_buffer *continuous_buffer)
+{
+    xa_erase(&context->continuous_buffers, continuous_buffer->handle >> PAGE_SHIFT);
+}
+
 struct hailo_vdma_continuous_buffer* hailo_vdma_find_continuous_buffer(struct hailo_vdma_file_context *context,
     uintptr_t buf_handle)
+{
+    unsigned long index = 0;
+    if (!vdma_handle_to_index(buf_handle, &index)) {
+        return NULL;
+    }
+    return xa_load(&context->continuous_buffers, index);
+}
+
+void hailo_vdma_clear_continuous_buffer_list(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller)
 {
     struct hailo_vdma_continuous_buffer *cur = NULL;
-    list_for_each_entry(cur, &context->continuous_buffer_list, continuous_buffer_list) {
-        if (cur->handle == buf_handle) {
-            return cur;
+    while (NULL != (cur = xa_first_entry_compat(&context->continuous_buffers))) {
+        hailo_vdma_remove_continuous_buffer(context, cur);
+        hailo_vdma_continuous_buffer_put(cur);
+    }
+    xa_destroy(&context->continuous_buffers);
+}
+
+#if defined(HAILO_SUPPORT_DMABUF_EXPORT)
+
+// Driver allocated buffer exported as a dmabuf.
+struct hailo_dmabuf_exporter {
+    // Exactly one of the buffers is set, the exporter holds a reference to it (and to the device of a continuous
+    // buffer), so it stays valid after its file frees it.
+    struct hailo_vdma_low_memory_buffer *low_memory_buffer;
+    struct hailo_vdma_continuous_buffer *continuous_buffer;
+    // Protects attachments.
+    struct mutex lock;
+    struct list_head attachments;
+};
+
+struct hailo_dmabuf_exporter_attachment {
+    struct list_head list;
+    struct device *dev;
+    // The buffer pages, built on attach with segments the importing device can handle.
+    struct sg_table sgt;
+    // The direction the sg table is mapped with, DMA_NONE if it is not mapped.
+    enum dma_data_direction direction;
+};
+
+static int low_memory_buffer_get_sgtable(struct device *dev, struct sg_table *sgt,
+    struct hailo_vdma_low_memory_buffer *low_memory_buffer)
+{
+    const size_t max_segment_size = max_t(size_t, PAGE_SIZE, dma_get_max_seg_size(dev) & PAGE_MASK);
+    struct hailo_vdma_low_memory_chunk *chunk = NULL;
+    size_t chunk_index = 0;
+    struct scatterlist *sg_entry = NULL;
+    unsigned int nents = 0;
+    size_t offset = 0, length = 0;
+    int err = 0;
+
+    // Each chunk is physically contiguous, so it is a single entry unless it is larger than the max segment size.
+    for_each_low_memory_chunk(low_memory_buffer, chunk, chunk_index) {
+        nents += DIV_ROUND_UP(PAGE_SIZE << chunk->order, max_segment_size);
+    }
+
+    err = sg_alloc_table(sgt, nents, GFP_KERNEL);
+    if (err < 0) {
+        return err;
+    }
+
+    sg_entry = sgt->sgl;
+    for_each_low_memory_chunk(low_memory_buffer, chunk, chunk_index) {
+        for (offset = 0; offset < (PAGE_SIZE << chunk->order); offset += length) {
+            length = min_t(size_t, (PAGE_SIZE << chunk->order) - offset, max_segment_size);
+            sg_set_page(sg_entry, chunk->first_page + (offset >> PAGE_SHIFT), length, 0);
+            sg_entry = sg_next(sg_entry);
         }
     }
 
-    return NULL;
+    return 0;
 }
 
-void hailo_vdma_clear_continuous_buffer_list(struct hailo_vdma_file_context *context,
-    struct hailo_vdma_controller *controller)
+static int hailo_dmabuf_attach(struct dma_buf *dmabuf, struct dma_buf_attachment *attachment)
+{
+    struct hailo_dmabuf_exporter *exporter = dmabuf->priv;
+    struct hailo_vdma_continuous_buffer *continuous_buffer = exporter->continuous_buffer;
+    struct hailo_dmabuf_exporter_attachment *exporter_attachment = NULL;
+    int err = 0;
+
+    exporter_attachment = kzalloc(sizeof(*exporter_attachment), GFP_KERNEL);
+    if (NULL == exporter_attachment) {
+        return -ENOMEM;
+    }
+
+    if (NULL != exporter->low_memory_buffer) {
+        err = low_memory_buffer_get_sgtable(attachment->dev, &exporter_attachment->sgt, exporter->low_memory_buffer);
+    } else {
+        // Coherent memory pages can only be described by the device that allocated it.
+        err = dma_get_sgtable(continuous_buffer->dev, &exporter_attachment->sgt, continuous_buffer->kernel_address,
+            continuous_buffer->dma_address, continuous_buffer->size);
+    }
+    if (err < 0) {
+        dev_err(attachment->dev, "Failed creating sg table for exported buffer, err %d\n", err);
+        kfree(exporter_attachment);
+        return err;
+    }
+
+    exporter_attachment->dev = attachment->dev;
+    exporter_attachment->direction = DMA_NONE;
+    attachment->priv = exporter_attachment;
+
+    mutex_lock(&exporter->lock);
+    list_add_tail(&exporter_attachment->list, &exporter->attachments);
+    mutex_unlock(&exporter->lock);
+    return 0;
+}
+
+static void hailo_dmabuf_detach(struct dma_buf *dmabuf, struct dma_buf_attachment *attachment)
+{
+    struct hailo_dmabuf_exporter *exporter = dmabuf->priv;
+    struct hailo_dmabuf_exporter_attachment *exporter_attachment = attachment->priv;
+
+    mutex_lock(&exporter->lock);
+    list_del(&exporter_attachment->list);
+    mutex_unlock(&exporter->lock);
+
+    sg_free_table(&exporter_attachment->sgt);
+    kfree(exporter_attachment);
+}
+
+static struct sg_table *hailo_dmabuf_map(struct dma_buf_attachment *attachment, enum dma_data_direction direction)
+{
+    struct hailo_dmabuf_exporter *exporter = attachment->dmabuf->priv;
+    struct hailo_dmabuf_exporter_attachment *exporter_attachment = attachment->priv;
+    int err = 0;
+
+    mutex_lock(&exporter->lock);
+    if (DMA_NONE != exporter_attachment->direction) {
+        mutex_unlock(&exporter->lock);
+        return ERR_PTR(-EBUSY);
+    }
+
+    err = dma_map_sgtable(attachment->dev, &exporter_attachment->sgt, direction, 0);
+    if (err < 0) {
+        mutex_unlock(&exporter->lock);
+        return ERR_PTR(err);
+    }
+
+    exporter_attachment->direction = direction;
+    mutex_unlock(&exporter->lock);
+    return &exporter_attachment->sgt;
+}
+
+static void hailo_dmabuf_unmap(struct dma_buf_attachment *attachment, struct sg_table *sgt,
+    enum dma_data_direction direction)
+{
+    struct hailo_dmabuf_exporter *exporter = attachment->dmabuf->priv;
+    struct hailo_dmabuf_exporter_attachment *exporter_attachment = attachment->priv;
+
+    mutex_lock(&exporter->lock);
+    dma_unmap_sgtable(attachment->dev, sgt, direction, 0);
+    exporter_attachment->direction = DMA_NONE;
+    mutex_unlock(&exporter->lock);
+}
+
+// CPU access (through the dmabuf mmap) is synchronized with the mapping of every importing device.
+static int hailo_dmabuf_begin_cpu_access(struct dma_buf *dmabuf, enum dma_data_direction direction)
+{
+    struct hailo_dmabuf_exporter *exporter = dmabuf->priv;
+    struct hailo_dmabuf_exporter_attachment *exporter_attachment = NULL;
+
+    mutex_lock(&exporter->lock);
+    list_for_each_entry(exporter_attachment, &exporter->attachments, list) {
+        if (DMA_NONE != exporter_attachment->direction) {
+            dma_sync_sgtable_for_cpu(exporter_attachment->dev, &exporter_attachment->sgt,
+                exporter_attachment->direction);
+        }
+    }
+    mutex_unlock(&exporter->lock);
+    return 0;
+}
+
+static int hailo_dmabuf_end_cpu_access(struct dma_buf *dmabuf, enum dma_data_direction direction)
+{
+    struct hailo_dmabuf_exporter *exporter = dmabuf->priv;
+    struct hailo_dmabuf_exporter_attachment *exporter_attachment = NULL;
+
+    mutex_lock(&exporter->lock);
+    list_for_each_entry(exporter_attachment, &exporter->attachments, list) {
+        if (DMA_NONE != exporter_attachment->direction) {
+            dma_sync_sgtable_for_device(exporter_attachment->dev, &exporter_attachment->sgt,
+                exporter_attachment->direction);
+        }
+    }
+    mutex_unlock(&exporter->lock);
+    return 0;
+}
+
+static int hailo_dmabuf_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
 {
-    struct hailo_vdma_continuous_buffer *cur = NULL, *next = NULL;
-    list_for_each_entry_safe(cur, next, &context->continuous_buffer_list, continuous_buffer_list) {
-        list_del(&cur->continuous_buffer_list);
-        hailo_vdma_continuous_buffer_free(controller->dev, cur);
-        kfree(cur);
+    struct hailo_dmabuf_exporter *exporter = dmabuf->priv;
+    struct hailo_vdma_continuous_buffer *continuous_buffer = exporter->continuous_buffer;
+
+    if (NULL != exporter->low_memory_buffer) {
+        if ((0 != vma->vm_pgoff) || ((vma->vm_end - vma->vm_start) != dmabuf->size)) {
+            return -EINVAL;
+        }
+        return hailo_vdma_low_memory_buffer_insert_pages(exporter->low_memory_buffer, vma);
+    }
+
+    return dma_mmap_coherent(continuous_buffer->dev, vma, continuous_buffer->kernel_address,
+        continuous_buffer->dma_address, continuous_buffer->size);
+}
+
+static void dmabuf_exporter_free(struct hailo_dmabuf_exporter *exporter)
+{
+    struct device *dev = NULL;
+
+    if (NULL != exporter->low_memory_buffer) {
+        hailo_vdma_low_memory_buffer_put(exporter->low_memory_buffer);
+    } else {
+        dev = exporter->continuous_buffer->dev;
+        hailo_vdma_continuous_buffer_put(exporter->continuous_buffer);
+        put_device(dev);
     }
+
+    mutex_destroy(&exporter->lock);
+    kfree(exporter);
 }
 
+static void hailo_dmabuf_release(struct dma_buf *dmabuf)
+{
+    dmabuf_exporter_free(dmabuf->priv);
+}
+
+static const struct dma_buf_ops hailo_dmabuf_ops = {
+    .attach = hailo_dmabuf_attach,
+    .detach = hailo_dmabuf_detach,
+    .map_dma_buf = hailo_dmabuf_map,
+    .unmap_dma_buf = hailo_dmabuf_unmap,
+    .begin_cpu_access = hailo_dmabuf_begin_cpu_access,
+    .end_cpu_access = hailo_dmabuf_end_cpu_access,
+    .mmap = hailo_dmabuf_mmap,
+    .release = hailo_dmabuf_release,
+};
+
+int hailo_vdma_buffer_export_dmabuf(struct hailo_vdma_low_memory_buffer *low_memory_buffer,
+    struct hailo_vdma_continuous_buffer *continuous_buffer, int flags)
+{
+    DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+    struct hailo_dmabuf_exporter *exporter = NULL;
+    struct dma_buf *dmabuf = NULL;
+    int fd = -EINVAL;
+
+    exporter = kzalloc(sizeof(*exporter), GFP_KERNEL);
+    if (NULL == exporter) {
+        return -ENOMEM;
+    }
+
+    mutex_init(&exporter->lock);
+    INIT_LIST_HEAD(&exporter->attachments);
+    if (NULL != low_memory_buffer) {
+        kref_get(&low_memory_buffer->kref);
+        exporter->low_memory_buffer = low_memory_buffer;
+        exp_info.size = low_memory_buffer->pages_count * PAGE_SIZE;
+    } else {
+        get_device(continuous_buffer->dev);
+        kref_get(&continuous_buffer->kref);
+        exporter->continuous_buffer = continuous_buffer;
+        exp_info.size = continuous_buffer->size;
+    }
+
+    exp_info.ops = &hailo_dmabuf_ops;
+    exp_info.flags = flags;
+    exp_info.priv = exporter;
+    dmabuf = dma_buf_export(&exp_info);
+    if (IS_ERR(dmabuf)) {
+        pr_err("Failed exporting dmabuf, err %ld\n", PTR_ERR(dmabuf));
+        dmabuf_exporter_free(exporter);
+        return PTR_ERR(dmabuf);
+    }
+
+    // From now on, the exporter is released with the dmabuf.
+    fd = dma_buf_fd(dmabuf, flags);
+    if (fd < 0) {
+        pr_err("Failed getting dmabuf fd, err %d\n", fd);
+        dma_buf_put(dmabuf);
+    }
+
+    return fd;
+}
+
+#else /* defined(HAILO_SUPPORT_DMABUF_EXPORT) */
+
+int hailo_vdma_buffer_export_dmabuf(struct hailo_vdma_low_memory_buffer *low_memory_buffer,
+    struct hailo_vdma_continuous_buffer *continuous_buffer, int flags)
+{
+    (void)low_memory_buffer;
+    (void)continuous_buffer;
+    (void)flags;
+    pr_err("Exporting dmabufs is not supported in kernel versions lower than 5.8.0\n");
+    return -EOPNOTSUPP;
+}
+
+#endif /* defined(HAILO_SUPPORT_DMABUF_EXPORT) */
+
 // Assumes the provided user_address belongs to the vma and that MMIO_AND_NO_PAGES_VMA_MASK bits are set under
 // vma->vm_flags. This is validated in hailo_vdma_buffer_map, and won't be checked here
 #if defined(HAILO_SUPPORT_MMIO_DMA_MAPPING)
@@ -640,8 +2034,8 @@ static int map_mmio_address(uintptr_t user_address, u32 size, struct vm_area_str
 #endif /* defined(HAILO_SUPPORT_MMIO_DMA_MAPPING) */
 
 
-static int prepare_sg_table(struct sg_table *sg_table, uintptr_t user_address, u32 size,
-    struct hailo_vdma_low_memory_buffer *low_mem_driver_allocated_buffer)
+static int prepare_sg_table(struct device *dev, struct sg_table *sg_table, uintptr_t user_address, u32 size,
+    enum dma_data_direction direction, struct hailo_vdma_low_memory_buffer *low_mem_driver_allocated_buffer)
 {
     int ret = -EINVAL;
     int pinned_pages = 0;
@@ -649,6 +2043,9 @@ static int prepare_sg_table(struct sg_table *sg_table, uintptr_t user_address, u
     struct page **pages = NULL;
     int i = 0;
     struct scatterlist *sg_alloc_res = NULL;
+    unsigned int max_segment = 0;
+    struct hailo_vdma_low_memory_chunk *chunk = NULL;
+    size_t chunk_index = 0, page_index = 0;
 
     npages = (size + PAGE_SIZE - 1) >> PAGE_SHIFT;
     pages = kvmalloc_array(npages, sizeof(*pages), GFP_KERNEL);
@@ -658,12 +2055,19 @@ static int prepare_sg_table(struct sg_table *sg_table, uintptr_t user_address, u
 
     // Check whether mapping user allocated buffer or driver allocated low memory buffer
     if (NULL == low_mem_driver_allocated_buffer) {
+        // The buffer is kept pinned for as long as it is mapped, so it is pinned as long term - pages are migrated
+        // out of movable zones and CMA first. Write access is needed only if the device writes to the buffer.
+        // Memory of other PCIe devices mapped to user space (p2pdma pages, e.g. NVMe CMB allocated from p2pmem) may
+        // be pinned as well, for peer to peer DMA.
+        const unsigned int gup_flags = FOLL_LONGTERM | FOLL_PCI_P2PDMA |
+            ((DMA_TO_DEVICE != direction) ? FOLL_WRITE : 0);
+
         mmap_read_lock(current->mm);
-        pinned_pages = get_user_pages_compact(user_address, npages, FOLL_WRITE | FOLL_FORCE, pages);
+        pinned_pages = pin_user_pages_compact(user_address, npages, gup_flags, pages);
         mmap_read_unlock(current->mm);
 
         if (pinned_pages < 0) {
-            pr_err("get_user_pages failed with %d\n", pinned_pages);
+            pr_err("pin_user_pages failed with %d\n", pinned_pages);
             ret = pinned_pages;
             goto exit;
         } else if (pinned_pages != npages) {
@@ -680,14 +2084,26 @@ static int prepare_sg_table(struct sg_table *sg_table, uintptr_t user_address, u
             goto exit;
         }
 
-        for (i = 0; i < npages; i++) {
-            pages[i] = virt_to_page(low_mem_driver_allocated_buffer->pages_address[i]);
-            get_page(pages[i]);
+        // Pages of the same chunk are contiguous, so they are merged into a single sg entry.
+        i = 0;
+        for_each_low_memory_chunk(low_mem_driver_allocated_buffer, chunk, chunk_index) {
+            for (page_index = 0; page_index < (1UL << chunk->order); page_index++) {
+                pages[i] = chunk->first_page + page_index;
+                get_page(pages[i]);
+                i++;
+            }
         }
     }
 
+    // Contiguous pages are merged up to the device max segment size (must be page aligned), so binding a huge page
+    // backed buffer walks few sg entries. A segment must still fit a single bounce buffer if swiotlb is used.
+    max_segment = dma_get_max_seg_size(dev);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 1, 0)
+    max_segment = min_t(size_t, max_segment, dma_max_mapping_size(dev));
+#endif
+    max_segment = max_t(unsigned int, SGL_MAX_SEGMENT_SIZE, max_segment & PAGE_MASK);
     sg_alloc_res = sg_alloc_table_from_pages_segment_compat(sg_table, pages, npages,
-        0, size, SGL_MAX_SEGMENT_SIZE, NULL, 0, GFP_KERNEL);
+        0, size, max_segment, NULL, 0, GFP_KERNEL);
     if (IS_ERR(sg_alloc_res)) {
         ret = PTR_ERR(sg_alloc_res);
         pr_err("sg table alloc failed (err %d)..\n", ret);
@@ -697,29 +2113,42 @@ static int prepare_sg_table(struct sg_table *sg_table, uintptr_t user_address, u
     ret = 0;
     goto exit;
 release_pages:
-    for (i = 0; i < pinned_pages; i++) {
-        if (!PageReserved(pages[i])) {
-            SetPageDirty(pages[i]);
+    if (NULL == low_mem_driver_allocated_buffer) {
+        // Nothing was written to the pages yet, no need to dirty them.
+        unpin_user_pages(pages, pinned_pages);
+    } else {
+        for (i = 0; i < npages; i++) {
+            put_page(pages[i]);
         }
-        put_page(pages[i]);
     }
 exit:
     kvfree(pages);
     return ret;
 }
 
-static void clear_sg_table(struct sg_table *sgt)
+static void clear_sg_table(struct sg_table *sgt, bool is_pinned_user_memory, enum dma_data_direction direction)
 {
     struct sg_page_iter iter;
     struct page *page = NULL;
+    // Pages the device could not have written to are left clean.
+    const bool make_dirty = (DMA_TO_DEVICE != direction);
 
     for_each_sg_page(sgt->sgl, &iter, sgt->orig_nents, 0) {
         page = sg_page_iter_page(&iter);
         if (page) {
-            if (!PageReserved(page)) {
-                SetPageDirty(page);
+            if (make_dirty && !PageReserved(page) && !is_pci_p2pdma_page(page)) {
+                if (is_pinned_user_memory) {
+                    set_page_dirty_lock(page);
+                } else {
+                    SetPageDirty(page);
+                }
+            }
+
+            if (is_pinned_user_memory) {
+                unpin_user_page(page);
+            } else {
+                put_page(page);
             }
-            put_page(page);
         }
     }
 
@@ -11,13 +11,28 @@
 
 #include "vdma/vdma.h"
 
+#include <linux/sizes.h>
+
 #define SGL_MAX_SEGMENT_SIZE 	(0x10000)
 
-struct hailo_vdma_buffer *hailo_vdma_buffer_map(struct device *dev, uintptr_t user_address, size_t size,
-    enum dma_data_direction direction, enum hailo_dma_buffer_type buffer_type,
+// Max size of a single dma segment of a mapped buffer. The descriptors are programmed per descriptor page, so the
+// vDMA doesn't limit the segment size, and physically contiguous pages (e.g. huge pages) may be a single segment.
+#define HAILO_VDMA_MAX_SEGMENT_SIZE (UINT_MAX & PAGE_MASK)
+
+// Low memory buffers are allocated in physically contiguous chunks of up to 2MB, falling back to smaller chunks.
+#define HAILO_LOW_MEMORY_MAX_CHUNK_ORDER (get_order(SZ_2M))
+
+// Imported dmabufs are mapped using the attachments of dmabuf_cache.
+struct hailo_vdma_buffer *hailo_vdma_buffer_map(struct device *dev, struct hailo_dmabuf_cache *dmabuf_cache,
+    uintptr_t user_address, size_t size, enum dma_data_direction direction, enum hailo_dma_buffer_type buffer_type,
     struct hailo_vdma_low_memory_buffer *low_mem_driver_allocated_buffer);
 void hailo_vdma_buffer_get(struct hailo_vdma_buffer *buf);
 void hailo_vdma_buffer_put(struct hailo_vdma_buffer *buf);
+// Same as hailo_vdma_buffer_put, may be called from atomic context. The buffer is unmapped from a work if this is
+// the last reference.
+void hailo_vdma_buffer_put_deferred(struct hailo_vdma_buffer *buf);
+// Waits for the buffers released by hailo_vdma_buffer_put_deferred to be unmapped.
+void hailo_vdma_buffer_flush_deferred_puts(void);
 
 void hailo_vdma_buffer_sync(struct hailo_vdma_controller *controller,
     struct hailo_vdma_buffer *mapped_buffer, enum hailo_vdma_buffer_sync_type sync_type,
@@ -26,21 +41,60 @@ void hailo_vdma_buffer_sync_cyclic(struct hailo_vdma_controller *controller,
     struct hailo_vdma_buffer *mapped_buffer, enum hailo_vdma_buffer_sync_type sync_type,
     size_t offset, size_t size);
 
+int hailo_vdma_add_mapped_user_buffer(struct hailo_vdma_file_context *context, struct hailo_vdma_buffer *buffer);
+void hailo_vdma_remove_mapped_user_buffer(struct hailo_vdma_file_context *context, struct hailo_vdma_buffer *buffer);
 struct hailo_vdma_buffer* hailo_vdma_find_mapped_user_buffer(struct hailo_vdma_file_context *context,
     size_t buffer_handle);
 void hailo_vdma_clear_mapped_user_buffer_list(struct hailo_vdma_file_context *context,
     struct hailo_vdma_controller *controller);
 
-int hailo_desc_list_create(struct device *dev, u32 descriptors_count, u16 desc_page_size,
-    uintptr_t desc_handle, bool is_circular, struct hailo_descriptors_list_buffer *descriptors);
-void hailo_desc_list_release(struct device *dev, struct hailo_descriptors_list_buffer *descriptors);
+void hailo_vdma_buffer_cache_init(struct hailo_vdma_buffer_cache *cache, struct hailo_vdma_buffer_cache_stats *stats,
+    struct hailo_dmabuf_cache *dmabuf_cache);
+// Releases all cached buffers, must be called after the file's mapped buffers are released.
+void hailo_vdma_buffer_cache_finalize(struct hailo_vdma_buffer_cache *cache);
+// Same as hailo_vdma_buffer_map, reusing a cached mapping of the same user buffer if exists.
+struct hailo_vdma_buffer *hailo_vdma_buffer_cache_map(struct hailo_vdma_buffer_cache *cache, struct device *dev,
+    uintptr_t user_address, size_t size, enum dma_data_direction direction, enum hailo_dma_buffer_type buffer_type,
+    struct hailo_vdma_low_memory_buffer *low_mem_driver_allocated_buffer);
+// Drops the user reference to a buffer mapped by hailo_vdma_buffer_cache_map, keeping it in the cache if possible.
+void hailo_vdma_buffer_cache_unmap(struct hailo_vdma_buffer_cache *cache, struct hailo_vdma_buffer *buffer);
+// Drops the user reference to a buffer mapped by hailo_vdma_buffer_cache_map, without caching it.
+void hailo_vdma_buffer_cache_release(struct hailo_vdma_buffer *buffer);
+
+void hailo_dmabuf_cache_init(struct hailo_dmabuf_cache *cache, struct hailo_dmabuf_cache_stats *stats);
+// Releases the idle attachments (detaching from their dmabufs), attachments in use are released once unmapped.
+void hailo_dmabuf_cache_finalize(struct hailo_dmabuf_cache *cache);
+
+void hailo_desc_list_pool_init(struct hailo_desc_list_pool *pool, struct device *dev);
+void hailo_desc_list_pool_finalize(struct hailo_desc_list_pool *pool, struct device *dev);
+
+// If pool is not NULL, the descriptors list memory is taken from (and released to) the pool.
+int hailo_desc_list_create(struct device *dev, struct hailo_desc_list_pool *pool, u32 descriptors_count,
+    u16 desc_page_size, uintptr_t desc_handle, bool is_circular, struct hailo_descriptors_list_buffer *descriptors);
+void hailo_desc_list_release(struct device *dev, struct hailo_desc_list_pool *pool,
+    struct hailo_descriptors_list_buffer *descriptors);
+int hailo_vdma_add_descriptors_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_descriptors_list_buffer *descriptors);
+void hailo_vdma_remove_descriptors_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_descriptors_list_buffer *descriptors);
 struct hailo_descriptors_list_buffer* hailo_vdma_find_descriptors_buffer(struct hailo_vdma_file_context *context,
     uintptr_t desc_handle);
-void hailo_vdma_clear_descriptors_buffer_list(struct hailo_vdma_file_context *context,
-    struct hailo_vdma_controller *controller);
+void hailo_vdma_descriptors_buffer_get(struct hailo_descriptors_list_buffer *descriptors);
+// Drops a reference to a kmalloc'ed descriptors list, releasing it (and freeing the struct) on the last one.
+void hailo_vdma_descriptors_buffer_put(struct hailo_descriptors_list_buffer *descriptors);
+void hailo_vdma_clear_descriptors_buffer_list(struct hailo_vdma_file_context *context);
 
 int hailo_vdma_low_memory_buffer_alloc(size_t size, struct hailo_vdma_low_memory_buffer *low_memory_buffer);
 void hailo_vdma_low_memory_buffer_free(struct hailo_vdma_low_memory_buffer *low_memory_buffer);
+// Drops a reference to a kmalloc'ed low memory buffer, freeing it (and its pages) on the last one.
+void hailo_vdma_low_memory_buffer_put(struct hailo_vdma_low_memory_buffer *low_memory_buffer);
+// Inserts all the buffer pages to the vma, which must be of the buffer size.
+int hailo_vdma_low_memory_buffer_insert_pages(struct hailo_vdma_low_memory_buffer *low_memory_buffer,
+    struct vm_area_struct *vma);
+int hailo_vdma_add_low_memory_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_low_memory_buffer *low_memory_buffer);
+void hailo_vdma_remove_low_memory_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_low_memory_buffer *low_memory_buffer);
 struct hailo_vdma_low_memory_buffer* hailo_vdma_find_low_memory_buffer(struct hailo_vdma_file_context *context,
     uintptr_t buf_handle);
 void hailo_vdma_clear_low_memory_buffer_list(struct hailo_vdma_file_context *context);
@@ -49,8 +103,19 @@ int hailo_vdma_continuous_buffer_alloc(struct device *dev, size_t size,
     struct hailo_vdma_continuous_buffer *continuous_buffer);
 void hailo_vdma_continuous_buffer_free(struct device *dev,
     struct hailo_vdma_continuous_buffer *continuous_buffer);
+// Drops a reference to a kmalloc'ed continuous buffer, freeing it on the last one.
+void hailo_vdma_continuous_buffer_put(struct hailo_vdma_continuous_buffer *continuous_buffer);
+int hailo_vdma_add_continuous_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_continuous_buffer *continuous_buffer);
+void hailo_vdma_remove_continuous_buffer(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_continuous_buffer *continuous_buffer);
 struct hailo_vdma_continuous_buffer* hailo_vdma_find_continuous_buffer(struct hailo_vdma_file_context *context,
     uintptr_t buf_handle);
 void hailo_vdma_clear_continuous_buffer_list(struct hailo_vdma_file_context *context,
     struct hailo_vdma_controller *controller);
+
+// Exports a low memory or a continuous buffer (exactly one of them is not NULL) as a dmabuf, returns the dmabuf fd.
+// The dmabuf holds a reference to the buffer.
+int hailo_vdma_buffer_export_dmabuf(struct hailo_vdma_low_memory_buffer *low_memory_buffer,
+    struct hailo_vdma_continuous_buffer *continuous_buffer, int flags);
 #endif /* _HAILO_VDMA_MEMORY_H_ */
\ No newline at end of file
@@ -0,0 +1,527 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * Copyright (c) 2019-2024 Hailo Technologies Ltd. All rights reserved.
+ **/
+/**
+ * kunit suite of the vDMA memory code. The code is included (rather than linked) to reach its static helpers.
+ */
+
+// Same prefix as memory.c, defined before any kernel header is included.
+#define pr_fmt(fmt) "hailo: " fmt
+
+#include "vdma/memory.h"
+
+#include <linux/memremap.h>
+#include <linux/mm.h>
+
+// There are no p2pdma pages without a PCIe device exposing its memory, so the tests choose which pages are.
+#define TEST_MAX_P2PDMA_PAGES (4)
+static struct page *test_p2pdma_pages[TEST_MAX_P2PDMA_PAGES];
+
+static bool test_is_pci_p2pdma_page(const struct page *page)
+{
+    size_t i = 0;
+    for (i = 0; i < ARRAY_SIZE(test_p2pdma_pages); i++) {
+        if (page == test_p2pdma_pages[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#define is_pci_p2pdma_page(page) test_is_pci_p2pdma_page(page)
+
+#include "vdma/memory.c"
+
+#include "mock_vdma.h"
+
+#include <kunit/test.h>
+#include <linux/device.h>
+#include <linux/dma-mapping.h>
+
+struct memory_test {
+    // Device without a bus or dma ops (dma direct, 32-bit), the max segment size is set by the tests.
+    struct device *dev;
+    struct device_dma_parameters dma_parms;
+};
+
+// Large enough to be split to a few chunks of HAILO_LOW_MEMORY_MAX_CHUNK_ORDER.
+#define TEST_LOW_MEMORY_BUFFER_SIZE (3 * SZ_2M + 5 * PAGE_SIZE)
+
+// The largest order the buddy allocator can allocate, larger orders always fail.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+#define TEST_BUDDY_MAX_ORDER (MAX_PAGE_ORDER)
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+#define TEST_BUDDY_MAX_ORDER (MAX_ORDER)
+#else
+#define TEST_BUDDY_MAX_ORDER (MAX_ORDER - 1)
+#endif
+
+// A few index strides, the last one partial.
+#define TEST_SG_INDEX_ENTRIES_COUNT (4 * HAILO_VDMA_SG_INDEX_STRIDE + 5)
+
+// Entries of different sizes, so the indexed offsets are not multiples of a single size.
+static u32 test_sg_entry_size(unsigned int entry_number)
+{
+    return (u32)(PAGE_SIZE * (1 + (entry_number % 3)));
+}
+
+// Builds the sg table of the buffer, and returns the dma offset of each of its entries (and the buffer size after
+// the last entry).
+static size_t *build_test_sg_table(struct kunit *test, struct hailo_vdma_buffer *buffer, unsigned int entries_count)
+{
+    size_t *entry_offsets = kunit_kcalloc(test, entries_count + 1, sizeof(*entry_offsets), GFP_KERNEL);
+    struct scatterlist *sg_entry = NULL;
+    int i = 0;
+
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, entry_offsets);
+    KUNIT_ASSERT_EQ(test, 0, sg_alloc_table(&buffer->sg_table, entries_count, GFP_KERNEL));
+
+    for_each_sg(buffer->sg_table.sgl, sg_entry, buffer->sg_table.orig_nents, i) {
+        sg_dma_address(sg_entry) = MOCK_VDMA_BUFFER_DMA_ADDRESS + entry_offsets[i];
+        sg_dma_len(sg_entry) = test_sg_entry_size(i);
+        entry_offsets[i + 1] = entry_offsets[i] + test_sg_entry_size(i);
+    }
+    buffer->sg_table.nents = buffer->sg_table.orig_nents;
+    buffer->size = (u32)entry_offsets[entries_count];
+
+    return entry_offsets;
+}
+
+static struct scatterlist *sg_entry_by_number(struct hailo_vdma_buffer *buffer, unsigned int entry_number)
+{
+    struct scatterlist *sg_entry = buffer->sg_table.sgl;
+    unsigned int i = 0;
+
+    for (i = 0; i < entry_number; i++) {
+        sg_entry = sg_next(sg_entry);
+    }
+    return sg_entry;
+}
+
+// The seek must return the last indexed entry starting at or before offset.
+static void check_sg_seek(struct kunit *test, struct hailo_vdma_buffer *buffer, const size_t *entry_offsets,
+    unsigned int entries_count, size_t offset)
+{
+    unsigned int expected_number = 0, entry_number = 0;
+    size_t entry_offset = 0;
+    struct scatterlist *sg_entry = NULL;
+
+    while ((expected_number + HAILO_VDMA_SG_INDEX_STRIDE < entries_count) &&
+           (entry_offsets[expected_number + HAILO_VDMA_SG_INDEX_STRIDE] <= offset)) {
+        expected_number += HAILO_VDMA_SG_INDEX_STRIDE;
+    }
+
+    sg_entry = seek_sg_entry(buffer, offset, &entry_number, &entry_offset);
+    KUNIT_EXPECT_EQ_MSG(test, expected_number, entry_number, "offset %zu", offset);
+    KUNIT_EXPECT_EQ_MSG(test, entry_offsets[expected_number], entry_offset, "offset %zu", offset);
+    KUNIT_EXPECT_PTR_EQ_MSG(test, sg_entry_by_number(buffer, expected_number), sg_entry, "offset %zu", offset);
+}
+
+// Seeks to the boundaries of all sg entries (and the bytes around them), including the indexed ones.
+static void sg_index_seek_test(struct kunit *test)
+{
+    struct hailo_vdma_buffer *buffer = kunit_kzalloc(test, sizeof(*buffer), GFP_KERNEL);
+    const unsigned int entries_count = TEST_SG_INDEX_ENTRIES_COUNT;
+    size_t *entry_offsets = NULL;
+    unsigned int i = 0;
+
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buffer);
+    entry_offsets = build_test_sg_table(test, buffer, entries_count);
+
+    build_sg_index(buffer, &buffer->sg_table);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buffer->sg_index);
+    KUNIT_EXPECT_EQ(test, (size_t)DIV_ROUND_UP(entries_count, HAILO_VDMA_SG_INDEX_STRIDE), buffer->sg_index_count);
+
+    for (i = 0; i < entries_count; i++) {
+        if (i > 0) {
+            check_sg_seek(test, buffer, entry_offsets, entries_count, entry_offsets[i] - 1);
+        }
+        check_sg_seek(test, buffer, entry_offsets, entries_count, entry_offsets[i]);
+        check_sg_seek(test, buffer, entry_offsets, entries_count, entry_offsets[i] + 1);
+    }
+    check_sg_seek(test, buffer, entry_offsets, entries_count, buffer->size - 1);
+
+    kfree(buffer->sg_index);
+    sg_free_table(&buffer->sg_table);
+}
+
+// Without an index (its allocation failed), the seek starts from the first entry.
+static void sg_seek_without_index_test(struct kunit *test)
+{
+    struct hailo_vdma_buffer *buffer = kunit_kzalloc(test, sizeof(*buffer), GFP_KERNEL);
+    unsigned int entry_number = U32_MAX;
+    size_t entry_offset = SIZE_MAX;
+
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buffer);
+    build_test_sg_table(test, buffer, TEST_SG_INDEX_ENTRIES_COUNT);
+
+    KUNIT_EXPECT_PTR_EQ(test, buffer->sg_table.sgl,
+        seek_sg_entry(buffer, buffer->size - 1, &entry_number, &entry_offset));
+    KUNIT_EXPECT_EQ(test, 0U, entry_number);
+    KUNIT_EXPECT_EQ(test, (size_t)0, entry_offset);
+
+    sg_free_table(&buffer->sg_table);
+}
+
+// Device max segment sizes - below the sg segment floor, not page aligned, and unlimited.
+static const unsigned int max_segment_sizes[] = { SZ_4K, SZ_256K + 1, SZ_1M, UINT_MAX };
+
+static void max_segment_size_desc(const unsigned int *max_segment_size, char *desc)
+{
+    snprintf(desc, KUNIT_PARAM_DESC_SIZE, "max segment size 0x%x", *max_segment_size);
+}
+
+KUNIT_ARRAY_PARAM(max_segment_size, max_segment_sizes, max_segment_size_desc);
+
+// The pages of a low memory buffer are coalesced to sg entries up to the device max segment size, that must still
+// fit a single dma mapping.
+static void sg_table_max_segment_test(struct kunit *test)
+{
+    struct memory_test *ctx = test->priv;
+    const unsigned int max_segment_size = *(const unsigned int *)test->param_value;
+    struct hailo_vdma_low_memory_buffer low_memory_buffer = {0};
+    struct sg_table sgt = {0};
+    struct scatterlist *sg_entry = NULL;
+    size_t max_entry_size = 0, total_size = 0;
+    int i = 0;
+
+    dma_set_max_seg_size(ctx->dev, max_segment_size);
+    max_entry_size = dma_get_max_seg_size(ctx->dev);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 1, 0)
+    max_entry_size = min(max_entry_size, dma_max_mapping_size(ctx->dev));
+#endif
+    max_entry_size = max_t(size_t, SGL_MAX_SEGMENT_SIZE, max_entry_size & PAGE_MASK);
+
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_low_memory_buffer_alloc(TEST_LOW_MEMORY_BUFFER_SIZE, &low_memory_buffer));
+    KUNIT_ASSERT_EQ(test, 0, prepare_sg_table(ctx->dev, &sgt, 0, TEST_LOW_MEMORY_BUFFER_SIZE, DMA_BIDIRECTIONAL,
+        &low_memory_buffer));
+
+    for_each_sg(sgt.sgl, sg_entry, sgt.orig_nents, i) {
+        KUNIT_EXPECT_LE_MSG(test, (size_t)sg_entry->length, max_entry_size, "sg entry %d", i);
+        total_size += sg_entry->length;
+    }
+    KUNIT_EXPECT_EQ(test, (size_t)TEST_LOW_MEMORY_BUFFER_SIZE, total_size);
+    KUNIT_EXPECT_GE(test, (size_t)sgt.orig_nents, DIV_ROUND_UP(total_size, max_entry_size));
+    // Chunks are contiguous, so the entries are not split further than the segment size.
+    KUNIT_EXPECT_LE(test, (size_t)sgt.orig_nents,
+        low_memory_buffer.chunks_count * DIV_ROUND_UP(SZ_2M, min_t(size_t, max_entry_size, SZ_2M)));
+
+    clear_sg_table(&sgt, false, DMA_BIDIRECTIONAL);
+    hailo_vdma_low_memory_buffer_free(&low_memory_buffer);
+}
+
+// Chunks are allocated largest first, never larger than max_order or than the pages left to allocate.
+static void check_low_memory_chunks(struct kunit *test, struct hailo_vdma_low_memory_buffer *low_memory_buffer,
+    size_t size, unsigned int max_order)
+{
+    struct hailo_vdma_low_memory_chunk *chunk = NULL;
+    size_t chunk_index = 0, pages_left = DIV_ROUND_UP(size, PAGE_SIZE);
+    unsigned int previous_order = max_order;
+
+    KUNIT_EXPECT_EQ(test, pages_left, low_memory_buffer->pages_count);
+
+    for_each_low_memory_chunk(low_memory_buffer, chunk, chunk_index) {
+        KUNIT_ASSERT_NOT_ERR_OR_NULL(test, chunk->first_page);
+        KUNIT_EXPECT_LE_MSG(test, chunk->order, previous_order, "chunk %zu", chunk_index);
+        KUNIT_ASSERT_NE_MSG(test, (size_t)0, pages_left, "chunk %zu", chunk_index);
+        KUNIT_ASSERT_LE_MSG(test, chunk->order, (unsigned int)ilog2(pages_left), "chunk %zu", chunk_index);
+        previous_order = chunk->order;
+        pages_left -= (size_t)1 << chunk->order;
+    }
+    KUNIT_EXPECT_EQ(test, (size_t)0, pages_left);
+}
+
+static void low_memory_buffer_chunks_test(struct kunit *test)
+{
+    struct hailo_vdma_low_memory_buffer low_memory_buffer = {0};
+
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_low_memory_buffer_alloc(TEST_LOW_MEMORY_BUFFER_SIZE, &low_memory_buffer));
+    check_low_memory_chunks(test, &low_memory_buffer, TEST_LOW_MEMORY_BUFFER_SIZE, HAILO_LOW_MEMORY_MAX_CHUNK_ORDER);
+    hailo_vdma_low_memory_buffer_free(&low_memory_buffer);
+}
+
+// Starting above the buddy allocator max order, the first order always fails and the allocation must fall back to
+// smaller orders.
+static void low_memory_buffer_order_fallback_test(struct kunit *test)
+{
+    const unsigned int max_order = TEST_BUDDY_MAX_ORDER + 1;
+    const size_t size = (PAGE_SIZE << max_order) + 3 * PAGE_SIZE;
+    struct hailo_vdma_low_memory_buffer low_memory_buffer = {0};
+
+    if (size > SZ_64M) {
+        kunit_skip(test, "buffer of order %u is too large (%zu bytes)", max_order, size);
+    }
+
+    KUNIT_ASSERT_EQ(test, 0, low_memory_buffer_alloc(size, max_order, &low_memory_buffer));
+    KUNIT_EXPECT_LE(test, low_memory_buffer.chunks[0].order, (unsigned int)TEST_BUDDY_MAX_ORDER);
+    check_low_memory_chunks(test, &low_memory_buffer, size, max_order);
+    hailo_vdma_low_memory_buffer_free(&low_memory_buffer);
+}
+
+// Page aligned handles, from the first one hailo_get_next_vdma_handle returns to the largest one.
+static const uintptr_t test_vdma_handles[] = {
+    PAGE_SIZE, 2 * PAGE_SIZE, 3 * PAGE_SIZE, (uintptr_t)U16_MAX << PAGE_SHIFT, (uintptr_t)(ULONG_MAX >> 1) & PAGE_MASK,
+    (uintptr_t)PAGE_MASK,
+};
+
+// The handle of each buffer type is stored by its page number, and must be found back by the same handle only.
+static void vdma_handle_round_trip_test(struct kunit *test)
+{
+    const size_t handles_count = ARRAY_SIZE(test_vdma_handles);
+    struct hailo_vdma_file_context *context = kunit_kzalloc(test, sizeof(*context), GFP_KERNEL);
+    struct hailo_descriptors_list_buffer *descriptors =
+        kunit_kcalloc(test, handles_count + 1, sizeof(*descriptors), GFP_KERNEL);
+    struct hailo_vdma_low_memory_buffer *low_memory_buffers =
+        kunit_kcalloc(test, handles_count + 1, sizeof(*low_memory_buffers), GFP_KERNEL);
+    struct hailo_vdma_continuous_buffer *continuous_buffers =
+        kunit_kcalloc(test, handles_count + 1, sizeof(*continuous_buffers), GFP_KERNEL);
+    unsigned long index = 0;
+    uintptr_t handle = 0;
+    size_t i = 0;
+
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, context);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, descriptors);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, low_memory_buffers);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, continuous_buffers);
+    xa_init(&context->descriptors_buffers);
+    xa_init(&context->vdma_low_memory_buffers);
+    xa_init(&context->continuous_buffers);
+
+    for (i = 0; i < handles_count; i++) {
+        handle = test_vdma_handles[i];
+        KUNIT_ASSERT_TRUE(test, vdma_handle_to_index(handle, &index));
+        KUNIT_EXPECT_EQ(test, handle, (uintptr_t)index << PAGE_SHIFT);
+
+        descriptors[i].handle = handle;
+        low_memory_buffers[i].handle = handle;
+        continuous_buffers[i].handle = handle;
+        KUNIT_ASSERT_EQ(test, 0, hailo_vdma_add_descriptors_buffer(context, &descriptors[i]));
+        KUNIT_ASSERT_EQ(test, 0, hailo_vdma_add_low_memory_buffer(context, &low_memory_buffers[i]));
+        KUNIT_ASSERT_EQ(test, 0, hailo_vdma_add_continuous_buffer(context, &continuous_buffers[i]));
+    }
+
+    // Handles not returned by hailo_get_next_vdma_handle can't be added, and must not alias an existing one.
+    handle = test_vdma_handles[0] + PAGE_SIZE / 2;
+    descriptors[handles_count].handle = handle;
+    low_memory_buffers[handles_count].handle = handle;
+    continuous_buffers[handles_count].handle = handle;
+    KUNIT_EXPECT_FALSE(test, vdma_handle_to_index(handle, &index));
+    KUNIT_EXPECT_EQ(test, -EINVAL, hailo_vdma_add_descriptors_buffer(context, &descriptors[handles_count]));
+    KUNIT_EXPECT_EQ(test, -EINVAL, hailo_vdma_add_low_memory_buffer(context, &low_memory_buffers[handles_count]));
+    KUNIT_EXPECT_EQ(test, -EINVAL, hailo_vdma_add_continuous_buffer(context, &continuous_buffers[handles_count]));
+
+    // A handle can't be added twice.
+    KUNIT_EXPECT_EQ(test, -EBUSY, hailo_vdma_add_descriptors_buffer(context, &descriptors[0]));
+
+    for (i = 0; i < handles_count; i++) {
+        handle = test_vdma_handles[i];
+        KUNIT_EXPECT_PTR_EQ(test, &descriptors[i], hailo_vdma_find_descriptors_buffer(context, handle));
+        KUNIT_EXPECT_PTR_EQ(test, &low_memory_buffers[i], hailo_vdma_find_low_memory_buffer(context, handle));
+        KUNIT_EXPECT_PTR_EQ(test, &continuous_buffers[i], hailo_vdma_find_continuous_buffer(context, handle));
+
+        KUNIT_EXPECT_TRUE(test, NULL == hailo_vdma_find_descriptors_buffer(context, handle + 1));
+        KUNIT_EXPECT_TRUE(test, NULL == hailo_vdma_find_low_memory_buffer(context, handle - 1));
+        KUNIT_EXPECT_TRUE(test, NULL == hailo_vdma_find_continuous_buffer(context, handle | (PAGE_SIZE - 1)));
+    }
+
+    for (i = 0; i < handles_count; i++) {
+        handle = test_vdma_handles[i];
+        hailo_vdma_remove_descriptors_buffer(context, &descriptors[i]);
+        hailo_vdma_remove_low_memory_buffer(context, &low_memory_buffers[i]);
+        hailo_vdma_remove_continuous_buffer(context, &continuous_buffers[i]);
+
+        KUNIT_EXPECT_TRUE(test, NULL == hailo_vdma_find_descriptors_buffer(context, handle));
+        KUNIT_EXPECT_TRUE(test, NULL == hailo_vdma_find_low_memory_buffer(context, handle));
+        KUNIT_EXPECT_TRUE(test, NULL == hailo_vdma_find_continuous_buffer(context, handle));
+    }
+    KUNIT_EXPECT_TRUE(test, xa_empty(&context->descriptors_buffers));
+    KUNIT_EXPECT_TRUE(test, xa_empty(&context->vdma_low_memory_buffers));
+    KUNIT_EXPECT_TRUE(test, xa_empty(&context->continuous_buffers));
+
+    xa_destroy(&context->descriptors_buffers);
+    xa_destroy(&context->vdma_low_memory_buffers);
+    xa_destroy(&context->continuous_buffers);
+}
+
+#define TEST_P2PDMA_SG_ENTRIES_COUNT (TEST_MAX_P2PDMA_PAGES)
+
+// Which sg entries of the table are p2pdma pages (a bitmap), and the expected result.
+struct p2pdma_type_param {
+    unsigned long p2pdma_entries;
+    int expected_err;
+    bool expected_is_p2pdma;
+};
+
+static const struct p2pdma_type_param p2pdma_type_params[] = {
+    { 0x0, 0, false },
+    { 0xF, 0, true },
+    { 0x1, -EINVAL, false },
+    { 0x8, -EINVAL, false },
+    { 0x6, -EINVAL, false },
+};
+
+static void p2pdma_type_desc(const struct p2pdma_type_param *param, char *desc)
+{
+    snprintf(desc, KUNIT_PARAM_DESC_SIZE, "p2pdma entries 0x%lx", param->p2pdma_entries);
+}
+
+KUNIT_ARRAY_PARAM(p2pdma_type, p2pdma_type_params, p2pdma_type_desc);
+
+// Buffers of p2pdma pages only are not synced, and buffers mixing them with host memory are not supported.
+static void sg_table_p2pdma_type_test(struct kunit *test)
+{
+    const struct p2pdma_type_param *param = test->param_value;
+    struct page *pages[TEST_P2PDMA_SG_ENTRIES_COUNT] = {0};
+    struct sg_table sgt = {0};
+    struct scatterlist *sg_entry = NULL;
+    bool is_p2pdma = false;
+    int i = 0;
+
+    KUNIT_ASSERT_EQ(test, 0, sg_alloc_table(&sgt, TEST_P2PDMA_SG_ENTRIES_COUNT, GFP_KERNEL));
+    for_each_sg(sgt.sgl, sg_entry, sgt.orig_nents, i) {
+        pages[i] = alloc_page(GFP_KERNEL);
+        if (NULL == pages[i]) {
+            break;
+        }
+        sg_set_page(sg_entry, pages[i], PAGE_SIZE, 0);
+        if (test_bit(i, &param->p2pdma_entries)) {
+            test_p2pdma_pages[i] = pages[i];
+        }
+    }
+
+    if (i == TEST_P2PDMA_SG_ENTRIES_COUNT) {
+        KUNIT_EXPECT_EQ(test, param->expected_err, get_sg_table_p2pdma_type(&sgt, &is_p2pdma));
+        KUNIT_EXPECT_EQ(test, param->expected_is_p2pdma, is_p2pdma);
+    } else {
+        KUNIT_FAIL(test, "Failed to allocate page %d", i);
+    }
+
+    memset(test_p2pdma_pages, 0, sizeof(test_p2pdma_pages));
+    for (i = 0; i < TEST_P2PDMA_SG_ENTRIES_COUNT; i++) {
+        if (NULL != pages[i]) {
+            __free_page(pages[i]);
+        }
+    }
+    sg_free_table(&sgt);
+}
+
+// Descriptors counts of the smallest pool class, filling it or not.
+#define TEST_DESC_LIST_SMALL_DESCS_COUNT    (1024)
+#define TEST_DESC_LIST_CLASS_DESCS_COUNT    (VDMA_DESCRIPTOR_LIST_ALIGN / sizeof(struct hailo_vdma_descriptor))
+
+static struct hailo_descriptors_list_buffer *create_test_desc_list(struct kunit *test, struct memory_test *ctx,
+    struct hailo_desc_list_pool *pool, u32 descriptors_count)
+{
+    struct hailo_descriptors_list_buffer *descriptors = kunit_kzalloc(test, sizeof(*descriptors), GFP_KERNEL);
+
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, descriptors);
+    KUNIT_ASSERT_EQ(test, 0, hailo_desc_list_create(ctx->dev, pool, descriptors_count, MOCK_VDMA_DESC_PAGE_SIZE,
+        PAGE_SIZE, true, descriptors));
+    return descriptors;
+}
+
+// Released lists are reused (zeroed) by lists of the same size class, up to the max lists kept per class.
+static void desc_list_pool_reuse_test(struct kunit *test)
+{
+    struct memory_test *ctx = test->priv;
+    const unsigned int max_per_class = desc_list_pool_max_per_class, prealloc = desc_list_pool_prealloc;
+    const size_t class_size = desc_list_pool_class_size(0);
+    struct hailo_desc_list_pool *pool = kunit_kzalloc(test, sizeof(*pool), GFP_KERNEL);
+    struct hailo_descriptors_list_buffer *descriptors[3] = {NULL};
+    void *kernel_address = NULL;
+    dma_addr_t dma_address = 0;
+
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pool);
+    // Whatever the module parameters, the pool starts empty and keeps a single list of each class.
+    desc_list_pool_max_per_class = 1;
+    desc_list_pool_prealloc = 0;
+    hailo_desc_list_pool_init(pool, ctx->dev);
+
+    descriptors[0] = create_test_desc_list(test, ctx, pool, TEST_DESC_LIST_SMALL_DESCS_COUNT);
+    KUNIT_EXPECT_EQ(test, class_size, (size_t)descriptors[0]->buffer_size);
+    KUNIT_EXPECT_EQ(test, 1LL, (long long)atomic64_read(&pool->stats.misses));
+    kernel_address = descriptors[0]->kernel_address;
+    dma_address = descriptors[0]->dma_address;
+    memset(kernel_address, 0xFF, class_size);
+
+    hailo_desc_list_release(ctx->dev, pool, descriptors[0]);
+    KUNIT_EXPECT_EQ(test, 1LL, (long long)atomic64_read(&pool->stats.recycled));
+    KUNIT_EXPECT_EQ(test, (long long)class_size, (long long)atomic64_read(&pool->stats.cached_bytes));
+
+    // Same class, larger list.
+    descriptors[1] = create_test_desc_list(test, ctx, pool, TEST_DESC_LIST_CLASS_DESCS_COUNT);
+    KUNIT_EXPECT_EQ(test, 1LL, (long long)atomic64_read(&pool->stats.hits));
+    KUNIT_EXPECT_PTR_EQ(test, kernel_address, descriptors[1]->kernel_address);
+    KUNIT_EXPECT_EQ(test, (u64)dma_address, (u64)descriptors[1]->dma_address);
+    KUNIT_EXPECT_TRUE(test, NULL == memchr_inv(descriptors[1]->kernel_address, 0, class_size));
+    KUNIT_EXPECT_EQ(test, 0LL, (long long)atomic64_read(&pool->stats.cached_bytes));
+
+    // The pool is empty again.
+    descriptors[2] = create_test_desc_list(test, ctx, pool, TEST_DESC_LIST_SMALL_DESCS_COUNT);
+    KUNIT_EXPECT_EQ(test, 2LL, (long long)atomic64_read(&pool->stats.misses));
+
+    // A list released beyond the max kept per class is freed.
+    hailo_desc_list_release(ctx->dev, pool, descriptors[1]);
+    hailo_desc_list_release(ctx->dev, pool, descriptors[2]);
+    KUNIT_EXPECT_EQ(test, 2LL, (long long)atomic64_read(&pool->stats.recycled));
+    KUNIT_EXPECT_EQ(test, 1LL, (long long)atomic64_read(&pool->stats.freed));
+    KUNIT_EXPECT_EQ(test, (long long)class_size, (long long)atomic64_read(&pool->stats.cached_bytes));
+
+    hailo_desc_list_pool_finalize(pool, ctx->dev);
+    KUNIT_EXPECT_EQ(test, 0LL, (long long)atomic64_read(&pool->stats.cached_bytes));
+    desc_list_pool_max_per_class = max_per_class;
+    desc_list_pool_prealloc = prealloc;
+}
+
+static int memory_test_init(struct kunit *test)
+{
+    struct memory_test *ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+    if (NULL == ctx) {
+        return -ENOMEM;
+    }
+    test->priv = ctx;
+
+    ctx->dev = root_device_register("hailo_vdma_kunit");
+    if (IS_ERR(ctx->dev)) {
+        return PTR_ERR(ctx->dev);
+    }
+    ctx->dev->dma_parms = &ctx->dma_parms;
+    ctx->dev->coherent_dma_mask = DMA_BIT_MASK(32);
+    ctx->dev->dma_mask = &ctx->dev->coherent_dma_mask;
+
+    return 0;
+}
+
+static void memory_test_exit(struct kunit *test)
+{
+    struct memory_test *ctx = test->priv;
+
+    // Exit is called even if init failed.
+    if ((NULL == ctx) || IS_ERR_OR_NULL(ctx->dev)) {
+        return;
+    }
+
+    ctx->dev->dma_mask = NULL;
+    ctx->dev->dma_parms = NULL;
+    root_device_unregister(ctx->dev);
+}
+
+static struct kunit_case memory_test_cases[] = {
+    KUNIT_CASE(sg_index_seek_test),
+    KUNIT_CASE(sg_seek_without_index_test),
+    KUNIT_CASE_PARAM(sg_table_max_segment_test, max_segment_size_gen_params),
+    KUNIT_CASE(low_memory_buffer_chunks_test),
+    KUNIT_CASE(low_memory_buffer_order_fallback_test),
+    KUNIT_CASE(vdma_handle_round_trip_test),
+    KUNIT_CASE_PARAM(sg_table_p2pdma_type_test, p2pdma_type_gen_params),
+    KUNIT_CASE(desc_list_pool_reuse_test),
+    {}
+};
+
+struct kunit_suite hailo_vdma_memory_test_suite = {
+    .name = "hailo_vdma_memory",
+    .init = memory_test_init,
+    .exit = memory_test_exit,
+    .test_cases = memory_test_cases,
+};
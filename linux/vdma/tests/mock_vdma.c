@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * Copyright (c) 2019-2024 Hailo Technologies Ltd. All rights reserved.
+ **/
+
+#include "mock_vdma.h"
+
+#include <linux/io.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+// Control value the firmware writes to start the device side of a channel.
+#define MOCK_VDMA_CHANNEL_CONTROL_START         (0x1)
+#define MOCK_VDMA_DEVICE_INTERRUPTS_BITMASK     (1 << 4)
+#define MOCK_VDMA_HOST_INTERRUPTS_BITMASK       (1 << 5)
+
+#define MOCK_VDMA_CHANNEL_REGISTERS_SIZE        (CHANNEL_BASE_OFFSET(MAX_VDMA_CHANNELS_PER_ENGINE))
+
+// The fake dma addresses are used as is.
+static u64 mock_encode_desc_dma_address_range(dma_addr_t dma_address_start, dma_addr_t dma_address_end, u32 step,
+    u8 channel_id)
+{
+    (void)dma_address_end;
+    (void)step;
+    (void)channel_id;
+    return (u64)dma_address_start;
+}
+
+static u8 __iomem *mock_channel_regs(struct hailo_vdma_mock *mock, u8 channel_index, bool is_host_side)
+{
+    struct hailo_vdma_channel *channel = &mock->engine.channels[channel_index];
+    return is_host_side ? channel->host_regs : channel->device_regs;
+}
+
+int hailo_vdma_mock_init(struct kunit *test, struct hailo_vdma_mock *mock, u32 desc_count)
+{
+    void *registers = NULL;
+
+    if (!is_power_of_2(desc_count) || (desc_count > BIT(16))) {
+        return -EINVAL;
+    }
+
+    registers = kunit_kzalloc(test, MOCK_VDMA_CHANNEL_REGISTERS_SIZE, GFP_KERNEL);
+    if (NULL == registers) {
+        return -ENOMEM;
+    }
+
+    mock->desc_list.desc_list = kvcalloc(desc_count, sizeof(*mock->desc_list.desc_list), GFP_KERNEL);
+    if (NULL == mock->desc_list.desc_list) {
+        return -ENOMEM;
+    }
+    mock->desc_list.desc_count = desc_count;
+    mock->desc_list.desc_count_mask = desc_count - 1;
+    mock->desc_list.desc_page_size = MOCK_VDMA_DESC_PAGE_SIZE;
+    mock->desc_list.is_circular = true;
+
+    mock->hw.hw_ops.encode_desc_dma_address_range = mock_encode_desc_dma_address_range;
+    mock->hw.ddr_data_id = MOCK_VDMA_DDR_DATA_ID;
+    mock->hw.device_interrupts_bitmask = MOCK_VDMA_DEVICE_INTERRUPTS_BITMASK;
+    mock->hw.host_interrupts_bitmask = MOCK_VDMA_HOST_INTERRUPTS_BITMASK;
+    mock->hw.src_channels_bitmask = MOCK_VDMA_SRC_CHANNELS_BITMASK;
+
+    mock->channel_registers.address = (uintptr_t)registers;
+    mock->channel_registers.size = MOCK_VDMA_CHANNEL_REGISTERS_SIZE;
+    hailo_vdma_engine_init(&mock->engine, 0, &mock->channel_registers, mock->hw.src_channels_bitmask);
+
+    return 0;
+}
+
+void hailo_vdma_mock_finalize(struct hailo_vdma_mock *mock)
+{
+    kvfree(mock->desc_list.desc_list);
+    mock->desc_list.desc_list = NULL;
+}
+
+int hailo_vdma_mock_enable_channel(struct kunit *test, struct hailo_vdma_mock *mock, u8 channel_index, u16 depth)
+{
+    struct hailo_vdma_channel *channel = &mock->engine.channels[channel_index];
+    struct hailo_ongoing_transfer *transfers = NULL;
+    int err = -EINVAL;
+
+    if (!is_power_of_2(depth)) {
+        return -EINVAL;
+    }
+
+    transfers = kunit_kcalloc(test, depth, sizeof(*transfers), GFP_KERNEL);
+    if (NULL == transfers) {
+        return -ENOMEM;
+    }
+
+    channel->ongoing_transfers.head = 0;
+    channel->ongoing_transfers.tail = 0;
+    channel->ongoing_transfers.size = depth;
+    channel->ongoing_transfers.transfers = transfers;
+
+    err = hailo_vdma_start_channel(channel->host_regs, MOCK_VDMA_DESC_LIST_DMA_ADDRESS, mock->desc_list.desc_count,
+        mock->hw.ddr_data_id);
+    if (err < 0) {
+        return err;
+    }
+    hailo_vdma_mock_write_control(mock, channel_index, false, MOCK_VDMA_CHANNEL_CONTROL_START);
+
+    hailo_vdma_engine_enable_channels(&mock->engine, BIT(channel_index), false);
+    return 0;
+}
+
+int hailo_vdma_mock_sg_table(struct sg_table *sgt, unsigned int entries_count, u32 entry_size)
+{
+    struct scatterlist *sg_entry = NULL;
+    unsigned int i = 0;
+    int err = sg_alloc_table(sgt, entries_count, GFP_KERNEL);
+    if (err < 0) {
+        return err;
+    }
+
+    for_each_sg(sgt->sgl, sg_entry, sgt->orig_nents, i) {
+        sg_dma_address(sg_entry) = MOCK_VDMA_BUFFER_DMA_ADDRESS + (dma_addr_t)i * entry_size;
+        sg_dma_len(sg_entry) = entry_size;
+    }
+    sgt->nents = sgt->orig_nents;
+
+    return 0;
+}
+
+u16 hailo_vdma_mock_read_num_avail(struct hailo_vdma_mock *mock, u8 channel_index)
+{
+    return ioread16(mock_channel_regs(mock, channel_index, true) + CHANNEL_NUM_AVAIL_OFFSET);
+}
+
+void hailo_vdma_mock_process(struct hailo_vdma_mock *mock, u8 channel_index, u16 num_proc)
+{
+    iowrite16(num_proc, mock_channel_regs(mock, channel_index, true) + CHANNEL_NUM_PROC_OFFSET);
+}
+
+void hailo_vdma_mock_write_control(struct hailo_vdma_mock *mock, u8 channel_index, bool is_host_side, u8 control)
+{
+    iowrite8(control, mock_channel_regs(mock, channel_index, is_host_side) + CHANNEL_CONTROL_OFFSET);
+}
+
+void hailo_vdma_mock_write_error(struct hailo_vdma_mock *mock, u8 channel_index, bool is_host_side, u8 error)
+{
+    iowrite8(error, mock_channel_regs(mock, channel_index, is_host_side) + CHANNEL_ERROR_OFFSET);
+}
+
+kunit_test_suites(&hailo_vdma_common_test_suite, &hailo_vdma_memory_test_suite);
+
+MODULE_AUTHOR("Hailo Technologies Ltd.");
+MODULE_DESCRIPTION("Hailo vDMA kunit tests");
+MODULE_LICENSE("GPL v2");
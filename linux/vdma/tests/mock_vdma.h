@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * Copyright (c) 2019-2024 Hailo Technologies Ltd. All rights reserved.
+ **/
+/**
+ * Emulated vDMA engine for the kunit suites. The channel registers are plain kernel memory, so the tests play the
+ * firmware and the hw by reading and writing them directly.
+ */
+
+#ifndef _HAILO_VDMA_TESTS_MOCK_VDMA_H_
+#define _HAILO_VDMA_TESTS_MOCK_VDMA_H_
+
+#include "vdma_common.h"
+
+#include <kunit/test.h>
+#include <linux/scatterlist.h>
+
+#define MOCK_VDMA_DDR_DATA_ID               (1)
+#define MOCK_VDMA_SRC_CHANNELS_BITMASK      (0x0000FFFF)
+#define MOCK_VDMA_DESC_PAGE_SIZE            (512)
+// Fake dma addresses, never accessed. The descriptors list address must be aligned to VDMA_DESCRIPTOR_LIST_ALIGN.
+#define MOCK_VDMA_DESC_LIST_DMA_ADDRESS     (VDMA_DESCRIPTOR_LIST_ALIGN)
+#define MOCK_VDMA_BUFFER_DMA_ADDRESS        (0x10000000)
+
+struct hailo_vdma_mock {
+    struct hailo_vdma_hw hw;
+    struct hailo_resource channel_registers;
+    struct hailo_vdma_engine engine;
+    struct hailo_vdma_descriptors_list desc_list;
+};
+
+// Initializes an engine over zeroed registers with a circular descriptors list of desc_count descriptors (power of
+// two, up to 64K).
+int hailo_vdma_mock_init(struct kunit *test, struct hailo_vdma_mock *mock, u32 desc_count);
+void hailo_vdma_mock_finalize(struct hailo_vdma_mock *mock);
+
+// Enables the channel with an ongoing transfers list of the given depth (power of two), and starts both sides of the
+// channel as the driver and the firmware do.
+int hailo_vdma_mock_enable_channel(struct kunit *test, struct hailo_vdma_mock *mock, u8 channel_index, u16 depth);
+
+// Builds a dma mapped sg table of entries_count entries of entry_size bytes, contiguous in the fake dma address
+// space. Released by sg_free_table.
+int hailo_vdma_mock_sg_table(struct sg_table *sgt, unsigned int entries_count, u32 entry_size);
+
+u16 hailo_vdma_mock_read_num_avail(struct hailo_vdma_mock *mock, u8 channel_index);
+// Reports that the hw processed all descriptors before num_proc.
+void hailo_vdma_mock_process(struct hailo_vdma_mock *mock, u8 channel_index, u16 num_proc);
+// Sets the channel control byte of the host (or device) side, as the firmware does on abort or error.
+void hailo_vdma_mock_write_control(struct hailo_vdma_mock *mock, u8 channel_index, bool is_host_side, u8 control);
+// Sets the channel error byte of the host (or device) side, as the hw does on a channel error.
+void hailo_vdma_mock_write_error(struct hailo_vdma_mock *mock, u8 channel_index, bool is_host_side, u8 error);
+
+extern struct kunit_suite hailo_vdma_common_test_suite;
+extern struct kunit_suite hailo_vdma_memory_test_suite;
+
+#endif /* _HAILO_VDMA_TESTS_MOCK_VDMA_H_ */
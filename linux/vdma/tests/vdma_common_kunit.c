@@ -0,0 +1,562 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * Copyright (c) 2019-2024 Hailo Technologies Ltd. All rights reserved.
+ **/
+/**
+ * kunit suite of the common vDMA code, run over the emulated engine of mock_vdma.h. The code is included (rather
+ * than linked) to reach its static helpers.
+ */
+
+// The tracepoints are created by the driver modules, this copy of the code must not register them again.
+#define NOTRACE
+
+#include "vdma_common.c"
+
+#include "mock_vdma.h"
+
+#include <kunit/test.h>
+#include <linux/completion.h>
+#include <linux/jiffies.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+
+#define TEST_DESC_COUNT         (1024)
+#define TEST_CHANNEL            (0)
+#define TEST_DEPTH              (128)
+#define TEST_SG_ENTRY_SIZE      (4096)
+#define TEST_SG_ENTRIES_COUNT   (16)
+#define TEST_TRANSFER_SIZE      (2 * TEST_SG_ENTRY_SIZE)
+#define TEST_THROUGHPUT_TRANSFERS (100000)
+// Largest descriptors list, so num available wraps around at 16 bits.
+#define TEST_WRAPAROUND_DESC_COUNT (BIT(16))
+// Doesn't divide the list size, so transfers straddle the wraparound.
+#define TEST_WRAPAROUND_TRANSFER_DESCS (61)
+#define TEST_COMPLETION_RING_TRANSFERS (100000)
+#define TEST_COMPLETION_RING_TIMEOUT_MS (10000)
+
+struct vdma_common_test {
+    struct kunit *test;
+    struct hailo_vdma_mock mock;
+    struct sg_table sgt;
+    struct hailo_vdma_interrupts_wait_params irq_data;
+    u32 transfers_launched;
+    u32 transfers_done;
+};
+
+static struct hailo_vdma_channel *test_channel(struct vdma_common_test *ctx)
+{
+    return &ctx->mock.engine.channels[TEST_CHANNEL];
+}
+
+// Transfers must complete in launch order, each buffer opaque is the launch number of the transfer.
+static void test_transfer_done(struct hailo_ongoing_transfer *transfer, void *opaque)
+{
+    struct vdma_common_test *ctx = opaque;
+
+    KUNIT_EXPECT_PTR_EQ(ctx->test, transfer->buffers[0].opaque, (void *)(uintptr_t)ctx->transfers_done);
+    ctx->transfers_done++;
+}
+
+static struct hailo_vdma_mapped_transfer_buffer test_buffer(struct vdma_common_test *ctx, u32 size)
+{
+    struct hailo_vdma_mapped_transfer_buffer buffer = {
+        .sg_table = &ctx->sgt,
+        .size = size,
+        .offset = 0,
+        .opaque = (void *)(uintptr_t)ctx->transfers_launched,
+    };
+    return buffer;
+}
+
+static int launch(struct vdma_common_test *ctx, u32 size)
+{
+    struct hailo_vdma_channel *channel = test_channel(ctx);
+    struct hailo_vdma_mapped_transfer_buffer buffer = test_buffer(ctx, size);
+    int ret = hailo_vdma_launch_transfer(&ctx->mock.hw, channel, &ctx->mock.desc_list, channel->state.num_avail, 1,
+        &buffer, true, HAILO_VDMA_INTERRUPTS_DOMAIN_NONE, HAILO_VDMA_INTERRUPTS_DOMAIN_HOST, false);
+    if (ret >= 0) {
+        ctx->transfers_launched++;
+    }
+    return ret;
+}
+
+// Same as launch, without ringing the doorbell.
+static int prepare(struct vdma_common_test *ctx, u32 size, bool validate_hw_state)
+{
+    struct hailo_vdma_channel *channel = test_channel(ctx);
+    struct hailo_vdma_mapped_transfer_buffer buffer = test_buffer(ctx, size);
+    int ret = hailo_vdma_prepare_transfer(&ctx->mock.hw, channel, &ctx->mock.desc_list, channel->state.num_avail, 1,
+        &buffer, true, HAILO_VDMA_INTERRUPTS_DOMAIN_NONE, HAILO_VDMA_INTERRUPTS_DOMAIN_HOST, false,
+        validate_hw_state);
+    if (ret >= 0) {
+        ctx->transfers_launched++;
+    }
+    return ret;
+}
+
+// Lets the hw process all launched descriptors, as the interrupt handler sees it.
+static void process_all(struct vdma_common_test *ctx)
+{
+    hailo_vdma_mock_process(&ctx->mock, TEST_CHANNEL, test_channel(ctx)->state.num_avail);
+    hailo_vdma_engine_push_timestamps(&ctx->mock.engine, BIT(TEST_CHANNEL));
+}
+
+// Completes the processed transfers of the test channel, returns its irq data.
+static struct hailo_vdma_interrupts_channel_data *fill_irq_data(struct vdma_common_test *ctx)
+{
+    struct kunit *test = ctx->test;
+
+    memset(&ctx->irq_data, 0, sizeof(ctx->irq_data));
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_engine_fill_irq_data(&ctx->irq_data, &ctx->mock.engine, BIT(TEST_CHANNEL),
+        test_transfer_done, ctx, true));
+    KUNIT_ASSERT_EQ(test, (u8)1, ctx->irq_data.channels_count);
+    return &ctx->irq_data.irq_data[0];
+}
+
+static int vdma_common_test_init(struct kunit *test)
+{
+    struct vdma_common_test *ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+    int err = 0;
+
+    if (NULL == ctx) {
+        return -ENOMEM;
+    }
+    ctx->test = test;
+
+    err = hailo_vdma_mock_init(test, &ctx->mock, TEST_DESC_COUNT);
+    if (err < 0) {
+        return err;
+    }
+
+    err = hailo_vdma_mock_sg_table(&ctx->sgt, TEST_SG_ENTRIES_COUNT, TEST_SG_ENTRY_SIZE);
+    if (err < 0) {
+        hailo_vdma_mock_finalize(&ctx->mock);
+        return err;
+    }
+
+    test->priv = ctx;
+    return 0;
+}
+
+static void vdma_common_test_exit(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+
+    sg_free_table(&ctx->sgt);
+    hailo_vdma_mock_finalize(&ctx->mock);
+}
+
+static void launch_complete_test(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+    struct hailo_vdma_channel *channel = test_channel(ctx);
+    // Ends with a partial descriptor.
+    const u32 size = TEST_TRANSFER_SIZE + MOCK_VDMA_DESC_PAGE_SIZE / 2;
+    const u32 descs_count = DIV_ROUND_UP(size, MOCK_VDMA_DESC_PAGE_SIZE);
+    struct hailo_vdma_descriptor *last_desc = &ctx->mock.desc_list.desc_list[descs_count - 1];
+    struct hailo_vdma_interrupts_channel_data *irq_data = NULL;
+
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_enable_channel(test, &ctx->mock, TEST_CHANNEL, TEST_DEPTH));
+
+    KUNIT_ASSERT_EQ(test, (int)descs_count, launch(ctx, size));
+    KUNIT_EXPECT_EQ(test, (u16)descs_count, hailo_vdma_mock_read_num_avail(&ctx->mock, TEST_CHANNEL));
+    KUNIT_EXPECT_EQ(test, (u32)(MOCK_VDMA_DESC_PAGE_SIZE / 2),
+        last_desc->PageSize_DescControl >> DESCRIPTOR_PAGE_SIZE_SHIFT);
+    KUNIT_EXPECT_NE(test, 0UL, last_desc->PageSize_DescControl & ctx->mock.hw.host_interrupts_bitmask);
+
+    // Nothing processed yet.
+    irq_data = fill_irq_data(ctx);
+    KUNIT_EXPECT_EQ(test, (u8)0, irq_data->transfers_completed);
+    KUNIT_EXPECT_EQ(test, 0U, ctx->transfers_done);
+
+    process_all(ctx);
+    irq_data = fill_irq_data(ctx);
+    KUNIT_EXPECT_EQ(test, (u8)0, irq_data->engine_index);
+    KUNIT_EXPECT_EQ(test, (u8)TEST_CHANNEL, irq_data->channel_index);
+    KUNIT_EXPECT_TRUE(test, irq_data->is_active);
+    KUNIT_EXPECT_EQ(test, (u8)1, irq_data->transfers_completed);
+    KUNIT_EXPECT_EQ(test, (u8)0, irq_data->host_error);
+    KUNIT_EXPECT_EQ(test, (u8)0, irq_data->device_error);
+    KUNIT_EXPECT_TRUE(test, irq_data->validation_success);
+    KUNIT_EXPECT_EQ(test, 1U, ctx->transfers_done);
+
+    // The dirty last descriptor is restored for the next transfers.
+    KUNIT_EXPECT_EQ(test, (u32)((MOCK_VDMA_DESC_PAGE_SIZE << DESCRIPTOR_PAGE_SIZE_SHIFT) + DESCRIPTOR_DESC_CONTROL),
+        last_desc->PageSize_DescControl);
+
+    KUNIT_EXPECT_EQ(test, 1ULL, channel->stats.transfers_launched);
+    KUNIT_EXPECT_EQ(test, (u64)size, channel->stats.bytes_launched);
+    KUNIT_EXPECT_EQ(test, (u64)descs_count, channel->stats.descs_programmed);
+    KUNIT_EXPECT_EQ(test, 1ULL, channel->stats.transfers_completed);
+}
+
+// Launches transfers until the ongoing transfers list is full, and completes all of them with a single interrupt.
+static void launch_complete_batch_test(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+    const u32 transfers_count = TEST_DEPTH - 1;
+    u32 i = 0;
+
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_enable_channel(test, &ctx->mock, TEST_CHANNEL, TEST_DEPTH));
+
+    for (i = 0; i < transfers_count; i++) {
+        KUNIT_ASSERT_LT(test, 0, launch(ctx, MOCK_VDMA_DESC_PAGE_SIZE));
+    }
+    KUNIT_EXPECT_GT(test, 0, launch(ctx, MOCK_VDMA_DESC_PAGE_SIZE));
+    KUNIT_EXPECT_EQ(test, 1ULL, test_channel(ctx)->stats.launch_failures);
+
+    process_all(ctx);
+    KUNIT_EXPECT_EQ(test, (u8)transfers_count, fill_irq_data(ctx)->transfers_completed);
+    KUNIT_EXPECT_EQ(test, transfers_count, ctx->transfers_done);
+}
+
+// Measures the launch to completion path, one transfer at a time (the hw processes each transfer right away).
+static void launch_complete_throughput_test(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+    struct hailo_vdma_channel *channel = test_channel(ctx);
+    u64 start_ns = 0, elapsed_ns = 0, histogram_total = 0;
+    u32 i = 0;
+
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_enable_channel(test, &ctx->mock, TEST_CHANNEL, TEST_DEPTH));
+
+    start_ns = ktime_get_ns();
+    for (i = 0; i < TEST_THROUGHPUT_TRANSFERS; i++) {
+        KUNIT_ASSERT_LT(test, 0, launch(ctx, TEST_TRANSFER_SIZE));
+        process_all(ctx);
+        KUNIT_ASSERT_EQ(test, (u8)1, fill_irq_data(ctx)->transfers_completed);
+    }
+    elapsed_ns = ktime_get_ns() - start_ns;
+
+    KUNIT_EXPECT_EQ(test, (u32)TEST_THROUGHPUT_TRANSFERS, ctx->transfers_done);
+    for (i = 0; i < HAILO_VDMA_LATENCY_HISTOGRAM_BUCKETS; i++) {
+        histogram_total += channel->stats.latency_histogram[i];
+    }
+    KUNIT_EXPECT_EQ(test, (u64)TEST_THROUGHPUT_TRANSFERS, histogram_total);
+
+    kunit_info(test, "%u transfers of %u bytes, %llu ns per launch to completion\n", (u32)TEST_THROUGHPUT_TRANSFERS,
+        (u32)TEST_TRANSFER_SIZE, div_u64(elapsed_ns, TEST_THROUGHPUT_TRANSFERS));
+    kunit_info(test, "latency under 1us: %llu, 1-2us: %llu, 2-4us: %llu, longer: %llu\n",
+        channel->stats.latency_histogram[0], channel->stats.latency_histogram[1],
+        channel->stats.latency_histogram[2],
+        histogram_total - channel->stats.latency_histogram[0] - channel->stats.latency_histogram[1] -
+            channel->stats.latency_histogram[2]);
+}
+
+// Low half-word of the channel register word, the control and depth/data id bytes.
+static u16 read_control_depth(struct vdma_common_test *ctx)
+{
+    return (u16)(ioread32(test_channel(ctx)->host_regs) & 0xFFFF);
+}
+
+// The doorbell must keep the num available shadow equal to the hw value and leave the rest of the register word
+// untouched, across the 16-bit wraparound of num available.
+static void doorbell_num_avail_wraparound_test(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+    struct hailo_vdma_channel *channel = test_channel(ctx);
+    const u32 transfer_size = TEST_WRAPAROUND_TRANSFER_DESCS * MOCK_VDMA_DESC_PAGE_SIZE;
+    const u32 transfers_count = 2 * DIV_ROUND_UP(TEST_WRAPAROUND_DESC_COUNT, TEST_WRAPAROUND_TRANSFER_DESCS);
+    u16 control_depth = 0, last_num_avail = 0;
+    u32 wraparounds = 0, i = 0;
+
+    hailo_vdma_mock_finalize(&ctx->mock);
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_init(test, &ctx->mock, TEST_WRAPAROUND_DESC_COUNT));
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_enable_channel(test, &ctx->mock, TEST_CHANNEL, TEST_DEPTH));
+    control_depth = read_control_depth(ctx);
+
+    for (i = 0; i < transfers_count; i++) {
+        KUNIT_ASSERT_EQ(test, TEST_WRAPAROUND_TRANSFER_DESCS, launch(ctx, transfer_size));
+        KUNIT_ASSERT_EQ(test, channel->state.num_avail, hailo_vdma_mock_read_num_avail(&ctx->mock, TEST_CHANNEL));
+        KUNIT_ASSERT_EQ(test, channel->state.num_avail, channel->state.hw_num_avail);
+        KUNIT_ASSERT_EQ(test, control_depth, read_control_depth(ctx));
+        KUNIT_ASSERT_FALSE(test, channel->state.regs_value_valid);
+
+        if (channel->state.num_avail < last_num_avail) {
+            wraparounds++;
+        }
+        last_num_avail = channel->state.num_avail;
+
+        process_all(ctx);
+        KUNIT_ASSERT_EQ(test, (u8)1, fill_irq_data(ctx)->transfers_completed);
+    }
+
+    KUNIT_EXPECT_EQ(test, 2U, wraparounds);
+    KUNIT_EXPECT_EQ(test, transfers_count, ctx->transfers_done);
+}
+
+// A batch rings the doorbell after several prepared transfers, so the register word read by the validation of the
+// first one may be stale. The doorbell must read it again, keeping the firmware updates done meanwhile.
+static void doorbell_batch_rereads_register_test(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+    struct hailo_vdma_channel *channel = test_channel(ctx);
+    const u32 transfer_descs = TEST_TRANSFER_SIZE / MOCK_VDMA_DESC_PAGE_SIZE;
+    u8 control = 0;
+
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_enable_channel(test, &ctx->mock, TEST_CHANNEL, TEST_DEPTH));
+    // Sets control bits other than start/abort, the channel stays active.
+    control = ioread8(channel->host_regs + CHANNEL_CONTROL_OFFSET) | VDMA_CHANNEL_CONTROL_MASK;
+
+    KUNIT_ASSERT_EQ(test, (int)transfer_descs, prepare(ctx, TEST_TRANSFER_SIZE, true));
+    KUNIT_EXPECT_TRUE(test, channel->state.regs_value_valid);
+    hailo_vdma_mock_write_control(&ctx->mock, TEST_CHANNEL, true, control);
+    KUNIT_ASSERT_EQ(test, (int)transfer_descs, prepare(ctx, TEST_TRANSFER_SIZE, false));
+    KUNIT_EXPECT_FALSE(test, channel->state.regs_value_valid);
+    // Nothing is written before the doorbell.
+    KUNIT_EXPECT_EQ(test, (u16)0, hailo_vdma_mock_read_num_avail(&ctx->mock, TEST_CHANNEL));
+
+    hailo_vdma_channel_ring_doorbell(channel);
+    KUNIT_EXPECT_EQ(test, (u16)(2 * transfer_descs), hailo_vdma_mock_read_num_avail(&ctx->mock, TEST_CHANNEL));
+    KUNIT_EXPECT_EQ(test, (u16)(2 * transfer_descs), channel->state.hw_num_avail);
+    KUNIT_EXPECT_EQ(test, control, ioread8(channel->host_regs + CHANNEL_CONTROL_OFFSET));
+}
+
+static bool push_completion(struct vdma_common_test *ctx, struct hailo_vdma_completion_ring *ring, u32 *head)
+{
+    return hailo_vdma_channel_push_completion(ring, head, &ctx->mock.engine, test_channel(ctx), test_transfer_done,
+        ctx);
+}
+
+// Reads (and consumes) the ring entries as user space does, returns the amount of transfers they report.
+static u32 consume_completions(struct kunit *test, struct hailo_vdma_completion_ring *ring)
+{
+    const u32 head = smp_load_acquire(&ring->head);
+    u32 tail = ring->tail;
+    u32 transfers_completed = 0;
+
+    for (; tail != head; tail = (tail + 1) & HAILO_VDMA_COMPLETION_RING_ENTRIES_MASK) {
+        KUNIT_EXPECT_EQ(test, (u8)TEST_CHANNEL, ring->entries[tail].channel_index);
+        KUNIT_EXPECT_TRUE(test, ring->entries[tail].is_active);
+        transfers_completed += ring->entries[tail].transfers_completed;
+    }
+
+    // The entries must be read before they are released to the driver.
+    smp_store_release(&ring->tail, tail);
+    return transfers_completed;
+}
+
+// A full ring leaves the channel transfers ongoing, until user space consumes an entry.
+static void completion_ring_full_test(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+    struct hailo_vdma_completion_ring *ring = kunit_kzalloc(test, sizeof(*ring), GFP_KERNEL);
+    u32 head = 0, i = 0;
+
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ring);
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_enable_channel(test, &ctx->mock, TEST_CHANNEL, TEST_DEPTH));
+
+    for (i = 0; i < HAILO_VDMA_COMPLETION_RING_ENTRIES - 1; i++) {
+        KUNIT_ASSERT_LT(test, 0, launch(ctx, TEST_TRANSFER_SIZE));
+        process_all(ctx);
+        KUNIT_ASSERT_TRUE(test, push_completion(ctx, ring, &head));
+    }
+    KUNIT_EXPECT_EQ(test, (u32)(HAILO_VDMA_COMPLETION_RING_ENTRIES - 1), ctx->transfers_done);
+
+    KUNIT_ASSERT_LT(test, 0, launch(ctx, TEST_TRANSFER_SIZE));
+    process_all(ctx);
+    KUNIT_EXPECT_FALSE(test, push_completion(ctx, ring, &head));
+    KUNIT_EXPECT_EQ(test, (u32)(HAILO_VDMA_COMPLETION_RING_ENTRIES - 1), ctx->transfers_done);
+
+    KUNIT_EXPECT_EQ(test, (u32)(HAILO_VDMA_COMPLETION_RING_ENTRIES - 1), consume_completions(test, ring));
+    KUNIT_EXPECT_TRUE(test, push_completion(ctx, ring, &head));
+    KUNIT_EXPECT_EQ(test, (u32)HAILO_VDMA_COMPLETION_RING_ENTRIES, ctx->transfers_done);
+    KUNIT_EXPECT_EQ(test, 1U, consume_completions(test, ring));
+}
+
+struct completion_ring_producer {
+    struct vdma_common_test *ctx;
+    struct hailo_vdma_completion_ring *ring;
+    bool should_stop;
+    int err;
+    struct completion done;
+};
+
+// Launches and completes transfers one by one, waiting for ring space as needed. The completion work of the driver
+// pushes to the ring the same way.
+static int completion_ring_produce(void *data)
+{
+    struct completion_ring_producer *producer = data;
+    u32 head = 0, i = 0;
+    int err = 0;
+
+    for (i = 0; (i < TEST_COMPLETION_RING_TRANSFERS) && (0 == err); i++) {
+        err = launch(producer->ctx, TEST_TRANSFER_SIZE);
+        if (err < 0) {
+            break;
+        }
+        err = 0;
+        process_all(producer->ctx);
+
+        while (!push_completion(producer->ctx, producer->ring, &head)) {
+            if (READ_ONCE(producer->should_stop)) {
+                err = -EINTR;
+                break;
+            }
+            cond_resched();
+        }
+    }
+
+    producer->err = err;
+    // The producer memory is released once done is completed.
+    complete(&producer->done);
+    return 0;
+}
+
+// Runs the driver side (producer) and the user side (consumer) of a completion ring concurrently. The consumer must
+// see every completed transfer exactly once, so no entry may be overwritten before it is consumed.
+static void completion_ring_producer_consumer_test(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+    struct completion_ring_producer *producer = kunit_kzalloc(test, sizeof(*producer), GFP_KERNEL);
+    const unsigned long timeout = jiffies + msecs_to_jiffies(TEST_COMPLETION_RING_TIMEOUT_MS);
+    struct task_struct *task = NULL;
+    u32 transfers_consumed = 0;
+
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, producer);
+    producer->ring = kunit_kzalloc(test, sizeof(*producer->ring), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, producer->ring);
+    producer->ctx = ctx;
+    init_completion(&producer->done);
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_enable_channel(test, &ctx->mock, TEST_CHANNEL, TEST_DEPTH));
+
+    task = kthread_run(completion_ring_produce, producer, "hailo_vdma_kunit_producer");
+    KUNIT_ASSERT_FALSE(test, IS_ERR(task));
+
+    while ((transfers_consumed < TEST_COMPLETION_RING_TRANSFERS) && time_before(jiffies, timeout)) {
+        transfers_consumed += consume_completions(test, producer->ring);
+        cond_resched();
+    }
+
+    WRITE_ONCE(producer->should_stop, true);
+    wait_for_completion(&producer->done);
+    transfers_consumed += consume_completions(test, producer->ring);
+
+    KUNIT_EXPECT_EQ(test, 0, producer->err);
+    KUNIT_EXPECT_EQ(test, (u32)TEST_COMPLETION_RING_TRANSFERS, transfers_consumed);
+    KUNIT_EXPECT_EQ(test, (u32)TEST_COMPLETION_RING_TRANSFERS, ctx->transfers_done);
+}
+
+// An interrupt completing no transfer is counted as a spurious wakeup, only by the callers asking for it.
+static void spurious_wakeups_stats_test(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+    struct hailo_vdma_channel *channel = test_channel(ctx);
+
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_enable_channel(test, &ctx->mock, TEST_CHANNEL, TEST_DEPTH));
+    KUNIT_ASSERT_LT(test, 0, launch(ctx, TEST_TRANSFER_SIZE));
+
+    KUNIT_EXPECT_EQ(test, (u8)0, fill_irq_data(ctx)->transfers_completed);
+    KUNIT_EXPECT_EQ(test, 1ULL, channel->stats.spurious_wakeups);
+
+    memset(&ctx->irq_data, 0, sizeof(ctx->irq_data));
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_engine_fill_irq_data(&ctx->irq_data, &ctx->mock.engine, BIT(TEST_CHANNEL),
+        test_transfer_done, ctx, false));
+    KUNIT_EXPECT_EQ(test, (u8)0, ctx->irq_data.irq_data[0].transfers_completed);
+    KUNIT_EXPECT_EQ(test, 1ULL, channel->stats.spurious_wakeups);
+
+    process_all(ctx);
+    KUNIT_EXPECT_EQ(test, (u8)1, fill_irq_data(ctx)->transfers_completed);
+    KUNIT_EXPECT_EQ(test, 1ULL, channel->stats.spurious_wakeups);
+    KUNIT_EXPECT_EQ(test, 1ULL, channel->stats.transfers_completed);
+}
+
+#define TEST_HOST_ERROR     (0x5)
+#define TEST_DEVICE_ERROR   (0x7)
+
+// The error registers are read only once the channel is stopped, the errors of an active channel are reported as 0.
+static void error_registers_read_when_inactive_test(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+    struct hailo_vdma_interrupts_channel_data *irq_data = NULL;
+    int first_transfer_descs = 0;
+
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_enable_channel(test, &ctx->mock, TEST_CHANNEL, TEST_DEPTH));
+    first_transfer_descs = launch(ctx, TEST_TRANSFER_SIZE);
+    KUNIT_ASSERT_LT(test, 0, first_transfer_descs);
+    KUNIT_ASSERT_LT(test, 0, launch(ctx, TEST_TRANSFER_SIZE));
+    hailo_vdma_mock_write_error(&ctx->mock, TEST_CHANNEL, true, TEST_HOST_ERROR);
+    hailo_vdma_mock_write_error(&ctx->mock, TEST_CHANNEL, false, TEST_DEVICE_ERROR);
+
+    hailo_vdma_mock_process(&ctx->mock, TEST_CHANNEL, (u16)first_transfer_descs);
+    hailo_vdma_engine_push_timestamps(&ctx->mock.engine, BIT(TEST_CHANNEL));
+    irq_data = fill_irq_data(ctx);
+    KUNIT_EXPECT_TRUE(test, irq_data->is_active);
+    KUNIT_EXPECT_EQ(test, (u8)1, irq_data->transfers_completed);
+    KUNIT_EXPECT_EQ(test, (u8)0, irq_data->host_error);
+    KUNIT_EXPECT_EQ(test, (u8)0, irq_data->device_error);
+
+    // The firmware stops the device side of the channel.
+    hailo_vdma_mock_write_control(&ctx->mock, TEST_CHANNEL, false, 0);
+    process_all(ctx);
+    irq_data = fill_irq_data(ctx);
+    KUNIT_EXPECT_FALSE(test, irq_data->is_active);
+    KUNIT_EXPECT_EQ(test, (u8)1, irq_data->transfers_completed);
+    KUNIT_EXPECT_EQ(test, (u8)TEST_HOST_ERROR, irq_data->host_error);
+    KUNIT_EXPECT_EQ(test, (u8)TEST_DEVICE_ERROR, irq_data->device_error);
+}
+
+// Ongoing transfers list depths other than the default (TEST_DEPTH), up to the max.
+static const u16 ongoing_transfers_depths[] = { 2, 16, 64, HAILO_VDMA_MAX_ONGOING_TRANSFERS_DEPTH };
+
+static void ongoing_transfers_depth_desc(const u16 *depth, char *desc)
+{
+    snprintf(desc, KUNIT_PARAM_DESC_SIZE, "depth %u", *depth);
+}
+
+KUNIT_ARRAY_PARAM(ongoing_transfers_depth, ongoing_transfers_depths, ongoing_transfers_depth_desc);
+
+// Launches and completes batches of all sizes the list can hold, so its head and tail wrap around many times at
+// different positions. A batch filling the list must be completed in order, and the next launch must fail.
+static void ongoing_transfers_wraparound_test(struct kunit *test)
+{
+    struct vdma_common_test *ctx = test->priv;
+    struct hailo_vdma_channel *channel = test_channel(ctx);
+    const u16 depth = *(const u16 *)test->param_value;
+    const u32 max_batch = depth - 1;
+    u32 round = 0, batch = 0, i = 0;
+
+    KUNIT_ASSERT_EQ(test, 0, hailo_vdma_mock_enable_channel(test, &ctx->mock, TEST_CHANNEL, depth));
+
+    for (round = 0; round < 2 * depth; round++) {
+        batch = 1 + (round % max_batch);
+        for (i = 0; i < batch; i++) {
+            KUNIT_ASSERT_LT(test, 0, launch(ctx, MOCK_VDMA_DESC_PAGE_SIZE));
+        }
+        KUNIT_ASSERT_EQ(test, (int)batch, (int)ONGOING_TRANSFERS_CIRC_CNT(channel->ongoing_transfers));
+        if (batch == max_batch) {
+            KUNIT_EXPECT_GT(test, 0, launch(ctx, MOCK_VDMA_DESC_PAGE_SIZE));
+        }
+
+        process_all(ctx);
+        KUNIT_ASSERT_EQ(test, (u8)batch, fill_irq_data(ctx)->transfers_completed);
+        KUNIT_ASSERT_EQ(test, 0, (int)ONGOING_TRANSFERS_CIRC_CNT(channel->ongoing_transfers));
+    }
+
+    KUNIT_EXPECT_EQ(test, ctx->transfers_launched, ctx->transfers_done);
+    KUNIT_EXPECT_EQ(test, channel->ongoing_transfers.head, channel->ongoing_transfers.tail);
+    KUNIT_EXPECT_LT(test, channel->ongoing_transfers.head, (unsigned long)depth);
+}
+
+static struct kunit_case vdma_common_test_cases[] = {
+    KUNIT_CASE(launch_complete_test),
+    KUNIT_CASE(launch_complete_batch_test),
+    KUNIT_CASE(launch_complete_throughput_test),
+    KUNIT_CASE(doorbell_num_avail_wraparound_test),
+    KUNIT_CASE(doorbell_batch_rereads_register_test),
+    KUNIT_CASE(completion_ring_full_test),
+    KUNIT_CASE(completion_ring_producer_consumer_test),
+    KUNIT_CASE_PARAM(ongoing_transfers_wraparound_test, ongoing_transfers_depth_gen_params),
+    KUNIT_CASE(spurious_wakeups_stats_test),
+    KUNIT_CASE(error_registers_read_when_inactive_test),
+    {}
+};
+
+struct kunit_suite hailo_vdma_common_test_suite = {
+    .name = "hailo_vdma_common",
+    .init = vdma_common_test_init,
+    .exit = vdma_common_test_exit,
+    .test_cases = vdma_common_test_cases,
+};
@@ -10,8 +10,11 @@
 #include "ioctl.h"
 #include "utils/logs.h"
 
+#include <linux/log2.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
 #include <linux/version.h>
+#include <linux/vmalloc.h>
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
 #include <linux/dma-map-ops.h>
@@ -19,6 +22,26 @@
 #include <linux/dma-mapping.h>
 #endif
 
+static bool force_dma_sync = false;
+module_param(force_dma_sync, bool, S_IRUGO);
+MODULE_PARM_DESC(force_dma_sync, "Sync vDMA buffers even when the device dma is coherent");
+
+static uint max_ongoing_transfers = HAILO_VDMA_MAX_ONGOING_TRANSFERS;
+module_param(max_ongoing_transfers, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(max_ongoing_transfers, "Size of the ongoing transfers list of each vDMA channel, applied when the "
+    "channel is enabled. Power of two, up to 256 (default: 128)");
+
+static void completion_work(struct work_struct *work);
+
+static bool is_dma_coherent(struct device *dev)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+    return dev_is_dma_coherent(dev);
+#else
+    // Can't be queried, assume the buffers must be synced.
+    return false;
+#endif
+}
 
 static struct hailo_vdma_engine* init_vdma_engines(struct device *dev,
     struct hailo_resource *channel_registers_per_engine, size_t engines_count, u32 src_channels_bitmask)
@@ -67,6 +90,8 @@ int hailo_vdma_controller_init(struct hailo_vdma_controller *controller,
     struct hailo_resource *channel_registers_per_engine, size_t engines_count)
 {
     int err = 0;
+    size_t engine_index = 0;
+    u8 channel_index = 0;
     controller->hw = vdma_hw;
     controller->ops = ops;
     controller->dev = dev;
@@ -80,8 +105,27 @@ int hailo_vdma_controller_init(struct hailo_vdma_controller *controller,
     }
 
     controller->used_by_filp = NULL;
+    init_rwsem(&controller->inflight_lock);
+    controller->is_removed = false;
+    atomic64_set(&controller->buffer_cache_stats.hits, 0);
+    atomic64_set(&controller->buffer_cache_stats.misses, 0);
+    atomic64_set(&controller->buffer_cache_stats.invalidations, 0);
+    atomic64_set(&controller->buffer_cache_stats.evictions, 0);
+    atomic64_set(&controller->dmabuf_cache_stats.hits, 0);
+    atomic64_set(&controller->dmabuf_cache_stats.misses, 0);
+    atomic64_set(&controller->dmabuf_cache_stats.invalidations, 0);
+    atomic64_set(&controller->dmabuf_cache_stats.evictions, 0);
+    memset(controller->completion_rings, 0, sizeof(controller->completion_rings));
+    memset(controller->completion_pending_channels, 0, sizeof(controller->completion_pending_channels));
+    INIT_WORK(&controller->completion_work, completion_work);
     spin_lock_init(&controller->interrupts_lock);
-    init_waitqueue_head(&controller->interrupts_wq);
+    for (engine_index = 0; engine_index < MAX_VDMA_ENGINES; engine_index++) {
+        for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE; channel_index++) {
+            spin_lock_init(hailo_vdma_channel_lock(controller, engine_index, channel_index));
+            mutex_init(hailo_vdma_channel_launch_lock(controller, engine_index, channel_index));
+        }
+    }
+    INIT_LIST_HEAD(&controller->interrupts_waiters);
 
     /* Check and configure DMA length */
     err = hailo_set_dma_mask(dev);
@@ -89,22 +133,66 @@ int hailo_vdma_controller_init(struct hailo_vdma_controller *controller,
         return err;
     }
 
+    // The default max segment size (64KB for pci devices) splits contiguous memory into many sg entries.
+    if (NULL != dev->dma_parms) {
+        dma_set_max_seg_size(dev, HAILO_VDMA_MAX_SEGMENT_SIZE);
+    }
+
     if (get_dma_ops(controller->dev)) {
         hailo_dev_notice(controller->dev, "Probing: Using specialized dma_ops=%ps", get_dma_ops(controller->dev));
     }
 
+    controller->dma_coherent = is_dma_coherent(dev);
+    controller->force_dma_sync = force_dma_sync;
+    hailo_dev_notice(controller->dev, "Probing: dma %s coherent%s\n", controller->dma_coherent ? "is" : "is not",
+        (controller->dma_coherent && controller->force_dma_sync) ? ", buffers syncs are forced" : "");
+
+    // Allocates from the device, so must be initialized after the dma mask is set.
+    hailo_desc_list_pool_init(&controller->desc_list_pool, dev);
+
     return 0;
 }
 
-void hailo_vdma_file_context_init(struct hailo_vdma_file_context *context)
+void hailo_vdma_controller_disconnect(struct hailo_vdma_controller *controller)
 {
+    struct hailo_vdma_interrupts_waiter *waiter = NULL;
+    unsigned long irq_saved_flags = 0;
+
+    // Interrupt waiters may block forever, so they are woken up (and see is_removed) before draining.
+    spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
+    WRITE_ONCE(controller->is_removed, true);
+    list_for_each_entry(waiter, &controller->interrupts_waiters, waiters_list) {
+        wake_up_interruptible(&waiter->wq);
+    }
+    spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+
+    down_write(&controller->inflight_lock);
+    up_write(&controller->inflight_lock);
+}
+
+void hailo_vdma_controller_finalize(struct hailo_vdma_controller *controller)
+{
+    cancel_work_sync(&controller->completion_work);
+    hailo_vdma_buffer_flush_deferred_puts();
+    hailo_desc_list_pool_finalize(&controller->desc_list_pool, controller->dev);
+}
+
+void hailo_vdma_file_context_init(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller)
+{
+    mutex_init(&context->lock);
+
     atomic_set(&context->last_vdma_user_buffer_handle, 0);
-    INIT_LIST_HEAD(&context->mapped_user_buffer_list);
+    xa_init(&context->mapped_user_buffers);
+    hailo_dmabuf_cache_init(&context->dmabuf_cache, &controller->dmabuf_cache_stats);
+    hailo_vdma_buffer_cache_init(&context->buffer_cache, &controller->buffer_cache_stats,
+        &context->dmabuf_cache);
 
     atomic_set(&context->last_vdma_handle, 0);
-    INIT_LIST_HEAD(&context->descriptors_buffer_list);
-    INIT_LIST_HEAD(&context->vdma_low_memory_buffer_list);
-    INIT_LIST_HEAD(&context->continuous_buffer_list);
+    xa_init(&context->descriptors_buffers);
+    xa_init(&context->vdma_low_memory_buffers);
+    xa_init(&context->continuous_buffers);
+    context->completion_ring = NULL;
 
     BUILD_BUG_ON_MSG(MAX_VDMA_CHANNELS_PER_ENGINE > sizeof(context->enabled_channels_bitmap[0]) * BITS_IN_BYTE,
         "Unexpected amount of VDMA channels per engine");
@@ -117,6 +205,156 @@ void hailo_vdma_update_interrupts_mask(struct hailo_vdma_controller *controller,
     controller->ops->update_channel_interrupts(controller, engine_index, engine->enabled_channels);
 }
 
+void hailo_vdma_detach_completion_ring(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap)
+{
+    u8 channel_index = 0;
+
+    for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE; channel_index++) {
+        if (hailo_test_bit(channel_index, &channels_bitmap)) {
+            controller->completion_rings[engine_index][channel_index] = NULL;
+        }
+    }
+}
+
+static u16 get_ongoing_transfers_depth(struct hailo_vdma_controller *controller)
+{
+    const uint depth = READ_ONCE(max_ongoing_transfers);
+
+    if ((depth < 2) || (depth > HAILO_VDMA_MAX_ONGOING_TRANSFERS_DEPTH) || !is_power_of_2(depth)) {
+        hailo_dev_warn(controller->dev, "Invalid max_ongoing_transfers %u, using %u\n", depth,
+            HAILO_VDMA_MAX_ONGOING_TRANSFERS);
+        return HAILO_VDMA_MAX_ONGOING_TRANSFERS;
+    }
+
+    return (u16)depth;
+}
+
+int hailo_vdma_alloc_engine_ongoing_transfers(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap)
+{
+    struct hailo_vdma_engine *engine = &controller->vdma_engines[engine_index];
+    struct hailo_ongoing_transfer *transfers = NULL;
+    const u16 depth = get_ongoing_transfers_depth(controller);
+    spinlock_t *channel_lock = NULL;
+    unsigned long irq_saved_flags = 0;
+    u8 channel_index = 0;
+
+    for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE; channel_index++) {
+        if (!hailo_test_bit(channel_index, &channels_bitmap)) {
+            continue;
+        }
+
+        transfers = kvmalloc_array(depth, sizeof(*transfers), GFP_KERNEL);
+        if (NULL == transfers) {
+            hailo_dev_err(controller->dev, "Failed allocating ongoing transfers for channel %u\n", channel_index);
+            hailo_vdma_free_engine_ongoing_transfers(controller, engine_index,
+                channels_bitmap & (BIT(channel_index) - 1));
+            return -ENOMEM;
+        }
+
+        channel_lock = hailo_vdma_channel_lock(controller, engine_index, channel_index);
+        spin_lock_irqsave(channel_lock, irq_saved_flags);
+        engine->channels[channel_index].ongoing_transfers.head = 0;
+        engine->channels[channel_index].ongoing_transfers.tail = 0;
+        engine->channels[channel_index].ongoing_transfers.size = depth;
+        engine->channels[channel_index].ongoing_transfers.transfers = transfers;
+        spin_unlock_irqrestore(channel_lock, irq_saved_flags);
+    }
+
+    return 0;
+}
+
+void hailo_vdma_free_engine_ongoing_transfers(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap)
+{
+    struct hailo_vdma_engine *engine = &controller->vdma_engines[engine_index];
+    struct hailo_ongoing_transfer *transfers = NULL;
+    spinlock_t *channel_lock = NULL;
+    unsigned long irq_saved_flags = 0;
+    u8 channel_index = 0;
+
+    for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE; channel_index++) {
+        if (!hailo_test_bit(channel_index, &channels_bitmap)) {
+            continue;
+        }
+
+        channel_lock = hailo_vdma_channel_lock(controller, engine_index, channel_index);
+        spin_lock_irqsave(channel_lock, irq_saved_flags);
+        transfers = engine->channels[channel_index].ongoing_transfers.transfers;
+        engine->channels[channel_index].ongoing_transfers.transfers = NULL;
+        engine->channels[channel_index].ongoing_transfers.size = 0;
+        engine->channels[channel_index].ongoing_transfers.head = 0;
+        engine->channels[channel_index].ongoing_transfers.tail = 0;
+        spin_unlock_irqrestore(channel_lock, irq_saved_flags);
+
+        kvfree(transfers);
+    }
+}
+
+void hailo_vdma_disable_engine_channels(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap)
+{
+    struct hailo_vdma_engine *engine = &controller->vdma_engines[engine_index];
+    spinlock_t *channel_lock = NULL;
+    unsigned long irq_saved_flags = 0;
+    u8 channel_index = 0;
+
+    spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
+    hailo_vdma_detach_completion_ring(controller, engine_index, channels_bitmap);
+    spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+
+    // Transfers may be launched or completed concurrently, so each channel is disabled under its lock.
+    for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE; channel_index++) {
+        if (hailo_test_bit(channel_index, &channels_bitmap)) {
+            channel_lock = hailo_vdma_channel_lock(controller, engine_index, channel_index);
+            spin_lock_irqsave(channel_lock, irq_saved_flags);
+            hailo_vdma_engine_disable_channels(engine, BIT(channel_index), hailo_vdma_transfer_aborted, controller);
+            spin_unlock_irqrestore(channel_lock, irq_saved_flags);
+        }
+    }
+
+    hailo_vdma_free_engine_ongoing_transfers(controller, engine_index, channels_bitmap);
+}
+
+void hailo_vdma_read_channel_stats(struct hailo_vdma_controller *controller, size_t engine_index, u8 channel_index,
+    struct hailo_vdma_channel_stats *stats)
+{
+    spinlock_t *channel_lock = hailo_vdma_channel_lock(controller, engine_index, channel_index);
+    unsigned long irq_saved_flags = 0;
+
+    spin_lock_irqsave(channel_lock, irq_saved_flags);
+    *stats = controller->vdma_engines[engine_index].channels[channel_index].stats;
+    spin_unlock_irqrestore(channel_lock, irq_saved_flags);
+}
+
+static void release_completion_ring(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller)
+{
+    struct hailo_vdma_completion_ring_buffer *ring_buffer = context->completion_ring;
+    size_t engine_index = 0;
+    u8 channel_index = 0;
+    unsigned long irq_saved_flags = 0;
+
+    if (NULL == ring_buffer) {
+        return;
+    }
+
+    spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
+    for (engine_index = 0; engine_index < controller->vdma_engines_count; engine_index++) {
+        for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE; channel_index++) {
+            if (ring_buffer == controller->completion_rings[engine_index][channel_index]) {
+                controller->completion_rings[engine_index][channel_index] = NULL;
+            }
+        }
+    }
+    spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+
+    vfree(ring_buffer->ring);
+    kfree(ring_buffer);
+    context->completion_ring = NULL;
+}
+
 void hailo_vdma_file_context_finalize(struct hailo_vdma_file_context *context,
     struct hailo_vdma_controller *controller, struct file *filp)
 {
@@ -130,7 +368,7 @@ void hailo_vdma_file_context_finalize(struct hailo_vdma_file_context *context,
         if (context->enabled_channels_bitmap[engine_index]) {
             hailo_dev_info(controller->dev, "Disabling channels for engine %zu, channels bitmap 0x%x\n", engine_index, 
             context->enabled_channels_bitmap[engine_index]);
-            hailo_vdma_engine_disable_channels(engine, context->enabled_channels_bitmap[engine_index]);
+            hailo_vdma_disable_engine_channels(controller, engine_index, context->enabled_channels_bitmap[engine_index]);
 
             if (is_device_up) {
                 hailo_vdma_update_interrupts_mask(controller, engine_index);
@@ -142,16 +380,175 @@ void hailo_vdma_file_context_finalize(struct hailo_vdma_file_context *context,
         }
     }
 
+    // The aborted transfers references are dropped from a work, so the buffers are unmapped before the file is
+    // closed.
+    hailo_vdma_buffer_flush_deferred_puts();
+
     hailo_vdma_clear_mapped_user_buffer_list(context, controller);
-    hailo_vdma_clear_descriptors_buffer_list(context, controller);
+    hailo_vdma_buffer_cache_finalize(&context->buffer_cache);
+    // Idle attachments keep their dmabufs alive, so they are not kept after the file is closed.
+    hailo_dmabuf_cache_finalize(&context->dmabuf_cache);
+    hailo_vdma_clear_descriptors_buffer_list(context);
     hailo_vdma_clear_low_memory_buffer_list(context);
     hailo_vdma_clear_continuous_buffer_list(context, controller);
+    release_completion_ring(context, controller);
 
     if (filp == controller->used_by_filp) {
         controller->used_by_filp = NULL;
     }
 }
 
+void hailo_vdma_transfer_done(struct hailo_ongoing_transfer *transfer, void *opaque)
+{
+    u8 i = 0;
+    struct hailo_vdma_controller *controller = (struct hailo_vdma_controller *)opaque;
+    for (i = 0; i < transfer->buffers_count; i++) {
+        struct hailo_vdma_buffer *mapped_buffer = (struct hailo_vdma_buffer *)transfer->buffers[i].opaque;
+        hailo_vdma_buffer_sync_cyclic(controller, mapped_buffer, HAILO_SYNC_FOR_CPU,
+            transfer->buffers[i].offset, transfer->buffers[i].size);
+        hailo_vdma_buffer_put_deferred(mapped_buffer);
+    }
+}
+
+void hailo_vdma_transfer_aborted(struct hailo_ongoing_transfer *transfer, void *opaque)
+{
+    u8 i = 0;
+    for (i = 0; i < transfer->buffers_count; i++) {
+        hailo_vdma_buffer_put_deferred((struct hailo_vdma_buffer *)transfer->buffers[i].opaque);
+    }
+}
+
+// Completes the transfers of channels that have a completion ring. If the ring is full, the channel
+// is left for HAILO_VDMA_INTERRUPTS_WAIT.
+static void push_completions(struct hailo_vdma_controller *controller, struct hailo_vdma_engine *engine,
+    u32 channels_bitmap)
+{
+    struct hailo_vdma_completion_ring_buffer *ring_buffer = NULL;
+    struct hailo_vdma_channel *channel = NULL;
+    u8 channel_index = 0;
+    unsigned long irq_saved_flags = 0;
+
+    spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
+    if (controller->is_removed) {
+        // The channel registers may already be released.
+        spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+        return;
+    }
+
+    for_each_vdma_channel(engine, channel, channel_index) {
+        ring_buffer = controller->completion_rings[engine->index][channel_index];
+        if ((NULL == ring_buffer) || !hailo_test_bit(channel_index, &channels_bitmap) ||
+            !hailo_test_bit(channel_index, &engine->enabled_channels)) {
+            continue;
+        }
+
+        spin_lock(hailo_vdma_channel_lock(controller, engine->index, channel_index));
+        if (!hailo_vdma_channel_push_completion(ring_buffer->ring, &ring_buffer->head, engine, channel,
+                hailo_vdma_transfer_done, controller)) {
+            hailo_dev_dbg(controller->dev, "Completion ring is full, channel %u:%u\n", engine->index,
+                channel_index);
+        }
+        spin_unlock(hailo_vdma_channel_lock(controller, engine->index, channel_index));
+    }
+    spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+}
+
+// Completing a transfer syncs its buffers for the CPU, which may copy the whole buffer (e.g. from a swiotlb bounce
+// buffer), so the completion rings are filled from a work rather than from the interrupt handler. The ring waiters
+// are woken up once the ring is updated.
+static void completion_work(struct work_struct *work)
+{
+    struct hailo_vdma_controller *controller =
+        container_of(work, struct hailo_vdma_controller, completion_work);
+    struct hailo_vdma_engine *engine = NULL;
+    size_t engine_index = 0;
+    u32 channels_bitmap = 0;
+    unsigned long irq_saved_flags = 0;
+
+    for_each_vdma_engine(controller, engine, engine_index) {
+        spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
+        channels_bitmap = controller->completion_pending_channels[engine_index];
+        controller->completion_pending_channels[engine_index] = 0;
+        spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+
+        if (0 != channels_bitmap) {
+            push_completions(controller, engine, channels_bitmap);
+            hailo_vdma_wakeup_interrupts(controller, engine, channels_bitmap);
+        }
+    }
+}
+
+// Marks the interrupted channels that have a completion ring for completion_work. Returns their bitmap.
+static u32 defer_completions(struct hailo_vdma_controller *controller, struct hailo_vdma_engine *engine,
+    u32 channels_bitmap)
+{
+    u32 ring_channels_bitmap = 0;
+    u8 channel_index = 0;
+    unsigned long irq_saved_flags = 0;
+
+    spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
+    for (channel_index = 0; channel_index < MAX_VDMA_CHANNELS_PER_ENGINE; channel_index++) {
+        if (hailo_test_bit(channel_index, &channels_bitmap) &&
+            (NULL != controller->completion_rings[engine->index][channel_index])) {
+            hailo_set_bit(channel_index, &ring_channels_bitmap);
+        }
+    }
+    controller->completion_pending_channels[engine->index] |= ring_channels_bitmap;
+    spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+
+    if (0 != ring_channels_bitmap) {
+        queue_work(system_highpri_wq, &controller->completion_work);
+    }
+
+    return ring_channels_bitmap;
+}
+
+void hailo_vdma_add_interrupts_waiter(struct hailo_vdma_controller *controller,
+    struct hailo_vdma_interrupts_waiter *waiter, const u32 *channels_bitmap_per_engine)
+{
+    unsigned long irq_saved_flags = 0;
+
+    waiter->channels_bitmap_per_engine = channels_bitmap_per_engine;
+    init_waitqueue_head(&waiter->wq);
+
+    spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
+    list_add_tail(&waiter->waiters_list, &controller->interrupts_waiters);
+    spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+}
+
+void hailo_vdma_remove_interrupts_waiter(struct hailo_vdma_controller *controller,
+    struct hailo_vdma_interrupts_waiter *waiter)
+{
+    unsigned long irq_saved_flags = 0;
+
+    spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
+    list_del(&waiter->waiters_list);
+    spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+}
+
+// Must be called under controller->interrupts_lock
+static void wakeup_waiters_locked(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap)
+{
+    struct hailo_vdma_interrupts_waiter *waiter = NULL;
+
+    list_for_each_entry(waiter, &controller->interrupts_waiters, waiters_list) {
+        if (0 != (waiter->channels_bitmap_per_engine[engine_index] & channels_bitmap)) {
+            wake_up_interruptible(&waiter->wq);
+        }
+    }
+}
+
+void hailo_vdma_wakeup_waiters(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap)
+{
+    unsigned long irq_saved_flags = 0;
+
+    spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
+    wakeup_waiters_locked(controller, engine_index, channels_bitmap);
+    spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+}
+
 void hailo_vdma_wakeup_interrupts(struct hailo_vdma_controller *controller, struct hailo_vdma_engine *engine, 
     u32 channels_bitmap)
 {
@@ -159,26 +556,64 @@ void hailo_vdma_wakeup_interrupts(struct hailo_vdma_controller *controller, stru
 
     spin_lock_irqsave(&controller->interrupts_lock, irq_saved_flags);
     hailo_vdma_engine_set_channel_interrupts(engine, channels_bitmap);
+    wakeup_waiters_locked(controller, engine->index, channels_bitmap);
     spin_unlock_irqrestore(&controller->interrupts_lock, irq_saved_flags);
+}
 
-    wake_up_interruptible_all(&controller->interrupts_wq);
+static void count_interrupts(struct hailo_vdma_controller *controller, struct hailo_vdma_engine *engine,
+    u32 channels_bitmap)
+{
+    struct hailo_vdma_channel *channel = NULL;
+    spinlock_t *channel_lock = NULL;
+    unsigned long irq_saved_flags = 0;
+    u8 channel_index = 0;
+
+    // The channel stats are read and updated under the channel lock.
+    for_each_vdma_channel(engine, channel, channel_index) {
+        if (hailo_test_bit(channel_index, &channels_bitmap)) {
+            channel_lock = hailo_vdma_channel_lock(controller, engine->index, channel_index);
+            spin_lock_irqsave(channel_lock, irq_saved_flags);
+            channel->stats.interrupts++;
+            spin_unlock_irqrestore(channel_lock, irq_saved_flags);
+        }
+    }
 }
 
 void hailo_vdma_irq_handler(struct hailo_vdma_controller *controller,
     size_t engine_index, u32 channels_bitmap)
 {
     struct hailo_vdma_engine *engine = NULL;
+    u32 ring_channels_bitmap = 0;
 
     BUG_ON(engine_index >= controller->vdma_engines_count);
     engine = &controller->vdma_engines[engine_index];
 
     hailo_vdma_engine_push_timestamps(engine, channels_bitmap);
+    count_interrupts(controller, engine, channels_bitmap);
 
-    hailo_vdma_wakeup_interrupts(controller, engine, channels_bitmap);
+    // Channels with completion ring are woken up by completion_work, so users can block until the ring is updated.
+    ring_channels_bitmap = defer_completions(controller, engine, channels_bitmap);
+    hailo_vdma_wakeup_interrupts(controller, engine, channels_bitmap & ~ring_channels_bitmap);
 }
 
-long hailo_vdma_ioctl(struct hailo_vdma_file_context *context, struct hailo_vdma_controller *controller,
-    unsigned int cmd, unsigned long arg, struct file *filp, struct semaphore *mutex, bool *should_up_board_mutex)
+// Control plane ioctls change the channels configuration or shared controller state, and are called under the
+// board mutex. The rest are protected by the file context lock and the channels locks.
+static bool is_control_plane_ioctl(unsigned int cmd)
+{
+    switch (cmd) {
+    case HAILO_VDMA_ENABLE_CHANNELS:
+    case HAILO_VDMA_DISABLE_CHANNELS:
+    case HAILO_VDMA_INTERRUPTS_READ_TIMESTAMPS:
+    case HAILO_MARK_AS_IN_USE:
+    case HAILO_VDMA_COMPLETION_RING_CREATE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static long vdma_ioctl(struct hailo_vdma_file_context *context, struct hailo_vdma_controller *controller,
+    unsigned int cmd, unsigned long arg, struct file *filp)
 {
     switch (cmd) {
     case HAILO_VDMA_ENABLE_CHANNELS:
@@ -186,7 +621,7 @@ long hailo_vdma_ioctl(struct hailo_vdma_file_context *context, struct hailo_vdma
     case HAILO_VDMA_DISABLE_CHANNELS:
         return hailo_vdma_disable_channels_ioctl(controller, arg, context);
     case HAILO_VDMA_INTERRUPTS_WAIT:
-        return hailo_vdma_interrupts_wait_ioctl(controller, arg, mutex, should_up_board_mutex);
+        return hailo_vdma_interrupts_wait_ioctl(controller, arg);
     case HAILO_VDMA_INTERRUPTS_READ_TIMESTAMPS:
         return hailo_vdma_interrupts_read_timestamps_ioctl(controller, arg);
     case HAILO_VDMA_BUFFER_MAP:
@@ -211,23 +646,52 @@ long hailo_vdma_ioctl(struct hailo_vdma_file_context *context, struct hailo_vdma
         return hailo_vdma_continuous_buffer_alloc_ioctl(context, controller, arg);
     case HAILO_VDMA_CONTINUOUS_BUFFER_FREE:
         return hailo_vdma_continuous_buffer_free_ioctl(context, controller, arg);
+    case HAILO_VDMA_BUFFER_EXPORT_DMABUF:
+        return hailo_vdma_buffer_export_dmabuf_ioctl(context, controller, arg);
     case HAILO_VDMA_LAUNCH_TRANSFER:
         return hailo_vdma_launch_transfer_ioctl(context, controller, arg);
+    case HAILO_VDMA_LAUNCH_TRANSFERS_BATCH:
+        return hailo_vdma_launch_transfers_batch_ioctl(context, controller, arg);
+    case HAILO_VDMA_LAUNCH_SCATTER_TRANSFER:
+        return hailo_vdma_launch_scatter_transfer_ioctl(context, controller, arg);
+    case HAILO_VDMA_COMPLETION_RING_CREATE:
+        return hailo_vdma_completion_ring_create_ioctl(context, controller, arg);
     default:
         hailo_dev_err(controller->dev, "Invalid vDMA ioctl code 0x%x (nr: %d)\n", cmd, _IOC_NR(cmd));
         return -ENOTTY;
     }
 }
 
+long hailo_vdma_ioctl(struct hailo_vdma_file_context *context, struct hailo_vdma_controller *controller,
+    unsigned int cmd, unsigned long arg, struct file *filp, struct semaphore *mutex, bool *should_up_board_mutex)
+{
+    long err = 0;
+
+    // Taken before the board mutex is released, so device removal (which holds the board mutex) waits for the
+    // data path ioctls as well.
+    down_read(&controller->inflight_lock);
+
+    if (!is_control_plane_ioctl(cmd)) {
+        // Don't block other streams (and control ioctls) on the data path.
+        up(mutex);
+        *should_up_board_mutex = false;
+    }
+
+    if (controller->is_removed) {
+        err = -ENODEV;
+    } else {
+        err = vdma_ioctl(context, controller, cmd, arg, filp);
+    }
+
+    up_read(&controller->inflight_lock);
+    return err;
+}
+
 static int low_memory_buffer_mmap(struct hailo_vdma_controller *controller,
     struct hailo_vdma_low_memory_buffer *vdma_buffer, struct vm_area_struct *vma)
 {
     int err     = 0;
-    size_t i    = 0;
     unsigned long vsize         = vma->vm_end - vma->vm_start;
-    unsigned long orig_vm_start = vma->vm_start;
-    unsigned long orig_vm_end   = vma->vm_end;
-    unsigned long page_fn       = 0;
 
     if (vsize != vdma_buffer->pages_count * PAGE_SIZE) {
         hailo_dev_err(controller->dev, "mmap size should be %lu (given %lu)\n",
@@ -235,24 +699,12 @@ static int low_memory_buffer_mmap(struct hailo_vdma_controller *controller,
         return -EINVAL;
     }
 
-    for (i = 0 ; i < vdma_buffer->pages_count ; i++) {
-        if (i > 0) {
-            vma->vm_start = vma->vm_end;
-        }
-        vma->vm_end = vma->vm_start + PAGE_SIZE;
-
-        page_fn = virt_to_phys(vdma_buffer->pages_address[i]) >> PAGE_SHIFT ;
-        err = remap_pfn_range(vma, vma->vm_start, page_fn, PAGE_SIZE, vma->vm_page_prot);
-
-        if (err != 0) {
-            hailo_dev_err(controller->dev, " fops_mmap failed mapping kernel page %d\n", err);
-            return err;
-        }
+    err = hailo_vdma_low_memory_buffer_insert_pages(vdma_buffer, vma);
+    if (err < 0) {
+        hailo_dev_err(controller->dev, " fops_mmap failed mapping kernel pages %d\n", err);
+        return err;
     }
 
-    vma->vm_start = orig_vm_start;
-    vma->vm_end = orig_vm_end;
-
     return 0;
 }
 
@@ -278,23 +730,65 @@ static int continuous_buffer_mmap(struct hailo_vdma_controller *controller,
     return 0;
 }
 
+static int completion_ring_mmap(struct hailo_vdma_controller *controller,
+    struct hailo_vdma_completion_ring_buffer *ring_buffer, struct vm_area_struct *vma)
+{
+    int err = 0;
+    const unsigned long vsize = vma->vm_end - vma->vm_start;
+
+    if (vsize > ring_buffer->size) {
+        hailo_dev_err(controller->dev, "mmap size should be less than %zu (given %lu)\n",
+            ring_buffer->size, vsize);
+        return -EINVAL;
+    }
+
+    err = remap_vmalloc_range(vma, ring_buffer->ring, 0);
+    if (err < 0) {
+        hailo_dev_err(controller->dev, " vdma_mmap failed remap_vmalloc_range %d\n", err);
+        return err;
+    }
+
+    return 0;
+}
+
 int hailo_vdma_mmap(struct hailo_vdma_file_context *context, struct hailo_vdma_controller *controller,
     struct vm_area_struct *vma, uintptr_t vdma_handle)
 {
     struct hailo_vdma_low_memory_buffer *low_memory_buffer = NULL;
     struct hailo_vdma_continuous_buffer *continuous_buffer = NULL;
+    int err = -EINVAL;
+
+    // mmap is called with the mmap lock held, while the ioctls may take it (e.g. pinning user pages) under the
+    // in-flight lock. A pending writer would block a reader here, so trylock is used - it fails only once the device
+    // is being removed.
+    if (!down_read_trylock(&controller->inflight_lock)) {
+        return -ENODEV;
+    }
+    if (controller->is_removed) {
+        up_read(&controller->inflight_lock);
+        return -ENODEV;
+    }
 
     hailo_dev_info(controller->dev, "Map vdma_handle %llu\n", (u64)vdma_handle);
+
+    mutex_lock(&context->lock);
     if (NULL != (low_memory_buffer = hailo_vdma_find_low_memory_buffer(context, vdma_handle))) {
-        return low_memory_buffer_mmap(controller, low_memory_buffer, vma);
+        err = low_memory_buffer_mmap(controller, low_memory_buffer, vma);
     }
     else if (NULL != (continuous_buffer = hailo_vdma_find_continuous_buffer(context, vdma_handle))) {
-        return continuous_buffer_mmap(controller, continuous_buffer, vma);
+        err = continuous_buffer_mmap(controller, continuous_buffer, vma);
+    }
+    else if ((NULL != context->completion_ring) && (vdma_handle == context->completion_ring->handle)) {
+        err = completion_ring_mmap(controller, context->completion_ring, vma);
     }
     else {
         hailo_dev_err(controller->dev, "Can't mmap vdma handle: %llu (not existing)\n", (u64)vdma_handle);
-        return -EINVAL;
+        err = -EINVAL;
     }
+    mutex_unlock(&context->lock);
+    up_read(&controller->inflight_lock);
+
+    return err;
 }
 
 enum dma_data_direction get_dma_direction(enum hailo_dma_data_direction hailo_direction)
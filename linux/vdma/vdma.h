@@ -12,12 +12,17 @@
 #include "hailo_ioctl_common.h"
 #include "hailo_resource.h"
 #include "vdma_common.h"
+#include "utils/compact.h"
 
 #include <linux/dma-mapping.h>
 #include <linux/types.h>
+#include <linux/mutex.h>
 #include <linux/semaphore.h>
+#include <linux/rwsem.h>
+#include <linux/llist.h>
 #include <linux/dma-buf.h>
 #include <linux/version.h>
+#include <linux/workqueue.h>
 
 #define VDMA_CHANNEL_CONTROL_REG_OFFSET(channel_index, direction) (((direction) == DMA_TO_DEVICE) ? \
             (((channel_index) << 5) + 0x0) : (((channel_index) << 5) + 0x10))
@@ -30,6 +35,21 @@
     ((u8*)((vdma_registers)->address) + VDMA_CHANNEL_NUM_PROC_OFFSET(channel_index, direction))
 
 
+// Cached pinned user buffers are invalidated using mmu interval notifiers
+#if IS_ENABLED(CONFIG_MMU_NOTIFIER) && (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0))
+#define HAILO_SUPPORT_VDMA_BUFFER_CACHE
+#endif
+
+// Imported dmabufs attachments are cached using dynamic attachments (invalidated by move_notify)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 7, 0)
+#define HAILO_SUPPORT_DMABUF_ATTACHMENT_CACHE
+#endif
+
+// Exporting driver allocated buffers as dmabufs requires dma_map_sgtable
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+#define HAILO_SUPPORT_DMABUF_EXPORT
+#endif
+
 // dmabuf is supported from linux kernel version 3.3
 #if LINUX_VERSION_CODE < KERNEL_VERSION( 3, 3, 0 )
 // Make dummy struct with one byte (C standards does not allow empty struct) - in order to not have to ifdef everywhere
@@ -43,11 +63,21 @@ struct hailo_dmabuf_info {
     struct dma_buf *dmabuf;
     struct dma_buf_attachment *dmabuf_attachment;
     struct sg_table *dmabuf_sg_table;
+    // The cached attachment the buffer is mapped with (see struct hailo_dmabuf_cache).
+    struct hailo_dmabuf_cache_entry *cache_entry;
 };
 #endif // LINUX_VERSION_CODE < KERNEL_VERSION( 3, 3, 0 )
 
+#define HAILO_VDMA_SG_INDEX_STRIDE (32)
+
+// Entry of the sparse sg table index - the dma offset (from the start of the buffer) of every
+// HAILO_VDMA_SG_INDEX_STRIDE'th sg entry.
+struct hailo_vdma_sg_index_entry {
+    struct scatterlist          *sg_entry;
+    size_t                      offset;
+};
+
 struct hailo_vdma_buffer {
-    struct list_head            mapped_user_buffer_list;
     size_t                      handle;
 
     struct kref                 kref;
@@ -58,19 +88,46 @@ struct hailo_vdma_buffer {
     enum dma_data_direction     data_direction;
     struct sg_table             sg_table;
 
+    // Cleared if the dma api reports that no entry of the buffer needs cache maintenance (coherent device, no
+    // bounce buffers), so syncing the buffer can be skipped.
+    bool                        needs_sync;
+
     // If this flag is set, the buffer pointed by sg_table is not backed by
     // 'struct page' (only by pure pfn). On this case, accessing to the page,
     // or calling APIs that access the page (e.g. dma_sync_sg_for_cpu) is not
     // allowed.
     bool                        is_mmio;
 
+    // Set if the pages of sg_table were pinned from user memory (and must be unpinned), rather than referenced
+    // driver allocated (or mmio) pages.
+    bool                        is_pinned_user_memory;
+
+    // Set if the pinned pages are memory of another PCIe device (p2pdma pages), mapped for peer to peer DMA. The
+    // cpu doesn't cache this memory, so the buffer is never synced. Buffers mixing p2pdma and host pages are rejected.
+    bool                        is_p2pdma;
+
     // Relevant paramaters that need to be saved in case of dmabuf - otherwise struct pointers will be NULL
     struct hailo_dmabuf_info  dmabuf_info;
+
+    // Used to seek to the sg entry of an offset when syncing part of the buffer. NULL if the buffer is never synced
+    // (dmabuf or mmio) or if the index allocation failed.
+    struct hailo_vdma_sg_index_entry *sg_index;
+    size_t                      sg_index_count;
+
+    // Set if the buffer may be kept in the file's buffer cache after unmap (see memory.c).
+    struct hailo_vdma_buffer_cache_entry *cache_entry;
+
+    // Used to unmap the buffer from a work when the last reference is dropped from atomic context (e.g. when an
+    // ongoing transfer is completed from the interrupt handler).
+    struct llist_node           deferred_unmap_node;
 };
 
 // Continuous buffer that holds a descriptor list.
 struct hailo_descriptors_list_buffer {
-    struct list_head                   descriptors_buffer_list;
+    // Held by the file until the list is released, and by launches, which use the list without the file context lock.
+    struct kref                        kref;
+    struct device                      *dev;
+    struct hailo_desc_list_pool        *pool;
     uintptr_t                          handle;
     void                               *kernel_address;
     dma_addr_t                         dma_address;
@@ -78,21 +135,121 @@ struct hailo_descriptors_list_buffer {
     struct hailo_vdma_descriptors_list desc_list;
 };
 
+// Physically contiguous part of a low memory buffer. The pages are split (each page has its own reference count).
+struct hailo_vdma_low_memory_chunk {
+    struct page                         *first_page;
+    unsigned int                        order;
+};
+
+// Low memory and continuous buffers are reference counted, since they may be exported as dmabufs that outlive the
+// file (or the free ioctl) that owns them.
 struct hailo_vdma_low_memory_buffer {
-    struct list_head                    vdma_low_memory_buffer_list;
+    struct kref                         kref;
     uintptr_t                           handle;
     size_t                              pages_count;
-    void                                **pages_address;
+    // The buffer pages, in order, in chunks of up to HAILO_LOW_MEMORY_MAX_CHUNK_ORDER (see memory.h).
+    struct hailo_vdma_low_memory_chunk  *chunks;
+    size_t                              chunks_count;
 };
 
+#define for_each_low_memory_chunk(buffer, chunk, chunk_index)                                       \
+    _for_each_element_array((buffer)->chunks, (buffer)->chunks_count, chunk, chunk_index)
+
 struct hailo_vdma_continuous_buffer {
-    struct list_head    continuous_buffer_list;
+    struct kref         kref;
+    struct device       *dev;
     uintptr_t           handle;
     void                *kernel_address;
     dma_addr_t          dma_address;
     size_t              size;
 };
 
+// Completion ring shared with user space (allocated with vmalloc_user).
+struct hailo_vdma_completion_ring_buffer {
+    uintptr_t                           handle;
+    struct hailo_vdma_completion_ring   *ring;
+    size_t                              size;
+    // Driver copy of ring->head, since the ring itself is writable by user space.
+    u32                                 head;
+};
+
+// Descriptors lists memory is pooled in power of 2 multiples of VDMA_DESCRIPTOR_LIST_ALIGN, from 64KB up to the size
+// of MAX_SG_DESCS_COUNT descriptors (1MB).
+#define HAILO_DESC_LIST_POOL_CLASSES_COUNT (5)
+
+struct hailo_desc_list_pool_stats {
+    atomic64_t hits;            // Lists created from pooled memory.
+    atomic64_t misses;          // Lists allocated with dma_alloc_coherent.
+    atomic64_t recycled;        // Released lists kept in the pool.
+    atomic64_t freed;           // Released lists freed, since their class of the pool was full.
+    atomic64_t cached_bytes;    // Memory currently held by the pool.
+};
+
+// Released descriptors lists memory of a device, kept for reuse by the next lists of the same size class, so creating
+// a list doesn't need a new (64KB aligned) coherent allocation.
+struct hailo_desc_list_pool {
+    spinlock_t                          lock;
+    // Lists of struct hailo_desc_list_pool_entry, one for each size class.
+    struct list_head                    free_lists[HAILO_DESC_LIST_POOL_CLASSES_COUNT];
+    size_t                              free_count[HAILO_DESC_LIST_POOL_CLASSES_COUNT];
+    // Set when the device is removed, lists released afterwards are freed.
+    bool                                is_finalized;
+    struct hailo_desc_list_pool_stats   stats;
+};
+
+struct hailo_vdma_buffer_cache_stats {
+    atomic64_t hits;
+    atomic64_t misses;
+    atomic64_t invalidations;
+    atomic64_t evictions;
+};
+
+// Pinned and dma mapped user buffers that were unmapped by the user, kept for reuse when the same user buffer is
+// mapped again.
+struct hailo_vdma_buffer_cache {
+    spinlock_t                              lock;
+    // Cached entries, most recently unmapped first.
+    struct list_head                        lru;
+    size_t                                  count;
+    // Cached entries invalidated by the mmu notifier, released from release_work.
+    struct list_head                        invalidated;
+    struct work_struct                      release_work;
+    struct hailo_vdma_buffer_cache_stats    *stats;
+    // Cache of the imported dmabufs mapped by the file.
+    struct hailo_dmabuf_cache               *dmabuf_cache;
+};
+
+struct hailo_dmabuf_cache_stats {
+    atomic64_t hits;            // Dmabufs mapped with an existing attachment.
+    atomic64_t misses;          // Dmabufs attached and mapped.
+    atomic64_t invalidations;   // Idle attachments mappings invalidated by the exporter (mapped again on reuse).
+    atomic64_t evictions;       // Idle attachments detached, since the cache was full.
+};
+
+// Attachments of the device to the dmabufs imported by a file (with their mapped sg table), kept after the buffers are
+// unmapped, so mapping the same dmabuf again (e.g. a camera frame pool cycled every frame) doesn't attach and map it
+// again. Idle attachments are unpinned, so the exporter may move the buffer and invalidate their mapping.
+struct hailo_dmabuf_cache {
+    // Protects the entries, taken before the dmabufs reservation locks.
+    struct mutex                        lock;
+    // All entries, in use and idle.
+    struct list_head                    entries;
+    // Idle entries, most recently unmapped first.
+    struct list_head                    lru;
+    size_t                              idle_count;
+    // Set when the file is closed, entries unmapped afterwards are released.
+    bool                                is_finalized;
+    // Stats of the device, shared by the caches of all files.
+    struct hailo_dmabuf_cache_stats     *stats;
+};
+
+// Thread waiting for interrupts on some channels, woken up only by interrupts on these channels.
+struct hailo_vdma_interrupts_waiter {
+    struct list_head    waiters_list;
+    const u32           *channels_bitmap_per_engine;
+    wait_queue_head_t   wq;
+};
+
 struct hailo_vdma_controller;
 struct hailo_vdma_controller_ops {
     void (*update_channel_interrupts)(struct hailo_vdma_controller *controller, size_t engine_index,
@@ -108,10 +265,42 @@ struct hailo_vdma_controller {
     struct hailo_vdma_engine *vdma_engines;
 
     spinlock_t interrupts_lock;
-    wait_queue_head_t interrupts_wq;
+    // Protects the state of each channel (ongoing transfers, num avail/proc), since transfers are launched and
+    // completed without the board mutex. When both are needed, interrupts_lock must be taken first.
+    spinlock_t channels_locks[MAX_VDMA_ENGINES][MAX_VDMA_CHANNELS_PER_ENGINE];
+    // Serializes the launches on each channel: syncing the buffers for the device and programming the descriptors,
+    // done without the file context lock. Taken before the channel lock.
+    struct mutex channels_launch_locks[MAX_VDMA_ENGINES][MAX_VDMA_CHANNELS_PER_ENGINE];
+    // List of hailo_vdma_interrupts_waiter, protected by interrupts_lock.
+    struct list_head interrupts_waiters;
 
     struct file *used_by_filp;
 
+    // Held for read by the vdma ioctls and mmap (the data path runs without the board mutex), and for write by
+    // hailo_vdma_controller_disconnect to drain them before the device resources are released.
+    struct rw_semaphore inflight_lock;
+    // Set once the device is removed, new vdma ioctls and mmaps fail with -ENODEV.
+    bool is_removed;
+
+    // Set if the device dma is coherent with the CPU caches. Buffers that don't need sync are not synced unless
+    // force_dma_sync is set (initialized from the module parameter, may be changed from debugfs).
+    bool dma_coherent;
+    bool force_dma_sync;
+
+    struct hailo_vdma_buffer_cache_stats buffer_cache_stats;
+
+    struct hailo_desc_list_pool desc_list_pool;
+
+    struct hailo_dmabuf_cache_stats dmabuf_cache_stats;
+
+    // Completion ring of each channel, NULL if the channel completions are
+    // reported only by HAILO_VDMA_INTERRUPTS_WAIT. Protected by interrupts_lock.
+    struct hailo_vdma_completion_ring_buffer *completion_rings[MAX_VDMA_ENGINES][MAX_VDMA_CHANNELS_PER_ENGINE];
+    // Channels with a completion ring interrupted since the last run of completion_work, which pushes their
+    // completions out of the interrupt handler. Protected by interrupts_lock.
+    u32 completion_pending_channels[MAX_VDMA_ENGINES];
+    struct work_struct completion_work;
+
     // Putting big IOCTL structures here to avoid stack allocation.
     struct hailo_vdma_interrupts_read_timestamp_params read_interrupt_timestamps_params;
 };
@@ -120,17 +309,37 @@ struct hailo_vdma_controller {
     _for_each_element_array(controller->vdma_engines, controller->vdma_engines_count,   \
         engine, engine_index)
 
+static inline spinlock_t *hailo_vdma_channel_lock(struct hailo_vdma_controller *controller,
+    u8 engine_index, u8 channel_index)
+{
+    return &controller->channels_locks[engine_index][channel_index];
+}
+
+static inline struct mutex *hailo_vdma_channel_launch_lock(struct hailo_vdma_controller *controller,
+    u8 engine_index, u8 channel_index)
+{
+    return &controller->channels_launch_locks[engine_index][channel_index];
+}
+
 struct hailo_vdma_file_context {
+    // Protects the buffers and descriptors tables below. vDMA data path ioctls are called without the board
+    // mutex, so they may run concurrently on the same file.
+    struct mutex lock;
+
     atomic_t last_vdma_user_buffer_handle;
-    struct list_head mapped_user_buffer_list;
+    // Tables of the buffers and descriptors lists owned by the file, indexed by their handle (see memory.c).
+    struct xarray mapped_user_buffers;
+    struct hailo_vdma_buffer_cache buffer_cache;
+    struct hailo_dmabuf_cache dmabuf_cache;
 
     // Last_vdma_handle works as a handle for vdma decriptor list and for the vdma buffer -
     // there will be no collisions between the two
     atomic_t last_vdma_handle;
-    struct list_head descriptors_buffer_list;
-    struct list_head vdma_low_memory_buffer_list;
-    struct list_head continuous_buffer_list;
+    struct xarray descriptors_buffers;
+    struct xarray vdma_low_memory_buffers;
+    struct xarray continuous_buffers;
     u32 enabled_channels_bitmap[MAX_VDMA_ENGINES];
+    struct hailo_vdma_completion_ring_buffer *completion_ring;
 };
 
 
@@ -139,13 +348,55 @@ int hailo_vdma_controller_init(struct hailo_vdma_controller *controller,
     struct hailo_vdma_controller_ops *ops,
     struct hailo_resource *channel_registers_per_engine, size_t engines_count);
 
+// Fails new vdma ioctls and mmaps, wakes up the interrupt waiters and waits for the ongoing ioctls and mmaps to
+// finish. Must be called on device removal, before the device resources are released.
+void hailo_vdma_controller_disconnect(struct hailo_vdma_controller *controller);
+
+// Releases the controller resources that are bound to the device, must be called before the device is removed.
+void hailo_vdma_controller_finalize(struct hailo_vdma_controller *controller);
+
 void hailo_vdma_update_interrupts_mask(struct hailo_vdma_controller *controller,
     size_t engine_index);
 
-void hailo_vdma_file_context_init(struct hailo_vdma_file_context *context);
+void hailo_vdma_file_context_init(struct hailo_vdma_file_context *context,
+    struct hailo_vdma_controller *controller);
 void hailo_vdma_file_context_finalize(struct hailo_vdma_file_context *context,
     struct hailo_vdma_controller *controller, struct file *filp);
 
+// Each buffer of an ongoing transfer holds a reference, dropped when the transfer is done or aborted.
+void hailo_vdma_transfer_done(struct hailo_ongoing_transfer *transfer, void *opaque);
+void hailo_vdma_transfer_aborted(struct hailo_ongoing_transfer *transfer, void *opaque);
+
+// Allocates the ongoing transfers lists of the given channels of the engine, sized by the max_ongoing_transfers
+// module parameter. Must be called before the channels are enabled.
+int hailo_vdma_alloc_engine_ongoing_transfers(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap);
+
+// Releases the ongoing transfers lists of the given (disabled) channels of the engine.
+void hailo_vdma_free_engine_ongoing_transfers(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap);
+
+// Disables the given channels of the engine, detaches them from their completion ring and releases their ongoing
+// transfers lists.
+void hailo_vdma_disable_engine_channels(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap);
+
+// Copies the performance counters of the channel (taken under the channel lock).
+void hailo_vdma_read_channel_stats(struct hailo_vdma_controller *controller, size_t engine_index, u8 channel_index,
+    struct hailo_vdma_channel_stats *stats);
+
+// Must be called under controller->interrupts_lock
+void hailo_vdma_detach_completion_ring(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap);
+
+void hailo_vdma_add_interrupts_waiter(struct hailo_vdma_controller *controller,
+    struct hailo_vdma_interrupts_waiter *waiter, const u32 *channels_bitmap_per_engine);
+void hailo_vdma_remove_interrupts_waiter(struct hailo_vdma_controller *controller,
+    struct hailo_vdma_interrupts_waiter *waiter);
+// Wakes up the waiters of the given channels, without marking them as interrupted.
+void hailo_vdma_wakeup_waiters(struct hailo_vdma_controller *controller, size_t engine_index,
+    u32 channels_bitmap);
+
 void hailo_vdma_wakeup_interrupts(struct hailo_vdma_controller *controller, struct hailo_vdma_engine *engine, 
     u32 channels_bitmap);
 void hailo_vdma_irq_handler(struct hailo_vdma_controller *controller, size_t engine_index,